@@ -1,23 +1,27 @@
 #include "agent_loop.h"
 #include "agent/context_builder.h"
+#include "agent/history_summary.h"
+#include "agent/turn_arena.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
 #include "llm/llm_proxy.h"
 #include "memory/session_mgr.h"
 #include "tools/tool_registry.h"
+#include "tools/tool_executor.h"
+#include "proxy/http_pool.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "cJSON.h"
 
 static const char *TAG = "agent";
 
-#define TOOL_OUTPUT_SIZE  (8 * 1024)
-
 /* Build the assistant content array from llm_response_t for the messages history.
  * Returns a cJSON array with text and tool_use blocks. */
 static cJSON *build_assistant_content(const llm_response_t *resp)
@@ -136,200 +140,781 @@ static char *patch_tool_input_with_context(const llm_tool_call_t *call, const mi
     return patched;
 }
 
-/* Build the user message with tool_result blocks */
+/* Build the user message with tool_result blocks (independent calls run concurrently).
+ * *cancelled counts calls skipped or abandoned because cancel was set. */
 static cJSON *build_tool_results(const llm_response_t *resp, const mimi_msg_t *msg,
-                                 char *tool_output, size_t tool_output_size)
+                                 const volatile bool *cancel, int *cancelled)
 {
     cJSON *content = cJSON_CreateArray();
+    tool_exec_call_t calls[MIMI_MAX_TOOL_CALLS] = {0};
+    char *patched[MIMI_MAX_TOOL_CALLS] = {0};
+    int count = resp->call_count;
 
-    for (int i = 0; i < resp->call_count; i++) {
+    for (int i = 0; i < count; i++) {
         const llm_tool_call_t *call = &resp->calls[i];
-        const char *tool_input = call->input ? call->input : "{}";
-        char *patched_input = patch_tool_input_with_context(call, msg);
-        if (patched_input) {
-            tool_input = patched_input;
-        }
+        patched[i] = patch_tool_input_with_context(call, msg);
+        calls[i].name = call->name;
+        calls[i].input = patched[i] ? patched[i] : (call->input ? call->input : "{}");
+    }
 
-        /* Execute tool */
-        tool_output[0] = '\0';
-        tool_registry_execute(call->name, tool_input, tool_output, tool_output_size);
-        free(patched_input);
+    int64_t start_us = esp_timer_get_time();
+    tool_executor_run(calls, count, cancel);
+    if (count > 1) {
+        ESP_LOGI(TAG, "%d tool calls done in %lld ms", count,
+                 (long long)((esp_timer_get_time() - start_us) / 1000));
+    }
 
-        ESP_LOGI(TAG, "Tool %s result: %d bytes", call->name, (int)strlen(tool_output));
+    for (int i = 0; i < count; i++) {
+        const char *output = calls[i].output ? calls[i].output : "Error: no output";
+        ESP_LOGI(TAG, "Tool %s result: %d bytes", calls[i].name, (int)strlen(output));
+        if (calls[i].err == ESP_ERR_INVALID_STATE) (*cancelled)++;
 
         /* Build tool_result block */
         cJSON *result_block = cJSON_CreateObject();
         cJSON_AddStringToObject(result_block, "type", "tool_result");
-        cJSON_AddStringToObject(result_block, "tool_use_id", call->id);
-        cJSON_AddStringToObject(result_block, "content", tool_output);
+        cJSON_AddStringToObject(result_block, "tool_use_id", resp->calls[i].id);
+        cJSON_AddStringToObject(result_block, "content", output);
         cJSON_AddItemToArray(content, result_block);
+
+        free(calls[i].output);
+        cJSON_free(patched[i]);
     }
 
     return content;
 }
 
-static void agent_loop_task(void *arg)
-{
-    ESP_LOGI(TAG, "Agent loop started on core %d", xPortGetCoreID());
-
-    /* Allocate large buffers from PSRAM */
-    char *system_prompt = heap_caps_calloc(1, MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
-    char *history_json = heap_caps_calloc(1, MIMI_LLM_STREAM_BUF_SIZE, MALLOC_CAP_SPIRAM);
-    char *tool_output = heap_caps_calloc(1, TOOL_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
+#if MIMI_LLM_STREAM
+typedef struct {
+    int64_t start_us;
+    bool first_seen;
+} stream_probe_t;
 
-    if (!system_prompt || !history_json || !tool_output) {
-        ESP_LOGE(TAG, "Failed to allocate PSRAM buffers");
-        vTaskDelete(NULL);
-        return;
+/* Text deltas arrive as the model generates; log time-to-first-token */
+static void on_stream_text(const char *delta, size_t len, void *user_ctx)
+{
+    stream_probe_t *probe = (stream_probe_t *)user_ctx;
+    (void)delta;
+    if (!probe->first_seen && len > 0) {
+        probe->first_seen = true;
+        ESP_LOGI(TAG, "LLM first token after %lld ms",
+                 (long long)((esp_timer_get_time() - probe->start_us) / 1000));
     }
+}
+#endif
 
-    const char *tools_json = tool_registry_get_tools_json();
-
-    while (1) {
-        mimi_msg_t msg;
-        esp_err_t err = message_bus_pop_inbound(&msg, UINT32_MAX);
-        if (err != ESP_OK) continue;
-
-        ESP_LOGI(TAG, "Processing message from %s:%s", msg.channel, msg.chat_id);
-
-        /* 1. Build system prompt */
-        context_build_system_prompt(system_prompt, MIMI_CONTEXT_BUF_SIZE);
-        append_turn_context_prompt(system_prompt, MIMI_CONTEXT_BUF_SIZE, &msg);
-        ESP_LOGI(TAG, "LLM turn context: channel=%s chat_id=%s", msg.channel, msg.chat_id);
-
-        /* 2. Load session history into cJSON array */
-        session_get_history_json(msg.chat_id, history_json,
-                                 MIMI_LLM_STREAM_BUF_SIZE, MIMI_AGENT_MAX_HISTORY);
+/* ── Turn ─────────────────────────────────────────────────────── */
+
+/* Why a turn was cancelled */
+typedef enum {
+    TURN_RUN = 0,                        /* not cancelled */
+    TURN_STOPPED,                        /* /stop from the chat, or the CLI */
+    TURN_SUPERSEDED,                     /* a newer message of the chat joins it in a new turn */
+} turn_cancel_t;
+
+typedef struct {
+    int id;
+    char *system_prompt;                 /* PSRAM, MIMI_CONTEXT_BUF_SIZE */
+    turn_arena_t *arena;                 /* cJSON allocations of the running turn; NULL = heap */
+    http_cancel_t cancel;                /* attached to the worker task: cuts off its LLM request */
+    uint8_t cancel_reason;               /* turn_cancel_t; s_lock */
+    bool committed;                      /* reply queued, no longer cancellable; s_lock */
+    bool pinned;                         /* ran a tool with side effects: not supersedable; s_lock */
+    bool requeue_slot;                   /* s_space_sem slot held for the superseded message; s_lock */
+    int64_t cancel_us;                   /* when the running turn was cancelled; s_lock */
+} agent_worker_t;
+
+/* What a turn spent before it was cancelled */
+typedef struct {
+    turn_cancel_t cancelled;
+    uint32_t llm_aborted;                /* LLM requests cut off mid-flight */
+    uint32_t tools_cancelled;            /* tool calls skipped or abandoned */
+    uint32_t tokens;                     /* input + output tokens already billed */
+    bool saved;                          /* turn appended to the session history */
+} turn_result_t;
+
+static turn_cancel_t turn_commit(agent_worker_t *w);
+static void turn_pin(agent_worker_t *w);
+
+/* Whether every call of the response is free of side effects (unknown tools only fail) */
+static bool calls_read_only(const llm_response_t *resp)
+{
+    for (int i = 0; i < resp->call_count; i++) {
+        const mimi_tool_t *tool = tool_registry_find(resp->calls[i].name);
+        if (tool && !tool->read_only) return false;
+    }
+    return true;
+}
 
-        cJSON *messages = cJSON_Parse(history_json);
-        if (!messages) messages = cJSON_CreateArray();
+/* Fixed replies are built once in agent_loop_init(); every send pushes another reference */
+#define WORKING_TEXT  "\xF0\x9F\x90\xB1mimi is working..."
+#define ERROR_TEXT    "Sorry, I encountered an error."
 
-        /* 3. Append current user message */
-        cJSON *user_msg = cJSON_CreateObject();
-        cJSON_AddStringToObject(user_msg, "role", "user");
-        cJSON_AddStringToObject(user_msg, "content", msg.content);
-        cJSON_AddItemToArray(messages, user_msg);
+static char *s_working_text;
+static char *s_error_text;
 
-        /* 4. ReAct loop */
-        char *final_text = NULL;
-        int iteration = 0;
-        bool sent_working_status = false;
+static char *shared_text(char *shared, const char *text)
+{
+    return shared ? payload_ref(shared) : payload_dup(text);
+}
 
-        while (iteration < MIMI_AGENT_MAX_TOOL_ITER) {
-            /* Send "working" indicator before each API call */
+/*
+ * Run one turn. A cancelled turn stops at the next LLM call, tool run or
+ * iteration and sends nothing; a superseded one keeps msg->content for the
+ * caller to queue again, every other outcome releases it.
+ */
+static void agent_run_turn(agent_worker_t *w, mimi_msg_t *msg, turn_result_t *result)
+{
+    const char *tools_json = tool_registry_get_tools_json();
+    esp_err_t err;
+
+    ESP_LOGI(TAG, "Processing message from %s:%s", msg->channel, msg->chat_id);
+    int64_t turn_start_us = esp_timer_get_time();
+    http_pool_stats_t net_before;
+    http_pool_get_stats(&net_before);
+
+    /* 1. Load session history into cJSON array */
+    cJSON *messages = session_get_history(msg->chat_id, MIMI_AGENT_MAX_HISTORY);
+    if (!messages) messages = cJSON_CreateArray();
+
+    /* 2. Build system prompt (stable prefix first, per-turn context appended);
+     *    history is trimmed to the same token budget */
+    size_t stable_len = 0;
+    context_build_system_prompt(w->system_prompt, MIMI_CONTEXT_BUF_SIZE, &stable_len,
+                                messages, msg->content);
+    append_turn_context_prompt(w->system_prompt, MIMI_CONTEXT_BUF_SIZE, msg);
+    ESP_LOGI(TAG, "LLM turn context: channel=%s chat_id=%s", msg->channel, msg->chat_id);
+
+    /* 3. Append current user message */
+    cJSON *user_msg = cJSON_CreateObject();
+    cJSON_AddStringToObject(user_msg, "role", "user");
+    cJSON_AddStringToObject(user_msg, "content", msg->content);
+    cJSON_AddItemToArray(messages, user_msg);
+
+    /* 4. ReAct loop */
+    char *final_text = NULL;
+    int iteration = 0;
+    llm_usage_t usage = {0};
+    bool sent_working_status = false;
+    memset(result, 0, sizeof(*result));
+
+    while (iteration < MIMI_AGENT_MAX_TOOL_ITER && !w->cancel.fired) {
+        /* Send "working" indicator before each API call */
 #if MIMI_AGENT_SEND_WORKING_STATUS
-            if (!sent_working_status && strcmp(msg.channel, MIMI_CHAN_SYSTEM) != 0) {
-                mimi_msg_t status = {0};
-                strncpy(status.channel, msg.channel, sizeof(status.channel) - 1);
-                strncpy(status.chat_id, msg.chat_id, sizeof(status.chat_id) - 1);
-                status.content = strdup("\xF0\x9F\x90\xB1mimi is working...");
-                if (status.content) {
-                    if (message_bus_push_outbound(&status) != ESP_OK) {
-                        ESP_LOGW(TAG, "Outbound queue full, drop working status");
-                        free(status.content);
-                    } else {
-                        sent_working_status = true;
-                    }
+        if (!sent_working_status && strcmp(msg->channel, MIMI_CHAN_SYSTEM) != 0) {
+            mimi_msg_t status = {0};
+            strncpy(status.channel, msg->channel, sizeof(status.channel) - 1);
+            strncpy(status.chat_id, msg->chat_id, sizeof(status.chat_id) - 1);
+            status.content = shared_text(s_working_text, WORKING_TEXT);
+            if (status.content) {
+                if (message_bus_push_outbound(&status) != ESP_OK) {
+                    ESP_LOGW(TAG, "Outbound queue full, drop working status");
+                    payload_release(status.content);
+                } else {
+                    sent_working_status = true;
                 }
             }
+        }
 #endif
 
-            llm_response_t resp;
-            err = llm_chat_tools(system_prompt, messages, tools_json, &resp);
+        llm_response_t resp;
+#if MIMI_LLM_STREAM
+        stream_probe_t probe = { .start_us = esp_timer_get_time() };
+        err = llm_chat_tools_stream(w->system_prompt, stable_len, messages, tools_json,
+                                    on_stream_text, &probe, &resp);
+#else
+        err = llm_chat_tools(w->system_prompt, stable_len, messages, tools_json, &resp);
+#endif
 
-            if (err != ESP_OK) {
+        if (err != ESP_OK) {
+            if (w->cancel.fired) {
+                ESP_LOGI(TAG, "LLM request aborted: turn cancelled");
+                result->llm_aborted++;
+            } else {
                 ESP_LOGE(TAG, "LLM call failed: %s", esp_err_to_name(err));
-                break;
             }
+            break;
+        }
 
-            if (!resp.tool_use) {
-                /* Normal completion — save final text and break */
-                if (resp.text && resp.text_len > 0) {
-                    final_text = strdup(resp.text);
-                }
-                llm_response_free(&resp);
-                break;
+        usage.input_tokens += resp.usage.input_tokens;
+        usage.output_tokens += resp.usage.output_tokens;
+        usage.cache_read_tokens += resp.usage.cache_read_tokens;
+        usage.cache_creation_tokens += resp.usage.cache_creation_tokens;
+
+        if (!resp.tool_use) {
+            /* Normal completion — save final text and break */
+            if (resp.text && resp.text_len > 0) {
+                final_text = payload_dup(resp.text);   /* becomes the outbound content */
             }
+            llm_response_free(&resp);
+            break;
+        }
 
-            ESP_LOGI(TAG, "Tool use iteration %d: %d calls", iteration + 1, resp.call_count);
+        ESP_LOGI(TAG, "Tool use iteration %d: %d calls", iteration + 1, resp.call_count);
+
+        /* Append assistant message with content array */
+        cJSON *asst_msg = cJSON_CreateObject();
+        cJSON_AddStringToObject(asst_msg, "role", "assistant");
+        cJSON_AddItemToObject(asst_msg, "content", build_assistant_content(&resp));
+        cJSON_AddItemToArray(messages, asst_msg);
+
+        /* Execute tools and append results. A turn replayed after a supersede
+         * would repeat them, so one that changes state runs to its end */
+        if (!calls_read_only(&resp)) turn_pin(w);
+        int tools_cancelled = 0;
+        cJSON *tool_results = build_tool_results(&resp, msg, &w->cancel.fired, &tools_cancelled);
+        result->tools_cancelled += tools_cancelled;
+        cJSON *result_msg = cJSON_CreateObject();
+        cJSON_AddStringToObject(result_msg, "role", "user");
+        cJSON_AddItemToObject(result_msg, "content", tool_results);
+        cJSON_AddItemToArray(messages, result_msg);
+
+        llm_response_free(&resp);
+        iteration++;
+    }
 
-            /* Append assistant message with content array */
-            cJSON *asst_msg = cJSON_CreateObject();
-            cJSON_AddStringToObject(asst_msg, "role", "assistant");
-            cJSON_AddItemToObject(asst_msg, "content", build_assistant_content(&resp));
-            cJSON_AddItemToArray(messages, asst_msg);
+    cJSON_Delete(messages);
+
+    /* Pool counters are global: concurrent Telegram polling is included */
+    http_pool_stats_t net_after;
+    http_pool_get_stats(&net_after);
+    ESP_LOGI(TAG, "Turn done in %lld ms: %u HTTP requests, %u reused, %u handshakes",
+             (long long)((esp_timer_get_time() - turn_start_us) / 1000),
+             (unsigned)(net_after.requests - net_before.requests),
+             (unsigned)(net_after.reused - net_before.reused),
+             (unsigned)(net_after.handshakes - net_before.handshakes));
+    ESP_LOGI(TAG, "Turn tokens: in=%u out=%u cache_read=%u cache_write=%u",
+             (unsigned)usage.input_tokens, (unsigned)usage.output_tokens,
+             (unsigned)usage.cache_read_tokens, (unsigned)usage.cache_creation_tokens);
+
+    /* 5. Send response. A reply that is ready goes out even if the turn was cancelled meanwhile */
+    turn_cancel_t cancelled = turn_commit(w);
+    esp_err_t save = ESP_FAIL;
+    if (cancelled != TURN_RUN && !(final_text && final_text[0])) {
+        ESP_LOGI(TAG, "Turn for %s:%s %s after %lld ms, nothing sent",
+                 msg->channel, msg->chat_id, cancelled == TURN_STOPPED ? "stopped" : "superseded",
+                 (long long)((esp_timer_get_time() - turn_start_us) / 1000));
+        payload_release(final_text);
+        result->cancelled = cancelled;
+        result->tokens = usage.input_tokens + usage.output_tokens +
+                         usage.cache_read_tokens + usage.cache_creation_tokens;
+        if (cancelled == TURN_SUPERSEDED) return;   /* msg->content stays with the caller */
+    } else if (final_text && final_text[0]) {
+        /* Save to session (only user text + final assistant text) */
+        save = session_append_turn(msg->chat_id, msg->content, final_text);
+        if (save != ESP_OK) {
+            ESP_LOGW(TAG, "Session save failed for chat %s: %s", msg->chat_id, esp_err_to_name(save));
+        } else {
+            ESP_LOGI(TAG, "Session queued for chat %s", msg->chat_id);
+        }
 
-            /* Execute tools and append results */
-            cJSON *tool_results = build_tool_results(&resp, &msg, tool_output, TOOL_OUTPUT_SIZE);
-            cJSON *result_msg = cJSON_CreateObject();
-            cJSON_AddStringToObject(result_msg, "role", "user");
-            cJSON_AddItemToObject(result_msg, "content", tool_results);
-            cJSON_AddItemToArray(messages, result_msg);
+        /* Push response to outbound */
+        mimi_msg_t out = {0};
+        strncpy(out.channel, msg->channel, sizeof(out.channel) - 1);
+        strncpy(out.chat_id, msg->chat_id, sizeof(out.chat_id) - 1);
+        out.content = final_text;  /* transfer ownership */
+        out.origin_us = msg->enqueue_us;
+        ESP_LOGI(TAG, "Queue final response to %s:%s (%d bytes)",
+                 out.channel, out.chat_id, (int)strlen(final_text));
+        if (message_bus_push_outbound(&out) != ESP_OK) {
+            ESP_LOGW(TAG, "Outbound queue full, drop final response");
+            payload_release(final_text);
+        } else {
+            final_text = NULL;
+        }
+    } else {
+        /* Error or empty response */
+        payload_release(final_text);
+        mimi_msg_t out = {0};
+        strncpy(out.channel, msg->channel, sizeof(out.channel) - 1);
+        strncpy(out.chat_id, msg->chat_id, sizeof(out.chat_id) - 1);
+        out.origin_us = msg->enqueue_us;
+        out.content = shared_text(s_error_text, ERROR_TEXT);
+        if (out.content) {
+            if (message_bus_push_outbound(&out) != ESP_OK) {
+                ESP_LOGW(TAG, "Outbound queue full, drop error response");
+                payload_release(out.content);
+            }
+        }
+    }
 
-            llm_response_free(&resp);
-            iteration++;
+    result->saved = (save == ESP_OK);
+
+    /* Free inbound message content */
+    payload_release(msg->content);
+
+    /* Log memory status */
+    ESP_LOGI(TAG, "Free PSRAM: %d bytes",
+             (int)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+}
+
+/* ── Scheduling: per-chat order, different chats in parallel ──── */
+
+#define AGENT_PENDING_MAX  MIMI_BUS_QUEUE_LEN
+
+/* Messages taken off the bus, waiting for a worker (guarded by s_lock) */
+static mimi_msg_t s_pending[AGENT_PENDING_MAX];
+static int s_pending_count = 0;
+static agent_worker_t s_workers[MIMI_AGENT_WORKERS];
+static int s_worker_count = 0;
+static const mimi_msg_t *s_running[MIMI_AGENT_WORKERS];   /* chat each worker is serving */
+static mimi_msg_t s_running_msg[MIMI_AGENT_WORKERS];
+
+static SemaphoreHandle_t s_lock;
+static SemaphoreHandle_t s_work_sem;     /* given whenever a message may have become runnable */
+static SemaphoreHandle_t s_space_sem;    /* free s_pending slots */
+static agent_loop_stats_t s_stats;
+static prio_sched_t s_sched;             /* share of turns per priority class */
+
+static bool same_chat(const mimi_msg_t *a, const mimi_msg_t *b)
+{
+    return strcmp(a->chat_id, b->chat_id) == 0 && strcmp(a->channel, b->channel) == 0;
+}
+
+static bool chat_running(const mimi_msg_t *msg)
+{
+    for (int i = 0; i < s_worker_count; i++) {
+        if (s_running[i] && same_chat(s_running[i], msg)) return true;
+    }
+    return false;
+}
+
+/* System messages (cron, heartbeat) are separate tasks: never merged or delayed */
+static bool coalescable(const mimi_msg_t *msg)
+{
+    return MIMI_AGENT_COALESCE_MS > 0 && strcmp(msg->channel, MIMI_CHAN_SYSTEM) != 0;
+}
+
+/*
+ * A lone message runs at once. Only once a chat has a burst pending (a second
+ * message already queued) is it held until it has been quiet for the debounce
+ * window, or until its oldest message has waited MIMI_AGENT_COALESCE_MAX_MS.
+ * A follow-up to a turn already running supersedes it instead.
+ */
+static int64_t chat_ready_us(int first)
+{
+    const mimi_msg_t *head = &s_pending[first];
+    if (!coalescable(head)) return 0;
+
+    bool burst = false;
+    int64_t newest = head->enqueue_us;
+    for (int i = first + 1; i < s_pending_count; i++) {
+        if (!same_chat(&s_pending[i], head)) continue;
+        burst = true;
+        if (s_pending[i].enqueue_us > newest) newest = s_pending[i].enqueue_us;
+    }
+    if (!burst) return 0;
+
+    int64_t quiet = newest + (int64_t)MIMI_AGENT_COALESCE_MS * 1000;
+    int64_t cap = head->enqueue_us + (int64_t)MIMI_AGENT_COALESCE_MAX_MS * 1000;
+    return quiet < cap ? quiet : cap;
+}
+
+static void pending_remove(int i)
+{
+    memmove(&s_pending[i], &s_pending[i + 1], (s_pending_count - i - 1) * sizeof(mimi_msg_t));
+    s_pending_count--;
+}
+
+/*
+ * Merge every pending message of head's chat into head (one user turn, texts
+ * joined by newlines, in arrival order). The merged messages' content is
+ * released here; head keeps the oldest enqueue time. Returns messages merged.
+ */
+static int merge_chat(int first, mimi_msg_t *head)
+{
+    if (!coalescable(head)) return 0;
+
+    size_t total = payload_len(head->content);
+    int extra = 0;
+    for (int i = first; i < s_pending_count; i++) {
+        if (!same_chat(&s_pending[i], head)) continue;
+        total += 1 + payload_len(s_pending[i].content);
+        extra++;
+    }
+    if (extra == 0) return 0;
+
+    char *merged = payload_alloc(total);
+    if (!merged) return 0;              /* run them one by one instead */
+
+    size_t off = 0;
+    const char *text = head->content ? head->content : "";
+    memcpy(merged + off, text, strlen(text));
+    off += strlen(text);
+    for (int i = first; i < s_pending_count;) {
+        if (!same_chat(&s_pending[i], head)) {
+            i++;
+            continue;
         }
+        text = s_pending[i].content ? s_pending[i].content : "";
+        merged[off++] = '\n';
+        memcpy(merged + off, text, strlen(text));
+        off += strlen(text);
+        payload_release(s_pending[i].content);
+        pending_remove(i);
+    }
+    merged[off] = '\0';
 
-        cJSON_Delete(messages);
-
-        /* 5. Send response */
-        if (final_text && final_text[0]) {
-            /* Save to session (only user text + final assistant text) */
-            esp_err_t save_user = session_append(msg.chat_id, "user", msg.content);
-            esp_err_t save_asst = session_append(msg.chat_id, "assistant", final_text);
-            if (save_user != ESP_OK || save_asst != ESP_OK) {
-                ESP_LOGW(TAG, "Session save failed for chat %s (user=%s, assistant=%s)",
-                         msg.chat_id,
-                         esp_err_to_name(save_user),
-                         esp_err_to_name(save_asst));
-            } else {
-                ESP_LOGI(TAG, "Session saved for chat %s", msg.chat_id);
-            }
+    payload_release(head->content);
+    head->content = merged;
+    return extra;
+}
 
-            /* Push response to outbound */
-            mimi_msg_t out = {0};
-            strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
-            strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
-            out.content = final_text;  /* transfer ownership */
-            ESP_LOGI(TAG, "Queue final response to %s:%s (%d bytes)",
-                     out.channel, out.chat_id, (int)strlen(final_text));
-            if (message_bus_push_outbound(&out) != ESP_OK) {
-                ESP_LOGW(TAG, "Outbound queue full, drop final response");
-                free(final_text);
-            } else {
-                final_text = NULL;
-            }
+/* ── Cancellation ─────────────────────────────────────────────── */
+
+/*
+ * Caller holds s_lock. The turn stops at its next check; an LLM request in
+ * flight is cut off. A stop also overrides a pending supersede, so the
+ * message is not queued again. A pinned turn is only stopped, never
+ * superseded: the new message queues behind it and is coalesced.
+ */
+static bool cancel_turn_locked(agent_worker_t *w, turn_cancel_t reason)
+{
+    if (!s_running[w->id] || w->committed) return false;
+    if (reason == TURN_SUPERSEDED && w->pinned) return false;
+    if (w->cancel_reason != TURN_RUN &&
+        !(reason == TURN_STOPPED && w->cancel_reason == TURN_SUPERSEDED)) return false;
+    w->cancel_reason = reason;
+    w->cancel_us = esp_timer_get_time();
+    http_pool_cancel_fire(&w->cancel);
+    return true;
+}
+
+/* From here on the turn's outcome is fixed; returns why it was cancelled, if it was */
+static turn_cancel_t turn_commit(agent_worker_t *w)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    w->committed = true;
+    turn_cancel_t reason = (turn_cancel_t)w->cancel_reason;
+    xSemaphoreGive(s_lock);
+    return reason;
+}
+
+/* The turn is about to run a tool with side effects; a supersede already fired skips it */
+static void turn_pin(agent_worker_t *w)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    w->pinned = true;
+    xSemaphoreGive(s_lock);
+}
+
+/*
+ * Caller holds s_lock. A new message of a chat whose turn is still running
+ * replaces that turn. The superseded message must go back into s_pending, so
+ * a slot is reserved for it first; with the queue full the new message
+ * just waits behind the turn instead.
+ */
+static void supersede_locked(const mimi_msg_t *msg)
+{
+    if (!MIMI_AGENT_SUPERSEDE || !coalescable(msg)) return;
+    for (int i = 0; i < s_worker_count; i++) {
+        agent_worker_t *w = &s_workers[i];
+        if (!s_running[i] || !same_chat(s_running[i], msg) || w->requeue_slot) continue;
+        if (xSemaphoreTake(s_space_sem, 0) != pdTRUE) {
+            ESP_LOGW(TAG, "Queue full: new message from %s:%s waits for its running turn",
+                     msg->channel, msg->chat_id);
+            continue;
+        }
+        if (cancel_turn_locked(w, TURN_SUPERSEDED)) {
+            w->requeue_slot = true;
+            ESP_LOGI(TAG, "New message from %s:%s supersedes its running turn", msg->channel, msg->chat_id);
         } else {
-            /* Error or empty response */
-            free(final_text);
-            mimi_msg_t out = {0};
-            strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
-            strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
-            out.content = strdup("Sorry, I encountered an error.");
-            if (out.content) {
-                if (message_bus_push_outbound(&out) != ESP_OK) {
-                    ESP_LOGW(TAG, "Outbound queue full, drop error response");
-                    free(out.content);
-                }
+            xSemaphoreGive(s_space_sem);
+        }
+    }
+}
+
+/* Caller holds s_lock. Put a superseded message back at the head of the queue (slot reserved), to be merged */
+static void requeue_locked(const mimi_msg_t *msg)
+{
+    memmove(&s_pending[1], &s_pending[0], s_pending_count * sizeof(mimi_msg_t));
+    s_pending[0] = *msg;
+    s_pending_count++;
+    if (s_pending_count > (int)s_stats.pending_max) s_stats.pending_max = s_pending_count;
+}
+
+static bool match_chat(const mimi_msg_t *msg, const char *channel, const char *chat_id)
+{
+    return (!channel || strcmp(msg->channel, channel) == 0) &&
+           (!chat_id || strcmp(msg->chat_id, chat_id) == 0);
+}
+
+int agent_loop_stop(const char *channel, const char *chat_id, int *dropped)
+{
+    int turns = 0;
+    int removed = 0;
+    if (!s_lock) return 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < s_worker_count; i++) {
+        if (s_running[i] && match_chat(s_running[i], channel, chat_id) &&
+            cancel_turn_locked(&s_workers[i], TURN_STOPPED)) {
+            turns++;
+        }
+    }
+    for (int i = 0; i < s_pending_count;) {
+        if (!match_chat(&s_pending[i], channel, chat_id)) {
+            i++;
+            continue;
+        }
+        payload_release(s_pending[i].content);
+        pending_remove(i);
+        removed++;
+    }
+    s_stats.stop_dropped += removed;
+    xSemaphoreGive(s_lock);
+
+    for (int i = 0; i < removed; i++) xSemaphoreGive(s_space_sem);
+    if (dropped) *dropped = removed;
+    if (turns || removed) {
+        ESP_LOGI(TAG, "Stop %s:%s: %d turn(s) cancelled, %d queued message(s) dropped",
+                 channel ? channel : "*", chat_id ? chat_id : "*", turns, removed);
+    }
+    return turns;
+}
+
+/* "/stop", or "/stop@botname" in Telegram groups */
+static bool is_stop_command(const char *text)
+{
+    if (!text) return false;
+    while (*text == ' ' || *text == '\n' || *text == '\t') text++;
+    if (strncmp(text, "/stop", 5) != 0) return false;
+    text += 5;
+    if (*text == '@') text += strcspn(text, " \n\t");
+    while (*text == ' ' || *text == '\n' || *text == '\t') text++;
+    return *text == '\0';
+}
+
+static void handle_stop(const mimi_msg_t *msg)
+{
+    int dropped = 0;
+    int turns = agent_loop_stop(msg->channel, msg->chat_id, &dropped);
+
+    mimi_msg_t out = {0};
+    strncpy(out.channel, msg->channel, sizeof(out.channel) - 1);
+    strncpy(out.chat_id, msg->chat_id, sizeof(out.chat_id) - 1);
+    out.origin_us = msg->enqueue_us;
+    out.content = payload_dup(turns || dropped ? "Stopped." : "Nothing to stop.");
+    if (out.content && message_bus_push_outbound(&out) != ESP_OK) {
+        payload_release(out.content);
+    }
+}
+
+/* A person is waiting on a queued or running turn: background work holds off */
+static bool interactive_busy(void)
+{
+    for (int i = 0; i < s_pending_count; i++) {
+        if (s_pending[i].prio == MIMI_PRIO_INTERACTIVE) return true;
+    }
+    for (int i = 0; i < s_worker_count; i++) {
+        if (s_running[i] && s_running[i]->prio == MIMI_PRIO_INTERACTIVE) return true;
+    }
+    return false;
+}
+
+/*
+ * Next message to run; caller holds s_lock. Within each priority class the
+ * oldest message whose chat is idle and settled; between classes,
+ * prio_sched_pick() decides. Returns the number of s_pending slots freed
+ * (0 = nothing runnable) and sets *wake_us to the earliest time a held-back
+ * burst becomes ready.
+ */
+static int take_runnable(int worker, mimi_msg_t *out, int64_t *wake_us)
+{
+    int64_t now = esp_timer_get_time();
+    *wake_us = 0;
+
+    bool ready[MIMI_PRIO_COUNT] = {0};
+    int first[MIMI_PRIO_COUNT] = {0};
+    for (int i = 0; i < s_pending_count; i++) {
+        /* FIFO scan: an idle chat's oldest message is always found first */
+        if (chat_running(&s_pending[i])) continue;
+
+        int64_t ready_us = chat_ready_us(i);
+        if (ready_us > now) {
+            if (*wake_us == 0 || ready_us < *wake_us) *wake_us = ready_us;
+            continue;
+        }
+
+        int c = s_pending[i].prio < MIMI_PRIO_COUNT ? s_pending[i].prio : MIMI_PRIO_BACKGROUND;
+        if (!ready[c]) {
+            ready[c] = true;
+            first[c] = i;
+        }
+    }
+    if (ready[MIMI_PRIO_BACKGROUND] && interactive_busy()) {
+        ready[MIMI_PRIO_BACKGROUND] = false;    /* re-checked when the interactive turn ends */
+    }
+
+    int c = prio_sched_pick(&s_sched, ready);
+    if (c >= 0) {
+        int i = first[c];
+        *out = s_pending[i];
+        pending_remove(i);
+        int merged = merge_chat(i, out);
+        if (merged > 0) {
+            s_stats.coalesced += merged;
+            ESP_LOGI(TAG, "Coalesced %d queued messages for %s:%s into one turn",
+                     merged + 1, out->channel, out->chat_id);
+        }
+        s_running_msg[worker] = *out;
+        s_running[worker] = &s_running_msg[worker];
+        agent_worker_t *w = &s_workers[worker];
+        w->cancel_reason = TURN_RUN;
+        w->committed = false;
+        w->pinned = false;
+        http_pool_cancel_reset(&w->cancel);
+        return 1 + merged;
+    }
+    return 0;
+}
+
+/* Moves inbound messages from the bus into s_pending */
+static void agent_dispatch_task(void *arg)
+{
+    while (1) {
+        mimi_msg_t msg;
+        while (message_bus_pop_inbound(&msg, UINT32_MAX) != ESP_OK) {}
+
+        /* Commands act on the chat's turns right away instead of queueing behind them */
+        if (strcmp(msg.channel, MIMI_CHAN_SYSTEM) != 0 && is_stop_command(msg.content)) {
+            handle_stop(&msg);
+            payload_release(msg.content);
+            continue;
+        }
+
+        xSemaphoreTake(s_space_sem, portMAX_DELAY);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        supersede_locked(&msg);
+        s_pending[s_pending_count++] = msg;
+        if (s_pending_count > (int)s_stats.pending_max) s_stats.pending_max = s_pending_count;
+        xSemaphoreGive(s_lock);
+        xSemaphoreGive(s_work_sem);
+    }
+}
+
+static void agent_worker_task(void *arg)
+{
+    agent_worker_t *w = (agent_worker_t *)arg;
+    ESP_LOGI(TAG, "Agent worker %d started on core %d", w->id, xPortGetCoreID());
+    if (http_pool_cancel_attach(&w->cancel) != ESP_OK) {
+        ESP_LOGW(TAG, "Worker %d: no cancel token, /stop waits for its LLM requests", w->id);
+    }
+
+    while (1) {
+        mimi_msg_t msg;
+        int64_t wake_us;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        int taken = take_runnable(w->id, &msg, &wake_us);
+        xSemaphoreGive(s_lock);
+        if (taken == 0) {
+            TickType_t ticks = portMAX_DELAY;
+            if (wake_us) {
+                int64_t ms = (wake_us - esp_timer_get_time()) / 1000;
+                ticks = pdMS_TO_TICKS(ms > 0 ? ms : 0) + 1;
             }
+            xSemaphoreTake(s_work_sem, ticks);
+            continue;
+        }
+        for (int i = 0; i < taken; i++) xSemaphoreGive(s_space_sem);
+
+        int64_t start_us = esp_timer_get_time();
+        int64_t wait_ms = msg.enqueue_us ? (start_us - msg.enqueue_us) / 1000 : 0;
+        ESP_LOGI(TAG, "Worker %d: %s:%s (%s) waited %lld ms in queue",
+                 w->id, msg.channel, msg.chat_id, message_bus_prio_name(msg.prio), (long long)wait_ms);
+
+        turn_arena_report_t arena;
+        turn_result_t result;
+        turn_arena_begin(w->arena);
+        agent_run_turn(w, &msg, &result);     /* frees msg.content unless superseded */
+        turn_arena_end(w->arena, &arena);
+        if (w->arena) {
+            ESP_LOGI(TAG, "Worker %d arena: peak %u bytes, %u allocs, %u chunks, %u heap fallbacks",
+                     w->id, (unsigned)arena.peak, (unsigned)arena.allocs,
+                     (unsigned)arena.chunks, (unsigned)arena.heap_fallbacks);
         }
 
-        /* Free inbound message content */
-        free(msg.content);
+        int64_t end_us = esp_timer_get_time();
+        int64_t busy_ms = (end_us - start_us) / 1000;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_running[w->id] = NULL;
+        bool slot_unused = w->requeue_slot && result.cancelled != TURN_SUPERSEDED;
+        w->requeue_slot = false;
+        if (result.cancelled != TURN_RUN) {
+            /* Savings: what an average completed turn would still have run, had it not been cut */
+            uint32_t done = s_stats.turns - s_stats.stopped - s_stats.superseded;
+            int64_t avg_ms = done ? (s_stats.busy_ms_total - s_stats.cancel_busy_ms_total) / done : 0;
+            int64_t cancel_ms = (end_us - w->cancel_us) / 1000;
+            if (result.cancelled == TURN_STOPPED) s_stats.stopped++;
+            else s_stats.superseded++;
+            s_stats.cancel_busy_ms_total += busy_ms;
+            s_stats.cancel_saved_ms += avg_ms > busy_ms ? avg_ms - busy_ms : 0;
+            s_stats.cancel_llm_aborted += result.llm_aborted;
+            s_stats.cancel_tools += result.tools_cancelled;
+            s_stats.cancel_tokens += result.tokens;
+            s_stats.cancel_ms_total += cancel_ms;
+            if (cancel_ms > s_stats.cancel_ms_max) s_stats.cancel_ms_max = cancel_ms;
+            if (result.cancelled == TURN_SUPERSEDED) requeue_locked(&msg);
+        }
+        s_stats.turns++;
+        s_stats.wait_ms_total += wait_ms;
+        s_stats.busy_ms_total += busy_ms;
+        if (wait_ms > s_stats.wait_ms_max) s_stats.wait_ms_max = wait_ms;
+        if (busy_ms > s_stats.busy_ms_max) s_stats.busy_ms_max = busy_ms;
+        int c = msg.prio < MIMI_PRIO_COUNT ? msg.prio : MIMI_PRIO_BACKGROUND;
+        s_stats.cls[c].turns++;
+        s_stats.cls[c].wait_ms_total += wait_ms;
+        if (wait_ms > s_stats.cls[c].wait_ms_max) s_stats.cls[c].wait_ms_max = wait_ms;
+        s_stats.arena_last = arena.peak;
+        if (arena.peak > s_stats.arena_peak) s_stats.arena_peak = arena.peak;
+        s_stats.arena_fallbacks += arena.heap_fallbacks;
+        xSemaphoreGive(s_lock);
+        if (slot_unused) xSemaphoreGive(s_space_sem);     /* stopped, or replied after all */
+
+        /* The next message of this chat may be runnable now */
+        xSemaphoreGive(s_work_sem);
+
+        /* 6. Fold old turns if the history grew too long, off the chat's
+         * critical path. The token may have fired before the commit */
+        if (result.saved) {
+            http_pool_cancel_reset(&w->cancel);
+            history_summary_maybe_update(msg.chat_id);
+        }
+    }
+}
 
-        /* Log memory status */
-        ESP_LOGI(TAG, "Free PSRAM: %d bytes",
-                 (int)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+void agent_loop_get_stats(agent_loop_stats_t *out)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    out->workers = s_worker_count;
+    out->pending = s_pending_count;
+    int busy = 0;
+    for (int i = 0; i < s_worker_count; i++) {
+        if (s_running[i]) busy++;
     }
+    out->busy_workers = busy;
+    xSemaphoreGive(s_lock);
 }
 
 esp_err_t agent_loop_init(void)
 {
+    s_lock = xSemaphoreCreateMutex();
+    s_work_sem = xSemaphoreCreateCounting(AGENT_PENDING_MAX + MIMI_AGENT_WORKERS * 2, 0);
+    s_space_sem = xSemaphoreCreateCounting(AGENT_PENDING_MAX, AGENT_PENDING_MAX);
+    if (!s_lock || !s_work_sem || !s_space_sem) {
+        ESP_LOGE(TAG, "Failed to create agent scheduler");
+        return ESP_ERR_NO_MEM;
+    }
+    s_working_text = payload_dup(WORKING_TEXT);
+    s_error_text = payload_dup(ERROR_TEXT);
+    if (history_summary_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create summary lock");
+        return ESP_ERR_NO_MEM;
+    }
     ESP_LOGI(TAG, "Agent loop initialized");
     return ESP_OK;
 }
 
-esp_err_t agent_loop_start(void)
+static bool start_worker(agent_worker_t *w)
 {
     const uint32_t stack_candidates[] = {
         MIMI_AGENT_STACK,
@@ -339,24 +924,63 @@ esp_err_t agent_loop_start(void)
         12 * 1024,
     };
 
+    /* Allocate the prompt buffer from PSRAM */
+    w->system_prompt = heap_caps_calloc(1, MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    if (!w->system_prompt) {
+        ESP_LOGE(TAG, "Failed to allocate PSRAM buffer for worker %d", w->id);
+        return false;
+    }
+    w->arena = turn_arena_create();
+    if (!w->arena && MIMI_ARENA_ENABLE) {
+        ESP_LOGW(TAG, "No arena for worker %d, its turns allocate from the heap", w->id);
+    }
+
+    char name[16];
+    snprintf(name, sizeof(name), "agent_%d", w->id);
     for (size_t i = 0; i < (sizeof(stack_candidates) / sizeof(stack_candidates[0])); i++) {
         uint32_t stack_size = stack_candidates[i];
         BaseType_t ret = xTaskCreatePinnedToCore(
-            agent_loop_task, "agent_loop",
-            stack_size, NULL,
+            agent_worker_task, name,
+            stack_size, w,
             MIMI_AGENT_PRIO, NULL, MIMI_AGENT_CORE);
 
         if (ret == pdPASS) {
-            ESP_LOGI(TAG, "agent_loop task created with stack=%u bytes", (unsigned)stack_size);
-            return ESP_OK;
+            ESP_LOGI(TAG, "%s task created with stack=%u bytes", name, (unsigned)stack_size);
+            return true;
         }
 
         ESP_LOGW(TAG,
-                 "agent_loop create failed (stack=%u, free_internal=%u, largest_internal=%u), retrying...",
-                 (unsigned)stack_size,
+                 "%s create failed (stack=%u, free_internal=%u, largest_internal=%u), retrying...",
+                 name, (unsigned)stack_size,
                  (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
                  (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
     }
 
-    return ESP_FAIL;
+    free(w->system_prompt);
+    return false;
+}
+
+esp_err_t agent_loop_start(void)
+{
+    for (int i = 0; i < MIMI_AGENT_WORKERS; i++) {
+        agent_worker_t *w = &s_workers[s_worker_count];
+        w->id = s_worker_count;
+        if (!start_worker(w)) break;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_worker_count++;
+        xSemaphoreGive(s_lock);
+    }
+
+    if (s_worker_count == 0) return ESP_FAIL;
+    if (s_worker_count < MIMI_AGENT_WORKERS) {
+        ESP_LOGW(TAG, "Running with %d of %d agent workers", s_worker_count, MIMI_AGENT_WORKERS);
+    }
+
+    if (xTaskCreatePinnedToCore(agent_dispatch_task, "agent_dispatch",
+                                MIMI_AGENT_DISPATCH_STACK, NULL,
+                                MIMI_AGENT_PRIO, NULL, MIMI_AGENT_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create agent dispatcher");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
 }
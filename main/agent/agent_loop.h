@@ -1,6 +1,9 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include "bus/message_bus.h"
 
 /**
  * Initialize the agent loop.
@@ -8,7 +11,56 @@
 esp_err_t agent_loop_init(void);
 
 /**
- * Start the agent loop task (runs on Core 1).
+ * Start the agent workers and their dispatcher (Core 1).
  * Consumes from inbound queue, calls Claude API, pushes to outbound queue.
+ * Turns of one chat run in order; different chats run on different workers.
  */
 esp_err_t agent_loop_start(void);
+
+typedef struct {
+    uint32_t turns;
+    int64_t wait_ms_total;              /* bus push -> worker start */
+    int64_t wait_ms_max;
+    int64_t busy_ms_total;              /* worker start -> reply queued */
+    int64_t busy_ms_max;
+    uint32_t pending_max;               /* high-water mark of messages waiting for a worker */
+    uint32_t coalesced;                 /* messages merged into another message's turn */
+    struct {
+        uint32_t turns;
+        int64_t wait_ms_total;          /* bus push -> worker start, per priority class */
+        int64_t wait_ms_max;
+    } cls[MIMI_PRIO_COUNT];
+    size_t arena_last;                  /* cJSON arena high-water mark of the last turn */
+    size_t arena_peak;                  /* ...and of any turn since boot */
+    uint32_t arena_fallbacks;           /* arena allocations that fell back to the heap */
+    uint32_t stopped;                   /* turns cancelled by /stop or agent_loop_stop() */
+    uint32_t superseded;                /* turns cancelled by a newer message of the same chat */
+    uint32_t stop_dropped;              /* queued messages dropped by /stop */
+    uint32_t cancel_llm_aborted;        /* LLM requests cut off mid-flight */
+    uint32_t cancel_tools;              /* tool calls skipped or abandoned */
+    uint32_t cancel_tokens;             /* tokens cancelled turns had already spent */
+    int64_t cancel_ms_total;            /* cancel request -> worker free again */
+    int64_t cancel_ms_max;
+    int64_t cancel_busy_ms_total;       /* worker time spent on turns that were cancelled */
+    int64_t cancel_saved_ms;            /* estimate: mean completed turn minus time already spent */
+    int workers;
+    int busy_workers;
+    int pending;
+} agent_loop_stats_t;
+
+/**
+ * Queue-wait versus processing-time counters since boot, for sizing
+ * MIMI_AGENT_WORKERS.
+ */
+void agent_loop_get_stats(agent_loop_stats_t *out);
+
+/**
+ * Cancel running turns and drop queued messages of a chat, as the "/stop"
+ * chat command does. A running turn stops at its next step: its LLM
+ * request is cut off, pending tool calls are skipped and nothing is sent.
+ * NULL channel or chat_id matches any (the CLI "stop" without arguments).
+ *
+ * @param dropped  Optional: number of queued messages dropped
+ * @return number of running turns cancelled
+ */
+int agent_loop_stop(const char *channel, const char *chat_id, int *dropped);
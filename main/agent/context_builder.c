@@ -1,96 +1,516 @@
 #include "context_builder.h"
 #include "mimi_config.h"
 #include "memory/memory_store.h"
+#include "memory/session_mgr.h"
 #include "skills/skill_loader.h"
+#include "cJSON.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <ctype.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 
 static const char *TAG = "context";
 
-static size_t append_file(char *buf, size_t size, size_t offset, const char *path, const char *header)
+static const char *PROMPT_INTRO =
+    "# MimiClaw\n\n"
+    "You are MimiClaw, a personal AI assistant running on an ESP32-S3 device.\n"
+    "You communicate through Telegram and WebSocket.\n\n"
+    "Be helpful, accurate, and concise.\n\n"
+    "## Available Tools\n"
+    "You have access to the following tools:\n"
+    "- web_search: Search the web for current information. "
+    "Use this when you need up-to-date facts, news, weather, or anything beyond your training data.\n"
+    "- get_current_time: Get the current date and time. "
+    "You do NOT have an internal clock — always use this tool when you need to know the time or date.\n"
+    "- read_file: Read a file from SPIFFS (path must start with /spiffs/).\n"
+    "- write_file: Write/overwrite a file on SPIFFS.\n"
+    "- edit_file: Find-and-replace edit a file on SPIFFS.\n"
+    "- list_dir: List files on SPIFFS, optionally filter by prefix.\n"
+    "- cron_add: Schedule a recurring or one-shot task. The message will trigger an agent turn when the job fires.\n"
+    "- cron_list: List all scheduled cron jobs.\n"
+    "- cron_remove: Remove a scheduled cron job by ID.\n\n"
+    "When using cron_add for Telegram delivery, always set channel='telegram' and a valid numeric chat_id.\n\n"
+    "Use tools when needed. Provide your final answer as text after using tools.\n\n"
+    "## Memory\n"
+    "You have persistent memory stored on local flash:\n"
+    "- Long-term memory: /spiffs/memory/MEMORY.md\n"
+    "- Daily notes: /spiffs/memory/daily/<YYYY-MM-DD>.md\n\n"
+    "IMPORTANT: Actively use memory to remember things across conversations.\n"
+    "- When you learn something new about the user (name, preferences, habits, context), write it to MEMORY.md.\n"
+    "- When something noteworthy happens in a conversation, append it to today's daily note.\n"
+    "- Always read_file MEMORY.md before writing, so you can edit_file to update without losing existing content.\n"
+    "- Use get_current_time to know today's date before writing daily notes.\n"
+    "- Keep MEMORY.md concise and organized — summarize, don't dump raw conversation.\n"
+    "- You should proactively save memory without being asked. If the user tells you their name, preferences, or important facts, persist them immediately.\n\n"
+    "## Skills\n"
+    "Skills are specialized instruction files stored in /spiffs/skills/.\n"
+    "When a task matches a skill, read the full skill file for detailed instructions.\n"
+    "You can create new skills using write_file to /spiffs/skills/<name>.md.\n";
+
+/* ── Section cache ────────────────────────────────────────────── */
+
+/* Order = prompt order; everything before SEC_MEMORY is the stable prefix */
+enum {
+    SEC_SOUL,
+    SEC_USER,
+    SEC_SKILLS,
+    SEC_MEMORY,
+    SEC_RECENT,
+    SEC_COUNT,
+};
+
+typedef struct {
+    const char *name;
+    size_t cap;                     /* rendered text limit */
+    int budget;                     /* token budget of the section */
+    char *text;                     /* PSRAM, rendered with its "## " header */
+    size_t len;
+    size_t tokens;                  /* estimate for text */
+    bool valid;                     /* cleared by context_invalidate_path() */
+    uint32_t sig;                   /* size/mtime signature of the sources */
+    int64_t checked_us;             /* last signature check */
+    int64_t build_us;               /* cost of the last rebuild */
+    uint32_t rebuilds;
+    uint32_t hits;
+    int64_t saved_us;               /* sum of build_us over hits */
+} prompt_section_t;
+
+static prompt_section_t s_sections[SEC_COUNT] = {
+    [SEC_SOUL]   = { .name = "soul",   .cap = 4096,       .budget = MIMI_BUDGET_SOUL },
+    [SEC_USER]   = { .name = "user",   .cap = 4096,       .budget = MIMI_BUDGET_USER },
+    [SEC_SKILLS] = { .name = "skills", .cap = 2048 + 128, .budget = MIMI_BUDGET_SKILLS },
+    [SEC_MEMORY] = { .name = "memory", .cap = 4096 + 64,  .budget = MIMI_BUDGET_MEMORY },
+    [SEC_RECENT] = { .name = "recent", .cap = 4096 + 64,  .budget = MIMI_BUDGET_NOTES },
+};
+
+/* ── Budget ───────────────────────────────────────────────────── */
+
+/* History is budgeted alongside the sections */
+#define PART_HISTORY    SEC_COUNT
+#define PART_COUNT      (SEC_COUNT + 1)
+
+#define TURN_CONTEXT_TOKENS  80     /* "Current Turn Context" block appended by the agent loop */
+#define MSG_OVERHEAD_TOKENS  4      /* role and framing per message */
+#define TRIM_MIN_TOKENS      48     /* a section cut below this is dropped instead */
+#define TRIM_MARK            "\n[...trimmed]\n"
+
+/* Lowest value first: what goes when the whole prompt is over budget */
+static const int s_drop_order[PART_COUNT] = {
+    SEC_RECENT, PART_HISTORY, SEC_MEMORY, SEC_SKILLS, SEC_USER, SEC_SOUL,
+};
+
+typedef struct {
+    int base;                       /* PROMPT_INTRO, never trimmed */
+    int turn;                       /* current message + turn context, never trimmed */
+    int want[PART_COUNT];           /* estimate before trimming */
+    int kept[PART_COUNT];
+    int history_msgs;
+    int history_dropped;
+    int total;
+} budget_report_t;
+
+static SemaphoreHandle_t s_lock;
+static budget_report_t s_last_report;   /* guarded by s_lock */
+
+size_t context_estimate_tokens(const char *text, size_t len)
 {
-    FILE *f = fopen(path, "r");
-    if (!f) return offset;
+    /* BPE tokenizers average ~4 ASCII chars or ~0.75 words per token; most
+     * CJK characters and emoji are a token each, 2-byte scripts about half */
+    size_t ascii = 0, words = 0, punct = 0, wide = 0, narrow = 0;
+    bool in_word = false;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)text[i];
+        if (c < 0x80) {
+            ascii++;
+            bool alnum = isalnum(c);
+            if (alnum && !in_word) words++;
+            if (!alnum && !isspace(c)) punct++;
+            in_word = alnum;
+        } else {
+            in_word = false;
+            if (c >= 0xE0) wide++;
+            else if (c >= 0xC0) narrow++;
+        }
+    }
+    size_t by_chars = (ascii + 3) / 4;
+    size_t by_words = words + words / 3 + punct / 2;
+    return (by_chars > by_words ? by_chars : by_words) + wide + (narrow + 1) / 2;
+}
 
-    if (header && offset < size - 1) {
-        offset += snprintf(buf + offset, size - offset, "\n## %s\n\n", header);
+static uint32_t sig_mix(uint32_t h, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        h = (h ^ ((v >> (i * 8)) & 0xFF)) * 16777619u;
+    }
+    return h;
+}
+
+/* 0 when missing, so creating a file changes the signature too */
+static uint32_t file_sig(uint32_t h, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) return sig_mix(h, 0);
+    return sig_mix(sig_mix(h, (uint32_t)st.st_size + 1), (uint32_t)st.st_mtime);
+}
+
+static void daily_path(char *buf, size_t size, int days_ago)
+{
+    time_t now;
+    time(&now);
+    now -= days_ago * 86400;
+    struct tm tm;
+    localtime_r(&now, &tm);
+    char date_str[16];
+    strftime(date_str, sizeof(date_str), "%Y-%m-%d", &tm);
+    snprintf(buf, size, "%s/%s.md", MIMI_SPIFFS_MEMORY_DIR, date_str);
+}
+
+/* Skill files are found by name only; content edits come in via invalidation */
+static uint32_t skills_sig(uint32_t h)
+{
+    DIR *dir = opendir(MIMI_SPIFFS_BASE);
+    if (!dir) return h;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, "skills/", 7) != 0) continue;
+        for (const char *p = ent->d_name; *p; p++) h = (h ^ (uint8_t)*p) * 16777619u;
     }
+    closedir(dir);
+    return h;
+}
+
+static uint32_t section_sig(int id)
+{
+    uint32_t h = 2166136261u;
+    char path[64];
 
-    size_t n = fread(buf + offset, 1, size - offset - 1, f);
-    offset += n;
-    buf[offset] = '\0';
+    switch (id) {
+    case SEC_SOUL:   return file_sig(h, MIMI_SOUL_FILE);
+    case SEC_USER:   return file_sig(h, MIMI_USER_FILE);
+    case SEC_MEMORY: return file_sig(h, MIMI_MEMORY_FILE);
+    case SEC_SKILLS: return skills_sig(h);
+    case SEC_RECENT:
+        /* Paths carry the date, so a day rollover changes the signature */
+        for (int i = 0; i < 3; i++) {
+            daily_path(path, sizeof(path), i);
+            for (const char *p = path; *p; p++) h = (h ^ (uint8_t)*p) * 16777619u;
+            h = file_sig(h, path);
+        }
+        return h;
+    default:
+        return 0;
+    }
+}
+
+static size_t render_file(char *buf, size_t size, const char *path, const char *header)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+
+    size_t off = snprintf(buf, size, "\n## %s\n\n", header);
+    size_t n = fread(buf + off, 1, size - off - 1, f);
+    off += n;
+    buf[off] = '\0';
     fclose(f);
-    return offset;
-}
-
-esp_err_t context_build_system_prompt(char *buf, size_t size)
-{
-    size_t off = 0;
-
-    off += snprintf(buf + off, size - off,
-        "# MimiClaw\n\n"
-        "You are MimiClaw, a personal AI assistant running on an ESP32-S3 device.\n"
-        "You communicate through Telegram and WebSocket.\n\n"
-        "Be helpful, accurate, and concise.\n\n"
-        "## Available Tools\n"
-        "You have access to the following tools:\n"
-        "- web_search: Search the web for current information. "
-        "Use this when you need up-to-date facts, news, weather, or anything beyond your training data.\n"
-        "- get_current_time: Get the current date and time. "
-        "You do NOT have an internal clock — always use this tool when you need to know the time or date.\n"
-        "- read_file: Read a file from SPIFFS (path must start with /spiffs/).\n"
-        "- write_file: Write/overwrite a file on SPIFFS.\n"
-        "- edit_file: Find-and-replace edit a file on SPIFFS.\n"
-        "- list_dir: List files on SPIFFS, optionally filter by prefix.\n"
-        "- cron_add: Schedule a recurring or one-shot task. The message will trigger an agent turn when the job fires.\n"
-        "- cron_list: List all scheduled cron jobs.\n"
-        "- cron_remove: Remove a scheduled cron job by ID.\n\n"
-        "When using cron_add for Telegram delivery, always set channel='telegram' and a valid numeric chat_id.\n\n"
-        "Use tools when needed. Provide your final answer as text after using tools.\n\n"
-        "## Memory\n"
-        "You have persistent memory stored on local flash:\n"
-        "- Long-term memory: /spiffs/memory/MEMORY.md\n"
-        "- Daily notes: /spiffs/memory/daily/<YYYY-MM-DD>.md\n\n"
-        "IMPORTANT: Actively use memory to remember things across conversations.\n"
-        "- When you learn something new about the user (name, preferences, habits, context), write it to MEMORY.md.\n"
-        "- When something noteworthy happens in a conversation, append it to today's daily note.\n"
-        "- Always read_file MEMORY.md before writing, so you can edit_file to update without losing existing content.\n"
-        "- Use get_current_time to know today's date before writing daily notes.\n"
-        "- Keep MEMORY.md concise and organized — summarize, don't dump raw conversation.\n"
-        "- You should proactively save memory without being asked. If the user tells you their name, preferences, or important facts, persist them immediately.\n\n"
-        "## Skills\n"
-        "Skills are specialized instruction files stored in /spiffs/skills/.\n"
-        "When a task matches a skill, read the full skill file for detailed instructions.\n"
-        "You can create new skills using write_file to /spiffs/skills/<name>.md.\n");
-
-    /* Bootstrap files */
-    off = append_file(buf, size, off, MIMI_SOUL_FILE, "Personality");
-    off = append_file(buf, size, off, MIMI_USER_FILE, "User Info");
-
-    /* Long-term memory */
-    char mem_buf[4096];
-    if (memory_read_long_term(mem_buf, sizeof(mem_buf)) == ESP_OK && mem_buf[0]) {
-        off += snprintf(buf + off, size - off, "\n## Long-term Memory\n\n%s\n", mem_buf);
-    }
-
-    /* Recent daily notes (last 3 days) */
-    char recent_buf[4096];
-    if (memory_read_recent(recent_buf, sizeof(recent_buf), 3) == ESP_OK && recent_buf[0]) {
-        off += snprintf(buf + off, size - off, "\n## Recent Notes\n\n%s\n", recent_buf);
-    }
-
-    /* Skills */
-    char skills_buf[2048];
-    size_t skills_len = skill_loader_build_summary(skills_buf, sizeof(skills_buf));
-    if (skills_len > 0) {
-        off += snprintf(buf + off, size - off,
+    return off;
+}
+
+static size_t render_section(int id, char *buf, size_t size)
+{
+    buf[0] = '\0';
+
+    switch (id) {
+    case SEC_SOUL:
+        return render_file(buf, size, MIMI_SOUL_FILE, "Personality");
+    case SEC_USER:
+        return render_file(buf, size, MIMI_USER_FILE, "User Info");
+    case SEC_SKILLS: {
+        char skills_buf[2048];
+        if (skill_loader_build_summary(skills_buf, sizeof(skills_buf)) == 0) return 0;
+        return snprintf(buf, size,
             "\n## Available Skills\n\n"
             "Available skills (use read_file to load full instructions):\n%s\n",
             skills_buf);
     }
+    case SEC_MEMORY: {
+        char *mem_buf = heap_caps_calloc(1, 4096, MALLOC_CAP_SPIRAM);
+        size_t n = 0;
+        if (mem_buf && memory_read_long_term(mem_buf, 4096) == ESP_OK && mem_buf[0]) {
+            n = snprintf(buf, size, "\n## Long-term Memory\n\n%s\n", mem_buf);
+        }
+        free(mem_buf);
+        return n;
+    }
+    case SEC_RECENT: {
+        char *recent_buf = heap_caps_calloc(1, 4096, MALLOC_CAP_SPIRAM);
+        size_t n = 0;
+        if (recent_buf && memory_read_recent(recent_buf, 4096, 3) == ESP_OK && recent_buf[0]) {
+            n = snprintf(buf, size, "\n## Recent Notes\n\n%s\n", recent_buf);
+        }
+        free(recent_buf);
+        return n;
+    }
+    default:
+        return 0;
+    }
+}
+
+/* Make s_sections[id] current; caller holds s_lock. Returns true if rebuilt. */
+static bool section_refresh(int id, int64_t now)
+{
+    prompt_section_t *sec = &s_sections[id];
+
+    if (!sec->text) {
+        sec->text = heap_caps_calloc(1, sec->cap, MALLOC_CAP_SPIRAM);
+        if (!sec->text) return false;
+    }
+
+    /* Writes that bypass the invalidation hooks are caught by the signature */
+    if (sec->valid && now - sec->checked_us >= (int64_t)MIMI_CONTEXT_REVALIDATE_MS * 1000) {
+        uint32_t sig = section_sig(id);
+        sec->checked_us = now;
+        if (sig != sec->sig) sec->valid = false;
+    }
+
+    if (sec->valid) {
+        sec->hits++;
+        sec->saved_us += sec->build_us;
+        return false;
+    }
+
+    int64_t start = esp_timer_get_time();
+    sec->sig = section_sig(id);
+    size_t n = render_section(id, sec->text, sec->cap);
+    sec->len = n < sec->cap ? n : sec->cap - 1;
+    sec->text[sec->len] = '\0';
+    sec->tokens = context_estimate_tokens(sec->text, sec->len);
+    sec->valid = true;
+    sec->checked_us = now;
+    sec->build_us = esp_timer_get_time() - start;
+    sec->rebuilds++;
+    return true;
+}
+
+static void section_invalidate(int id)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_sections[id].valid = false;
+    xSemaphoreGive(s_lock);
+}
 
-    ESP_LOGI(TAG, "System prompt built: %d bytes", (int)off);
+/* ── Public API ───────────────────────────────────────────────── */
+
+esp_err_t context_builder_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+void context_invalidate_path(const char *path)
+{
+    if (!path || !s_lock) return;
+
+    if (strcmp(path, MIMI_SOUL_FILE) == 0) {
+        section_invalidate(SEC_SOUL);
+    } else if (strcmp(path, MIMI_USER_FILE) == 0) {
+        section_invalidate(SEC_USER);
+    } else if (strcmp(path, MIMI_MEMORY_FILE) == 0) {
+        section_invalidate(SEC_MEMORY);
+    } else if (strncmp(path, MIMI_SPIFFS_MEMORY_DIR "/", strlen(MIMI_SPIFFS_MEMORY_DIR) + 1) == 0) {
+        section_invalidate(SEC_RECENT);
+    } else if (strncmp(path, MIMI_SKILLS_PREFIX, strlen(MIMI_SKILLS_PREFIX)) == 0) {
+        section_invalidate(SEC_SKILLS);
+    }
+}
+
+static int msg_tokens(const cJSON *msg)
+{
+    const char *content = cJSON_GetStringValue(cJSON_GetObjectItem(msg, "content"));
+    return MSG_OVERHEAD_TOKENS + (content ? (int)context_estimate_tokens(content, strlen(content)) : 0);
+}
+
+/* Byte length of the first keep tokens' worth of text, ending on a line if one is near */
+static size_t trim_point(const char *text, size_t len, size_t tokens, int keep)
+{
+    size_t cut = (size_t)((uint64_t)len * keep / tokens);
+    for (size_t nl = cut; nl > cut / 2; nl--) {
+        if (text[nl - 1] == '\n') return nl;
+    }
+    while (cut > 0 && ((uint8_t)text[cut] & 0xC0) == 0x80) cut--;
+    return cut;
+}
+
+/* Clip every part to its own budget, then cut the lowest-value parts until the total fits */
+static void budget_plan(budget_report_t *r)
+{
+    static const int budgets[PART_COUNT] = {
+        [SEC_SOUL] = MIMI_BUDGET_SOUL, [SEC_USER] = MIMI_BUDGET_USER,
+        [SEC_SKILLS] = MIMI_BUDGET_SKILLS, [SEC_MEMORY] = MIMI_BUDGET_MEMORY,
+        [SEC_RECENT] = MIMI_BUDGET_NOTES, [PART_HISTORY] = MIMI_BUDGET_HISTORY,
+    };
+
+    r->total = r->base + r->turn;
+    for (int i = 0; i < PART_COUNT; i++) {
+        r->kept[i] = r->want[i] < budgets[i] ? r->want[i] : budgets[i];
+        r->total += r->kept[i];
+    }
+
+    for (int d = 0; d < PART_COUNT && r->total > MIMI_CONTEXT_TOKEN_BUDGET; d++) {
+        int id = s_drop_order[d];
+        int over = r->total - MIMI_CONTEXT_TOKEN_BUDGET;
+        int cut = r->kept[id] < over ? r->kept[id] : over;
+        if (id != PART_HISTORY && r->kept[id] - cut < TRIM_MIN_TOKENS) cut = r->kept[id];
+        r->kept[id] -= cut;
+        r->total -= cut;
+    }
+}
+
+/*
+ * Drop the oldest verbatim messages until the rest fits; the first one kept
+ * after the summary must be a user turn. The summary pair counts against the
+ * budget but goes last, only if it does not fit on its own.
+ */
+static void history_trim(cJSON *history, budget_report_t *r)
+{
+    int count = cJSON_GetArraySize(history);
+    int total = r->want[PART_HISTORY];
+    int dropped = 0;
+    int from = session_history_summary_msgs(history);
+
+    while (count > 0) {
+        if (count == from) {
+            if (total <= r->kept[PART_HISTORY]) break;
+            from = 0;                    /* only the summary is left and still too large */
+        }
+        cJSON *first = cJSON_GetArrayItem(history, from);
+        const char *role = cJSON_GetStringValue(cJSON_GetObjectItem(first, "role"));
+        bool leading_reply = !role || strcmp(role, "user") != 0;
+        if (total <= r->kept[PART_HISTORY] && !leading_reply) break;
+        total -= msg_tokens(first);
+        cJSON_DeleteItemFromArray(history, from);
+        count--;
+        dropped++;
+    }
+
+    r->total += total - r->kept[PART_HISTORY];
+    r->kept[PART_HISTORY] = total;
+    r->history_msgs = count;
+    r->history_dropped = dropped;
+}
+
+esp_err_t context_build_system_prompt(char *buf, size_t size, size_t *stable_len,
+                                      cJSON *history, const char *user_text)
+{
+    int64_t now = esp_timer_get_time();
+    size_t off = snprintf(buf, size, "%s", PROMPT_INTRO);
+    if (off >= size) off = size - 1;
+
+    char rebuilt[64] = "";
+    int64_t build_us = 0;
+    int64_t saved_us = 0;
+    size_t stable = 0;
+
+    budget_report_t r = {0};
+    r.base = context_estimate_tokens(buf, off);
+    r.turn = TURN_CONTEXT_TOKENS + MSG_OVERHEAD_TOKENS +
+             (user_text ? context_estimate_tokens(user_text, strlen(user_text)) : 0);
+    const cJSON *item;
+    cJSON_ArrayForEach(item, history) {
+        r.want[PART_HISTORY] += msg_tokens(item);
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int id = 0; id < SEC_COUNT; id++) {
+        prompt_section_t *sec = &s_sections[id];
+        if (section_refresh(id, now)) {
+            build_us += sec->build_us;
+            size_t rl = strlen(rebuilt);
+            snprintf(rebuilt + rl, sizeof(rebuilt) - rl, "%s%s", rl ? "," : "", sec->name);
+        } else if (sec->valid) {
+            saved_us += sec->build_us;
+        }
+        r.want[id] = sec->text ? (int)sec->tokens : 0;
+    }
+
+    budget_plan(&r);
+    if (history) history_trim(history, &r);
+
+    for (int id = 0; id < SEC_COUNT; id++) {
+        /* Everything before memory changes rarely and forms the cacheable prefix;
+         * memory changes during conversations, so it goes after it. Stable
+         * sections are only trimmed by their own budget unless the prompt
+         * is far over, so the prefix stays byte-identical between turns. */
+        if (id == SEC_MEMORY) stable = off;
+
+        prompt_section_t *sec = &s_sections[id];
+        if (!sec->text || r.kept[id] == 0) continue;
+
+        size_t len = sec->len;
+        bool trimmed = r.kept[id] < (int)sec->tokens;
+        if (trimmed) len = trim_point(sec->text, sec->len, sec->tokens, r.kept[id]);
+
+        size_t n = len < size - 1 - off ? len : size - 1 - off;
+        memcpy(buf + off, sec->text, n);
+        off += n;
+        if (trimmed) off += snprintf(buf + off, size - off, "%s", TRIM_MARK);
+        if (off >= size) off = size - 1;
+    }
+    s_last_report = r;
+    xSemaphoreGive(s_lock);
+    buf[off] = '\0';
+
+    if (stable_len) *stable_len = stable;
+    ESP_LOGI(TAG, "System prompt built: %d bytes (%d stable), rebuilt [%s] in %lld ms, cache saved ~%lld ms",
+             (int)off, (int)stable, rebuilt, (long long)(build_us / 1000), (long long)(saved_us / 1000));
+
+    char parts[160] = "";
+    size_t pl = 0;
+    for (int id = 0; id < SEC_COUNT && pl < sizeof(parts); id++) {
+        if (r.want[id] == 0) continue;
+        pl += snprintf(parts + pl, sizeof(parts) - pl, " %s=%d/%d", s_sections[id].name, r.kept[id], r.want[id]);
+    }
+    ESP_LOGI(TAG, "Context budget: %d/%d tokens, base=%d turn=%d%s history=%d/%d (%d msgs, %d dropped)",
+             r.total, MIMI_CONTEXT_TOKEN_BUDGET, r.base, r.turn, parts,
+             r.kept[PART_HISTORY], r.want[PART_HISTORY], r.history_msgs, r.history_dropped);
     return ESP_OK;
 }
+
+void context_dump(void)
+{
+    if (!s_lock) {
+        printf("Context builder not initialized\n");
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int id = 0; id < SEC_COUNT; id++) {
+        const prompt_section_t *sec = &s_sections[id];
+        printf("  %-7s %5u bytes  rebuilds=%u hits=%u last_build=%lld ms saved=%lld ms%s\n",
+               sec->name, (unsigned)sec->len, (unsigned)sec->rebuilds, (unsigned)sec->hits,
+               (long long)(sec->build_us / 1000), (long long)(sec->saved_us / 1000),
+               sec->valid ? "" : "  (stale)");
+    }
+
+    const budget_report_t *r = &s_last_report;
+    printf("Last turn: %d/%d tokens (base %d, turn %d)\n",
+           r->total, MIMI_CONTEXT_TOKEN_BUDGET, r->base, r->turn);
+    for (int id = 0; id < PART_COUNT; id++) {
+        printf("  %-7s %5d/%-5d tokens%s\n",
+               id == PART_HISTORY ? "history" : s_sections[id].name, r->kept[id], r->want[id],
+               r->kept[id] < r->want[id] ? "  (trimmed)" : "");
+    }
+    if (r->history_dropped) {
+        printf("  history kept %d messages, dropped %d\n", r->history_msgs, r->history_dropped);
+    }
+    xSemaphoreGive(s_lock);
+}
@@ -2,13 +2,53 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include "cJSON.h"
+
+/**
+ * Initialize the prompt section cache.
+ */
+esp_err_t context_builder_init(void);
 
 /**
  * Build the system prompt from bootstrap files (SOUL.md, USER.md)
  * and memory context (MEMORY.md + recent daily notes).
+ * Sections that rarely change (instructions, SOUL, USER, skills) come first
+ * so they can be served from the provider's prompt cache. Each section is
+ * kept rendered in PSRAM and only re-read from SPIFFS when its sources change.
+ *
  *
- * @param buf   Output buffer (caller allocates, recommend MIMI_CONTEXT_BUF_SIZE)
- * @param size  Buffer size
+ * The prompt is held to MIMI_CONTEXT_TOKEN_BUDGET together with history and
+ * the current turn. Each section and the history is first clipped to its
+ * own MIMI_BUDGET_* limit; if the total is still over, daily notes, then
+ * the oldest history, then memory, skills, USER and SOUL are cut in that
+ * order. The instructions and the current turn are never cut.
+ *
+ * @param buf         Output buffer (caller allocates, recommend MIMI_CONTEXT_BUF_SIZE)
+ * @param size        Buffer size
+ * @param stable_len  Optional: length of the stable prefix of buf
+ * @param history     Optional: session history; oldest messages over budget are removed
+ * @param user_text   Optional: current user message, counted but never trimmed
+ */
+esp_err_t context_build_system_prompt(char *buf, size_t size, size_t *stable_len,
+                                      cJSON *history, const char *user_text);
+
+/**
+ * Rough token count of text (no tokenizer on device): one pass over the
+ * bytes, ASCII by character and word counts, multibyte text per character.
  */
-esp_err_t context_build_system_prompt(char *buf, size_t size);
+size_t context_estimate_tokens(const char *text, size_t len);
+
 
+/**
+ * Mark the prompt section fed by path as stale (SOUL.md, USER.md, MEMORY.md,
+ * daily notes, skills). Called from every write path; other paths are ignored.
+ * Writes that bypass this are caught by a size/mtime check every
+ * MIMI_CONTEXT_REVALIDATE_MS.
+ */
+void context_invalidate_path(const char *path);
+
+/**
+ * Print per-section size, rebuild/hit counts, time saved and the token
+ * budget report of the last turn (CLI).
+ */
+void context_dump(void);
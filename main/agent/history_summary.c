@@ -0,0 +1,261 @@
+#include "history_summary.h"
+#include "agent/context_builder.h"
+#include "llm/llm_proxy.h"
+#include "memory/session_mgr.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+
+static const char *TAG = "summary";
+
+#define SENTENCE_MAX    160     /* extractive fallback: chars kept per message */
+
+static const char *SUMMARY_PROMPT =
+    "You maintain the running summary of a chat between a user and an assistant. "
+    "Merge the previous summary (if any) and the new conversation excerpt into one "
+    "updated summary. Keep names, facts, decisions, open tasks and the user's "
+    "preferences; drop greetings and small talk. Write plain sentences in the "
+    "conversation's language, at most 150 words. Reply with the summary only.";
+
+static SemaphoreHandle_t s_lock;
+static history_summary_stats_t s_stats;
+static char s_busy[MIMI_AGENT_WORKERS][32];     /* chats being summarized (s_lock) */
+
+esp_err_t history_summary_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    return s_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void history_summary_get_stats(history_summary_stats_t *out)
+{
+    if (!s_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
+
+/* ── Helpers ──────────────────────────────────────────────────── */
+
+static const char *msg_role(const cJSON *msg)
+{
+    const char *role = cJSON_GetStringValue(cJSON_GetObjectItem(msg, "role"));
+    return role ? role : "";
+}
+
+static const char *msg_text(const cJSON *msg)
+{
+    const char *text = cJSON_GetStringValue(cJSON_GetObjectItem(msg, "content"));
+    return text ? text : "";
+}
+
+/* Largest length <= max that does not split a UTF-8 sequence */
+static size_t utf8_clip(const char *s, size_t len, size_t max)
+{
+    if (len <= max) return len;
+    while (max > 0 && ((unsigned char)s[max] & 0xC0) == 0x80) max--;
+    return max;
+}
+
+/* Append "<Role>: <text>\n", text clipped to max bytes */
+static size_t append_line(char *buf, size_t size, size_t off, const cJSON *msg, size_t max)
+{
+    if (off >= size - 1) return off;
+    const char *text = msg_text(msg);
+    size_t len = utf8_clip(text, strlen(text), max);
+    int n = snprintf(buf + off, size - off, "%s: %.*s%s\n",
+                     strcmp(msg_role(msg), "user") == 0 ? "User" : "Assistant",
+                     (int)len, text, len < strlen(text) ? "..." : "");
+    if (n < 0) return off;
+    return off + n >= size ? size - 1 : off + n;
+}
+
+/* ── Summaries ────────────────────────────────────────────────── */
+
+static char *summarize_llm(const char *previous, const cJSON *turns, int fold)
+{
+    char *transcript = heap_caps_malloc(MIMI_SUMMARY_INPUT_CHARS + 1, MALLOC_CAP_SPIRAM);
+    if (!transcript) return NULL;
+
+    size_t off = 0;
+    if (previous) {
+        off = snprintf(transcript, MIMI_SUMMARY_INPUT_CHARS + 1, "Previous summary:\n%.*s\n\n",
+                       MIMI_SUMMARY_MAX_CHARS, previous);
+    }
+    off += snprintf(transcript + off, MIMI_SUMMARY_INPUT_CHARS + 1 - off, "New conversation:\n");
+
+    /* Share what is left evenly, so one long message cannot crowd out the rest */
+    size_t share = (MIMI_SUMMARY_INPUT_CHARS - off) / fold;
+    for (int i = 0; i < fold; i++) {
+        off = append_line(transcript, MIMI_SUMMARY_INPUT_CHARS + 1, off,
+                          cJSON_GetArrayItem(turns, i), share > 16 ? share - 16 : share);
+    }
+
+    cJSON *messages = cJSON_CreateArray();
+    cJSON *msg = cJSON_CreateObject();
+    cJSON_AddStringToObject(msg, "role", "user");
+    cJSON_AddStringToObject(msg, "content", transcript);
+    cJSON_AddItemToArray(messages, msg);
+    free(transcript);
+
+    llm_response_t resp;
+    esp_err_t err = llm_complete(SUMMARY_PROMPT, messages, MIMI_SUMMARY_MAX_TOKENS, &resp);
+    cJSON_Delete(messages);
+    if (err != ESP_OK || !resp.text || resp.text_len == 0) {
+        ESP_LOGW(TAG, "Summarization call failed: %s", esp_err_to_name(err));
+        llm_response_free(&resp);
+        return NULL;
+    }
+
+    const char *text = resp.text;
+    while (*text == ' ' || *text == '\n') text++;
+    size_t len = utf8_clip(text, strlen(text), MIMI_SUMMARY_MAX_CHARS);
+    char *summary = len ? strndup(text, len) : NULL;
+    llm_response_free(&resp);
+    return summary;
+}
+
+/* Extractive fallback: the first sentence of each folded message */
+static char *summarize_local(const char *previous, const cJSON *turns, int fold)
+{
+    size_t size = MIMI_SUMMARY_MAX_CHARS * 2;
+    char *buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (!buf) return NULL;
+
+    size_t off = 0;
+    if (previous) off = snprintf(buf, size, "%s\n", previous);
+    if (off >= size) off = size - 1;
+    for (int i = 0; i < fold; i++) {
+        const cJSON *msg = cJSON_GetArrayItem(turns, i);
+        const char *text = msg_text(msg);
+        const char *end = strpbrk(text, ".!?\n");
+        size_t len = end ? (size_t)(end - text) + (*end == '\n' ? 0 : 1) : strlen(text);
+        off = append_line(buf, size, off, msg, len < SENTENCE_MAX ? len : SENTENCE_MAX);
+    }
+
+    /* Over the limit: keep the newest lines */
+    const char *start = buf;
+    while (off - (start - buf) > MIMI_SUMMARY_MAX_CHARS) {
+        const char *nl = strchr(start, '\n');
+        if (!nl) break;
+        start = nl + 1;
+    }
+    size_t len = off - (start - buf);
+    while (len > 0 && start[len - 1] == '\n') len--;
+    char *summary = len ? strndup(start, utf8_clip(start, len, MIMI_SUMMARY_MAX_CHARS)) : NULL;
+    free(buf);
+    return summary;
+}
+
+/* ── Public ───────────────────────────────────────────────────── */
+
+/* One summary per chat at a time: its next turn may end while this one still runs */
+static bool chat_claim(const char *chat_id)
+{
+    int free_slot = -1;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_AGENT_WORKERS; i++) {
+        if (strcmp(s_busy[i], chat_id) == 0) {
+            free_slot = -1;
+            break;
+        }
+        if (!s_busy[i][0] && free_slot < 0) free_slot = i;
+    }
+    if (free_slot >= 0) strncpy(s_busy[free_slot], chat_id, sizeof(s_busy[0]) - 1);
+    xSemaphoreGive(s_lock);
+    return free_slot >= 0;
+}
+
+static void chat_release(const char *chat_id)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_AGENT_WORKERS; i++) {
+        if (strcmp(s_busy[i], chat_id) == 0) s_busy[i][0] = '\0';
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static esp_err_t summary_update(const char *chat_id)
+{
+    session_mark_t mark;
+    cJSON *turns = session_get_turns(chat_id, MIMI_SESSION_MAX_MSGS, &mark);
+    int count = cJSON_GetArraySize(turns);
+
+    size_t tokens = 0;
+    const cJSON *item;
+    cJSON_ArrayForEach(item, turns) {
+        const char *text = msg_text(item);
+        tokens += context_estimate_tokens(text, strlen(text));
+    }
+
+    /* The next turn adds two messages: fold before any fall out of the history */
+    bool full = count >= MIMI_SESSION_MAX_MSGS - 2;
+    if (count <= MIMI_SUMMARY_KEEP_MSGS || (tokens <= MIMI_SUMMARY_TRIGGER_TOKENS && !full)) {
+        cJSON_Delete(turns);
+        return ESP_OK;
+    }
+
+    /* The kept part starts with a user message, right after the summary exchange */
+    int keep = MIMI_SUMMARY_KEEP_MSGS;
+    while (keep < count && strcmp(msg_role(cJSON_GetArrayItem(turns, count - keep)), "user") != 0) {
+        keep++;
+    }
+    int fold = count - keep;
+    if (fold <= 0) {
+        cJSON_Delete(turns);
+        return ESP_OK;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    char *previous = session_get_summary(chat_id);
+    bool from_llm = true;
+    char *summary = summarize_llm(previous, turns, fold);
+    if (!summary) {
+        from_llm = false;
+        summary = summarize_local(previous, turns, fold);
+    }
+    free(previous);
+    cJSON_Delete(turns);
+    if (!summary) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = session_set_summary(chat_id, summary, keep, &mark);
+    int64_t ms = (esp_timer_get_time() - start_us) / 1000;
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Chat %s: %d messages (~%u tokens) folded into a %s summary of %d bytes in %lld ms",
+                 chat_id, fold, (unsigned)tokens, from_llm ? "LLM" : "extractive",
+                 (int)strlen(summary), (long long)ms);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_stats.runs++;
+        if (from_llm) s_stats.llm++;
+        else s_stats.fallback++;
+        s_stats.folded += fold;
+        s_stats.ms_total += ms;
+        if (ms > s_stats.ms_max) s_stats.ms_max = ms;
+        xSemaphoreGive(s_lock);
+    } else {
+        ESP_LOGW(TAG, "Storing summary of %s failed: %s", chat_id, esp_err_to_name(err));
+    }
+    free(summary);
+    return err;
+}
+
+esp_err_t history_summary_maybe_update(const char *chat_id)
+{
+    if (!MIMI_SUMMARY_ENABLE) return ESP_OK;
+    if (!chat_claim(chat_id)) return ESP_OK;    /* already being folded */
+    esp_err_t err = summary_update(chat_id);
+    chat_release(chat_id);
+    return err;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+
+/**
+ * Initialize the summary statistics lock.
+ */
+esp_err_t history_summary_init(void);
+
+/**
+ * Fold the older turns of a chat into its rolling summary once the history
+ * passes MIMI_SUMMARY_TRIGGER_TOKENS, or is about to overflow
+ * MIMI_SESSION_MAX_MSGS. The newest MIMI_SUMMARY_KEEP_MSGS messages stay
+ * verbatim. The summary comes from a short LLM call (llm_complete); if that
+ * fails, a local extractive summary (first sentence of each message) is
+ * stored instead. Call after a turn has ended: the chat's next turn may run
+ * meanwhile (its messages stay verbatim); a chat already being folded is
+ * skipped.
+ * @return ESP_OK if nothing needed folding or a summary was stored
+ */
+esp_err_t history_summary_maybe_update(const char *chat_id);
+
+typedef struct {
+    uint32_t runs;                  /* summaries stored */
+    uint32_t llm;                   /* ...written by the LLM */
+    uint32_t fallback;              /* ...extractive, after an LLM failure */
+    uint32_t folded;                /* messages replaced by summaries */
+    int64_t ms_total;
+    int64_t ms_max;
+} history_summary_stats_t;
+
+void history_summary_get_stats(history_summary_stats_t *out);
@@ -0,0 +1,227 @@
+#include "turn_arena.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+
+static const char *TAG = "arena";
+
+#define ARENA_ALIGN     8
+#define ARENA_SLOTS     MIMI_AGENT_WORKERS
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    uint8_t *data;
+} arena_chunk_t;
+
+struct turn_arena {
+    TaskHandle_t owner;             /* task the arena is attached to, or NULL */
+    int escape;                     /* turn_arena_escape_begin() depth */
+    arena_chunk_t *head;            /* resident chunk first, newest chunk last */
+    arena_chunk_t *tail;
+    void *last;                     /* most recent block, can be rolled back */
+    size_t in_use;                  /* bytes handed out, minus rollbacks */
+    turn_arena_report_t report;
+};
+
+/*
+ * Every arena created. A slot is filled once at startup and its owner is
+ * only written by the owning task; other tasks just compare it against
+ * their own handle, so lookups need no lock.
+ */
+static turn_arena_t *s_slots[ARENA_SLOTS];
+static int s_slot_count = 0;
+
+/* ── Chunks ───────────────────────────────────────────────────── */
+
+static arena_chunk_t *chunk_new(size_t size)
+{
+    arena_chunk_t *chunk = heap_caps_malloc(sizeof(arena_chunk_t) + size, MALLOC_CAP_SPIRAM);
+    if (!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->data = (uint8_t *)(chunk + 1);
+    return chunk;
+}
+
+static bool chunk_owns(const arena_chunk_t *chunk, const void *ptr)
+{
+    const uint8_t *p = (const uint8_t *)ptr;
+    return p >= chunk->data && p < chunk->data + chunk->size;
+}
+
+/* ── cJSON hooks ──────────────────────────────────────────────── */
+
+static turn_arena_t *current_arena(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < s_slot_count; i++) {
+        turn_arena_t *a = s_slots[i];
+        if (a && a->owner == self) return a;
+    }
+    return NULL;
+}
+
+static void *arena_malloc(size_t size)
+{
+    turn_arena_t *a = current_arena();
+    if (!a || a->escape > 0) return malloc(size);
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    arena_chunk_t *chunk = a->tail;
+    if (chunk->size - chunk->used < size) {
+        /* Oversized blocks get a chunk of their own */
+        chunk = chunk_new(size > MIMI_ARENA_CHUNK_SIZE / 2 ? size : MIMI_ARENA_CHUNK_SIZE);
+        if (!chunk) {
+            a->report.heap_fallbacks++;
+            return malloc(size);
+        }
+        a->tail->next = chunk;
+        a->tail = chunk;
+        a->report.chunks++;
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    a->last = ptr;
+    a->in_use += size;
+    a->report.allocs++;
+    if (a->in_use > a->report.peak) a->report.peak = a->in_use;
+    return ptr;
+}
+
+static void arena_free(void *ptr)
+{
+    if (!ptr) return;
+    turn_arena_t *a = current_arena();
+    if (a) {
+        for (arena_chunk_t *c = a->head; c; c = c->next) {
+            if (!chunk_owns(c, ptr)) continue;
+            /* cJSON often frees what it just allocated (print buffers, failed parses) */
+            if (ptr == a->last && c == a->tail) {
+                size_t size = c->used - ((uint8_t *)ptr - c->data);
+                c->used -= size;
+                a->in_use -= size;
+                a->last = NULL;
+            }
+            return;
+        }
+    }
+    free(ptr);
+}
+
+/* ── Public ───────────────────────────────────────────────────── */
+
+esp_err_t turn_arena_init(void)
+{
+#if MIMI_ARENA_ENABLE
+    cJSON_Hooks hooks = {
+        .malloc_fn = arena_malloc,
+        .free_fn = arena_free,
+    };
+    cJSON_InitHooks(&hooks);
+    ESP_LOGI(TAG, "cJSON arena hooks installed (chunk %d bytes)", MIMI_ARENA_CHUNK_SIZE);
+#endif
+    return ESP_OK;
+}
+
+turn_arena_t *turn_arena_create(void)
+{
+#if MIMI_ARENA_ENABLE
+    if (s_slot_count >= ARENA_SLOTS) return NULL;
+    turn_arena_t *a = heap_caps_calloc(1, sizeof(turn_arena_t), MALLOC_CAP_SPIRAM);
+    if (!a) return NULL;
+    a->head = chunk_new(MIMI_ARENA_CHUNK_SIZE);
+    if (!a->head) {
+        free(a);
+        return NULL;
+    }
+    a->tail = a->head;
+    s_slots[s_slot_count++] = a;
+    return a;
+#else
+    return NULL;
+#endif
+}
+
+void turn_arena_begin(turn_arena_t *arena)
+{
+    if (!arena) return;
+    arena->escape = 0;
+    memset(&arena->report, 0, sizeof(arena->report));
+    arena->report.chunks = 1;
+    arena->owner = xTaskGetCurrentTaskHandle();
+}
+
+void turn_arena_end(turn_arena_t *arena, turn_arena_report_t *report)
+{
+    if (report) memset(report, 0, sizeof(*report));
+    if (!arena) return;
+
+    arena->owner = NULL;
+
+    arena_chunk_t *c = arena->head->next;
+    while (c) {
+        arena_chunk_t *next = c->next;
+        free(c);
+        c = next;
+    }
+    arena->head->next = NULL;
+    arena->head->used = 0;
+    arena->tail = arena->head;
+    arena->last = NULL;
+    arena->in_use = 0;
+    if (report) *report = arena->report;
+}
+
+turn_arena_mark_t turn_arena_mark(void)
+{
+    turn_arena_mark_t mark = {0};
+    turn_arena_t *a = current_arena();
+    if (a) {
+        mark.chunk = a->tail;
+        mark.used = a->tail->used;
+        mark.in_use = a->in_use;
+    }
+    return mark;
+}
+
+void turn_arena_release(const turn_arena_mark_t *mark)
+{
+    turn_arena_t *a = current_arena();
+    if (!a || !mark->chunk) return;
+
+    arena_chunk_t *c = mark->chunk;
+    arena_chunk_t *next = c->next;
+    while (next) {
+        arena_chunk_t *after = next->next;
+        free(next);
+        next = after;
+    }
+    c->next = NULL;
+    c->used = mark->used;
+    a->tail = c;
+    a->last = NULL;
+    a->in_use = mark->in_use;
+}
+
+void turn_arena_escape_begin(void)
+{
+    turn_arena_t *a = current_arena();
+    if (a) a->escape++;
+}
+
+void turn_arena_escape_end(void)
+{
+    turn_arena_t *a = current_arena();
+    if (a && a->escape > 0) a->escape--;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Per-turn bump allocator for cJSON. While an arena is attached to a task,
+ * every cJSON allocation of that task is carved from PSRAM chunks and
+ * cJSON frees are no-ops (except for the most recent block, which is
+ * rolled back); turn_arena_end() releases the whole turn at once. Other
+ * tasks keep using the heap.
+ *
+ * Anything that must outlive the turn (the session history cache, cached
+ * request fragments) is allocated inside turn_arena_escape_begin()/end().
+ * Strings handed to other tasks (outbound content) are plain malloc/strdup
+ * and never touch the arena. Memory returned by cJSON_Print*() must be
+ * released with cJSON_free().
+ */
+
+typedef struct turn_arena turn_arena_t;
+
+typedef struct {
+    size_t peak;                    /* high-water mark of bytes handed out */
+    uint32_t allocs;
+    uint32_t chunks;                /* chunks used, including the resident one */
+    uint32_t heap_fallbacks;        /* allocations served by the heap (chunk alloc failed) */
+} turn_arena_report_t;
+
+/**
+ * Route cJSON through the arena hooks. Call once, before any task parses JSON.
+ */
+esp_err_t turn_arena_init(void);
+
+/**
+ * Create an arena with one resident MIMI_ARENA_CHUNK_SIZE chunk in PSRAM.
+ * Arenas live for the whole run, at most one per agent worker.
+ * Call from a single task at startup.
+ * @return NULL if out of memory, out of slots or MIMI_ARENA_ENABLE is 0
+ */
+turn_arena_t *turn_arena_create(void);
+
+/**
+ * Attach the arena to the calling task.
+ */
+void turn_arena_begin(turn_arena_t *arena);
+
+/**
+ * Detach the arena and release everything allocated from it, keeping the
+ * resident chunk for the next turn.
+ * @param report  Optional: usage of the turn that just ended
+ */
+void turn_arena_end(turn_arena_t *arena, turn_arena_report_t *report);
+
+typedef struct {
+    void *chunk;
+    size_t used;
+    size_t in_use;
+} turn_arena_mark_t;
+
+/**
+ * Remember the current top of this task's arena, so that a burst of
+ * short-lived documents (one per stream event) can be released with
+ * turn_arena_release() instead of piling up until the end of the turn.
+ * Everything allocated after the mark must be dead by then.
+ */
+turn_arena_mark_t turn_arena_mark(void);
+void turn_arena_release(const turn_arena_mark_t *mark);
+
+/**
+ * Allocate from the heap on this task until the matching
+ * turn_arena_escape_end(). Nests; no effect without an attached arena.
+ */
+void turn_arena_escape_begin(void);
+void turn_arena_escape_end(void);
@@ -0,0 +1,193 @@
+#include "channel_registry.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+static const char *TAG = "channel";
+
+typedef struct channel channel_t;
+
+typedef struct {
+    channel_t *channel;
+    QueueHandle_t queue;
+} channel_lane_t;
+
+struct channel {
+    char name[16];
+    channel_send_fn_t send;
+    int lane_count;
+    int queue_len;
+    channel_lane_t lanes[MIMI_CHANNEL_MAX_LANES];
+    channel_stats_t stats;          /* guarded by s_lock */
+};
+
+/*
+ * Filled once at startup. An entry is complete before s_count covers it,
+ * so lookups from pushing tasks need no lock.
+ */
+static channel_t s_channels[MIMI_CHANNEL_MAX];
+static int s_count = 0;
+static SemaphoreHandle_t s_lock;
+
+static channel_t *channel_find(const char *name)
+{
+    for (int i = 0; i < s_count; i++) {
+        if (strcmp(s_channels[i].name, name) == 0) return &s_channels[i];
+    }
+    return NULL;
+}
+
+/* Same chat, same lane: keeps its "working" status ahead of its reply */
+static channel_lane_t *lane_for(channel_t *ch, const char *chat_id)
+{
+    uint32_t h = 2166136261u;
+    for (const char *p = chat_id; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619u;
+    }
+    return &ch->lanes[h % ch->lane_count];
+}
+
+static int channel_depth(const channel_t *ch)
+{
+    int depth = 0;
+    for (int i = 0; i < ch->lane_count; i++) depth += uxQueueMessagesWaiting(ch->lanes[i].queue);
+    return depth;
+}
+
+/* ── Dispatchers ──────────────────────────────────────────────── */
+
+static void channel_lane_task(void *arg)
+{
+    channel_lane_t *lane = (channel_lane_t *)arg;
+    channel_t *ch = lane->channel;
+    ESP_LOGI(TAG, "Dispatcher for %s started on core %d", ch->name, xPortGetCoreID());
+
+    while (1) {
+        mimi_msg_t msg;
+        if (xQueueReceive(lane->queue, &msg, portMAX_DELAY) != pdTRUE) continue;
+
+        ESP_LOGI(TAG, "Dispatching response to %s:%s", msg.channel, msg.chat_id);
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t err = ch->send(msg.chat_id, msg.content ? msg.content : "");
+        int64_t send_ms = (esp_timer_get_time() - start_us) / 1000;
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "%s send failed for %s: %s", ch->name, msg.chat_id, esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "%s send success for %s (%d bytes, %lld ms)", ch->name, msg.chat_id,
+                     (int)payload_len(msg.content), (long long)send_ms);
+        }
+        payload_release(msg.content);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        /* Up to the hand-off: send time is accounted separately below */
+        if (msg.origin_us) bus_hist_add(&ch->stats.e2e, start_us - msg.origin_us);
+        if (err == ESP_OK) ch->stats.sent++;
+        else ch->stats.failed++;
+        ch->stats.send_ms_total += send_ms;
+        if (send_ms > ch->stats.send_ms_max) ch->stats.send_ms_max = send_ms;
+        xSemaphoreGive(s_lock);
+    }
+}
+
+/* ── Public ───────────────────────────────────────────────────── */
+
+esp_err_t channel_register(const channel_desc_t *desc)
+{
+    if (!desc || !desc->name || !desc->send || desc->lanes < 1 ||
+        desc->lanes > MIMI_CHANNEL_MAX_LANES || desc->queue_len < 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) return ESP_ERR_NO_MEM;
+    }
+    if (channel_find(desc->name)) return ESP_ERR_INVALID_STATE;
+    if (s_count >= MIMI_CHANNEL_MAX) {
+        ESP_LOGE(TAG, "No room for channel %s (MIMI_CHANNEL_MAX=%d)", desc->name, MIMI_CHANNEL_MAX);
+        return ESP_ERR_NO_MEM;
+    }
+
+    channel_t *ch = &s_channels[s_count];
+    memset(ch, 0, sizeof(*ch));
+    strncpy(ch->name, desc->name, sizeof(ch->name) - 1);
+    ch->send = desc->send;
+    ch->queue_len = desc->queue_len;
+    strncpy(ch->stats.name, ch->name, sizeof(ch->stats.name) - 1);
+
+    for (int i = 0; i < desc->lanes; i++) {
+        channel_lane_t *lane = &ch->lanes[i];
+        lane->channel = ch;
+        lane->queue = xQueueCreate(desc->queue_len, sizeof(mimi_msg_t));
+        char task_name[16];
+        snprintf(task_name, sizeof(task_name), "out_%.8s%d", ch->name, i);
+        if (!lane->queue ||
+            xTaskCreatePinnedToCore(channel_lane_task, task_name, desc->stack, lane,
+                                    MIMI_OUTBOUND_PRIO, NULL, MIMI_OUTBOUND_CORE) != pdPASS) {
+            ESP_LOGW(TAG, "%s lane %d create failed (free_internal=%u)", ch->name, i,
+                     (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+            if (lane->queue) vQueueDelete(lane->queue);
+            lane->queue = NULL;
+            break;
+        }
+        ch->lane_count++;
+    }
+    if (ch->lane_count == 0) return ESP_FAIL;
+
+    ch->stats.lanes = ch->lane_count;
+    ch->stats.capacity = ch->lane_count * ch->queue_len;
+    s_count++;
+    ESP_LOGI(TAG, "Channel %s registered: %d lane(s) x %d queued", ch->name, ch->lane_count, ch->queue_len);
+    return ESP_OK;
+}
+
+esp_err_t channel_push(const mimi_msg_t *msg)
+{
+    channel_t *ch = channel_find(msg->channel);
+    if (!ch) {
+        ESP_LOGW(TAG, "Unknown channel: %s", msg->channel);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    channel_lane_t *lane = lane_for(ch, msg->chat_id);
+    int64_t start_us = esp_timer_get_time();
+    bool queued = xQueueSend(lane->queue, msg, pdMS_TO_TICKS(1000)) == pdTRUE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bus_hist_add(&ch->stats.wait, esp_timer_get_time() - start_us);
+    if (queued) {
+        int depth = channel_depth(ch);
+        if (depth > ch->stats.depth_max) ch->stats.depth_max = depth;
+    } else {
+        ch->stats.dropped++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (!queued) {
+        ESP_LOGW(TAG, "%s outbound queue full, dropping message", ch->name);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+int channel_get_stats(channel_stats_t *out, int max)
+{
+    if (!s_lock) return 0;
+    int n = s_count < max ? s_count : max;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < n; i++) {
+        out[i] = s_channels[i].stats;
+        out[i].depth = channel_depth(&s_channels[i]);
+    }
+    xSemaphoreGive(s_lock);
+    return n;
+}
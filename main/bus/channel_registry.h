@@ -0,0 +1,58 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include "bus/message_bus.h"
+
+/*
+ * Outbound side of the bus. Every channel registers a send handler and gets
+ * its own lanes: a bounded queue plus a dispatcher task each. A chat always
+ * maps to the same lane, so its replies stay in order, while a slow channel
+ * (Telegram retries, proxy tunnel) only holds up its own queue.
+ */
+
+/* Deliver text to chat_id; runs on the channel's dispatcher task */
+typedef esp_err_t (*channel_send_fn_t)(const char *chat_id, const char *text);
+
+typedef struct {
+    const char *name;               /* MIMI_CHAN_* */
+    channel_send_fn_t send;
+    int lanes;                      /* concurrent sends, 1..MIMI_CHANNEL_MAX_LANES */
+    int queue_len;                  /* queue depth per lane */
+    uint32_t stack;                 /* dispatcher task stack */
+} channel_desc_t;
+
+/**
+ * Register a channel and start its dispatcher tasks (Core MIMI_OUTBOUND_CORE).
+ * Call during startup, before anything pushes to it.
+ */
+esp_err_t channel_register(const channel_desc_t *desc);
+
+/**
+ * Queue msg on its channel's lane. Takes over the reference to msg->content
+ * on success.
+ * @return ESP_ERR_NOT_FOUND for an unregistered channel,
+ *         ESP_ERR_NO_MEM if the lane stayed full for a second
+ */
+esp_err_t channel_push(const mimi_msg_t *msg);
+
+typedef struct {
+    char name[16];
+    int lanes;
+    int depth;                      /* messages queued right now, all lanes */
+    int depth_max;
+    int capacity;                   /* lanes x queue_len */
+    uint32_t sent;
+    uint32_t failed;                /* handler returned an error */
+    uint32_t dropped;               /* lane full, message discarded */
+    int64_t send_ms_total;
+    int64_t send_ms_max;
+    bus_hist_t wait;                /* time channel_push() blocked on a full lane */
+    bus_hist_t e2e;                 /* inbound enqueue -> dispatch, replies with origin_us only */
+} channel_stats_t;
+
+/**
+ * Copy the statistics of up to max channels.
+ * @return number of channels written
+ */
+int channel_get_stats(channel_stats_t *out, int max);
@@ -1,59 +1,336 @@
 #include "message_bus.h"
+#include "channel_registry.h"
 #include "mimi_config.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/semphr.h"
+#include "cJSON.h"
 #include <string.h>
 
 static const char *TAG = "bus";
 
-static QueueHandle_t s_inbound_queue;
-static QueueHandle_t s_outbound_queue;
+/* FIFO of messages in a fixed buffer */
+typedef struct {
+    mimi_msg_t *buf;
+    int cap;
+    int head;
+    int count;
+} msg_ring_t;
 
-esp_err_t message_bus_init(void)
+/* Inbound class: a small queue in internal RAM, overflowing into PSRAM */
+typedef struct {
+    msg_ring_t queue;
+    msg_ring_t spill;
+    bus_class_stats_t stats;
+} inbound_class_t;
+
+static mimi_msg_t s_queue_buf[MIMI_PRIO_COUNT][MIMI_BUS_QUEUE_LEN];
+static inbound_class_t s_classes[MIMI_PRIO_COUNT];
+static prio_sched_t s_sched;
+static bus_producer_stats_t s_producers[MIMI_BUS_PRODUCERS_MAX];    /* guarded by s_lock */
+static int s_producer_count = 0;
+
+static SemaphoreHandle_t s_lock;
+static SemaphoreHandle_t s_avail;       /* counts queued messages, all classes */
+static SemaphoreHandle_t s_space;       /* given on every pop, wakes a blocked push */
+
+static const int s_weights[MIMI_PRIO_COUNT] = {
+    MIMI_BUS_WEIGHT_INTERACTIVE,
+    MIMI_BUS_WEIGHT_SCHEDULED,
+    MIMI_BUS_WEIGHT_BACKGROUND,
+};
+
+static const uint32_t s_hist_bounds_ms[BUS_HIST_BUCKETS - 1] = {1, 10, 100, 1000, 10000, 60000};
+
+static bool ring_push(msg_ring_t *r, const mimi_msg_t *msg)
+{
+    if (r->count >= r->cap) return false;
+    r->buf[(r->head + r->count) % r->cap] = *msg;
+    r->count++;
+    return true;
+}
+
+static bool ring_pop(msg_ring_t *r, mimi_msg_t *out)
 {
-    s_inbound_queue = xQueueCreate(MIMI_BUS_QUEUE_LEN, sizeof(mimi_msg_t));
-    s_outbound_queue = xQueueCreate(MIMI_BUS_QUEUE_LEN, sizeof(mimi_msg_t));
+    if (r->count == 0) return false;
+    *out = r->buf[r->head];
+    r->head = (r->head + 1) % r->cap;
+    r->count--;
+    return true;
+}
 
-    if (!s_inbound_queue || !s_outbound_queue) {
-        ESP_LOGE(TAG, "Failed to create message queues");
+esp_err_t message_bus_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    s_avail = xSemaphoreCreateCounting(MIMI_PRIO_COUNT * (MIMI_BUS_QUEUE_LEN + MIMI_BUS_SPILL_LEN), 0);
+    s_space = xSemaphoreCreateBinary();
+    if (!s_lock || !s_avail || !s_space) {
+        ESP_LOGE(TAG, "Failed to create inbound queue");
         return ESP_ERR_NO_MEM;
     }
 
-    ESP_LOGI(TAG, "Message bus initialized (queue depth %d)", MIMI_BUS_QUEUE_LEN);
+    for (int c = 0; c < MIMI_PRIO_COUNT; c++) {
+        s_classes[c].queue.buf = s_queue_buf[c];
+        s_classes[c].queue.cap = MIMI_BUS_QUEUE_LEN;
+        s_classes[c].spill.buf = heap_caps_calloc(MIMI_BUS_SPILL_LEN, sizeof(mimi_msg_t), MALLOC_CAP_SPIRAM);
+        s_classes[c].spill.cap = s_classes[c].spill.buf ? MIMI_BUS_SPILL_LEN : 0;
+        s_classes[c].stats.capacity = s_classes[c].queue.cap + s_classes[c].spill.cap;
+        if (!s_classes[c].spill.buf) {
+            ESP_LOGW(TAG, "No spill ring for %s messages", message_bus_prio_name(c));
+        }
+    }
+
+    esp_err_t err = payload_pool_init();
+    if (err != ESP_OK) return err;
+
+    ESP_LOGI(TAG, "Message bus initialized (%d classes, queue depth %d + %d spilled)",
+             MIMI_PRIO_COUNT, MIMI_BUS_QUEUE_LEN, MIMI_BUS_SPILL_LEN);
     return ESP_OK;
 }
 
+/* ── Scheduling ───────────────────────────────────────────────── */
+
+int prio_sched_pick(prio_sched_t *s, const bool ready[MIMI_PRIO_COUNT])
+{
+    if (MIMI_BUS_STRICT_PRIO) {
+        for (int c = 0; c < MIMI_PRIO_COUNT; c++) {
+            if (ready[c]) return c;
+        }
+        return -1;
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int c = 0; c < MIMI_PRIO_COUNT; c++) {
+            if (ready[c] && s->credit[c] > 0) {
+                s->credit[c]--;
+                return c;
+            }
+        }
+        /* Every ready class has used its share of this round */
+        for (int c = 0; c < MIMI_PRIO_COUNT; c++) s->credit[c] = s_weights[c];
+    }
+    return -1;
+}
+
+const char *message_bus_prio_name(int prio)
+{
+    switch (prio) {
+    case MIMI_PRIO_INTERACTIVE: return "interactive";
+    case MIMI_PRIO_SCHEDULED:   return "scheduled";
+    case MIMI_PRIO_BACKGROUND:  return "background";
+    default:                    return "?";
+    }
+}
+
+/* ── Metrics ──────────────────────────────────────────────────── */
+
+uint32_t bus_hist_bound_ms(int i)
+{
+    return (i >= 0 && i < BUS_HIST_BUCKETS - 1) ? s_hist_bounds_ms[i] : 0;
+}
+
+void bus_hist_add(bus_hist_t *h, int64_t us)
+{
+    if (us < 0) us = 0;
+    int b = 0;
+    while (b < BUS_HIST_BUCKETS - 1 && us >= (int64_t)s_hist_bounds_ms[b] * 1000) b++;
+    h->bucket[b]++;
+    h->count++;
+    h->total_us += us;
+    if (us > h->max_us) h->max_us = us;
+}
+
+/* Caller holds s_lock. NULL once the table is full: the class totals still count it */
+static bus_producer_stats_t *producer_find_locked(uint8_t prio, const char *channel)
+{
+    for (int i = 0; i < s_producer_count; i++) {
+        if (s_producers[i].prio == prio && strcmp(s_producers[i].channel, channel) == 0) {
+            return &s_producers[i];
+        }
+    }
+    if (s_producer_count >= MIMI_BUS_PRODUCERS_MAX) return NULL;
+    bus_producer_stats_t *p = &s_producers[s_producer_count++];
+    p->prio = prio;
+    strncpy(p->channel, channel, sizeof(p->channel) - 1);
+    return p;
+}
+
+/* ── Inbound ──────────────────────────────────────────────────── */
+
 esp_err_t message_bus_push_inbound(const mimi_msg_t *msg)
 {
-    if (xQueueSend(s_inbound_queue, msg, pdMS_TO_TICKS(1000)) != pdTRUE) {
-        ESP_LOGW(TAG, "Inbound queue full, dropping message");
-        return ESP_ERR_NO_MEM;
+    mimi_msg_t stamped = *msg;
+    stamped.enqueue_us = esp_timer_get_time();
+    if (stamped.prio >= MIMI_PRIO_COUNT) stamped.prio = MIMI_PRIO_BACKGROUND;
+    inbound_class_t *cls = &s_classes[stamped.prio];
+
+    int64_t deadline_us = stamped.enqueue_us + 1000 * 1000;
+    while (1) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        /* Keep FIFO order: once anything is spilled, later messages queue behind it */
+        bool queued = cls->spill.count == 0 && ring_push(&cls->queue, &stamped);
+        bool spilled = !queued && ring_push(&cls->spill, &stamped);
+        if (queued || spilled) {
+            cls->stats.pushed++;
+            if (spilled) cls->stats.spilled++;
+            int depth = cls->queue.count + cls->spill.count;
+            if (depth > cls->stats.depth_max) cls->stats.depth_max = depth;
+            bus_hist_add(&cls->stats.wait, esp_timer_get_time() - stamped.enqueue_us);
+            bus_producer_stats_t *p = producer_find_locked(stamped.prio, stamped.channel);
+            if (p) p->pushed++;
+        }
+        xSemaphoreGive(s_lock);
+
+        if (queued || spilled) {
+            if (spilled) {
+                ESP_LOGW(TAG, "Inbound %s queue full, message spilled to PSRAM",
+                         message_bus_prio_name(stamped.prio));
+            }
+            xSemaphoreGive(s_avail);
+            return ESP_OK;
+        }
+
+        int64_t left_us = deadline_us - esp_timer_get_time();
+        if (left_us <= 0 || xSemaphoreTake(s_space, pdMS_TO_TICKS(left_us / 1000) + 1) != pdTRUE) {
+            break;
+        }
     }
-    return ESP_OK;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cls->stats.dropped++;
+    bus_hist_add(&cls->stats.wait, esp_timer_get_time() - stamped.enqueue_us);
+    bus_producer_stats_t *p = producer_find_locked(stamped.prio, stamped.channel);
+    if (p) p->dropped++;
+    xSemaphoreGive(s_lock);
+    ESP_LOGW(TAG, "Inbound %s queue and spill full, dropping %s message",
+             message_bus_prio_name(stamped.prio), stamped.channel);
+    return ESP_ERR_NO_MEM;
 }
 
 esp_err_t message_bus_pop_inbound(mimi_msg_t *msg, uint32_t timeout_ms)
 {
     TickType_t ticks = (timeout_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
-    if (xQueueReceive(s_inbound_queue, msg, ticks) != pdTRUE) {
+    if (xSemaphoreTake(s_avail, ticks) != pdTRUE) {
         return ESP_ERR_TIMEOUT;
     }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ready[MIMI_PRIO_COUNT];
+    for (int c = 0; c < MIMI_PRIO_COUNT; c++) ready[c] = s_classes[c].queue.count > 0;
+    if (ready[MIMI_PRIO_INTERACTIVE]) ready[MIMI_PRIO_BACKGROUND] = false;
+
+    /* s_avail guarantees a message; background is only held back behind interactive */
+    int c = prio_sched_pick(&s_sched, ready);
+    inbound_class_t *cls = &s_classes[c];
+    ring_pop(&cls->queue, msg);
+    mimi_msg_t moved;
+    if (ring_pop(&cls->spill, &moved)) ring_push(&cls->queue, &moved);
+    xSemaphoreGive(s_lock);
+
+    xSemaphoreGive(s_space);
     return ESP_OK;
 }
 
+/* ── Outbound ─────────────────────────────────────────────────── */
+
+static uint32_t s_outbound_unknown = 0;     /* guarded by s_lock */
+
 esp_err_t message_bus_push_outbound(const mimi_msg_t *msg)
 {
-    if (xQueueSend(s_outbound_queue, msg, pdMS_TO_TICKS(1000)) != pdTRUE) {
-        ESP_LOGW(TAG, "Outbound queue full, dropping message");
-        return ESP_ERR_NO_MEM;
+    esp_err_t err = channel_push(msg);
+    if (err == ESP_ERR_NOT_FOUND) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_outbound_unknown++;
+        xSemaphoreGive(s_lock);
     }
-    return ESP_OK;
+    return err;
 }
 
-esp_err_t message_bus_pop_outbound(mimi_msg_t *msg, uint32_t timeout_ms)
+/* ── Reporting ────────────────────────────────────────────────── */
+
+void message_bus_get_metrics(bus_metrics_t *out)
 {
-    TickType_t ticks = (timeout_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
-    if (xQueueReceive(s_outbound_queue, msg, ticks) != pdTRUE) {
-        return ESP_ERR_TIMEOUT;
+    memset(out, 0, sizeof(*out));
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int c = 0; c < MIMI_PRIO_COUNT; c++) {
+        out->inbound[c] = s_classes[c].stats;
+        out->inbound[c].depth = s_classes[c].queue.count + s_classes[c].spill.count;
+        out->inbound[c].spilled_now = s_classes[c].spill.count;
     }
-    return ESP_OK;
+    memcpy(out->producers, s_producers, sizeof(s_producers));
+    out->producer_count = s_producer_count;
+    out->outbound_unknown = s_outbound_unknown;
+    xSemaphoreGive(s_lock);
+}
+
+static cJSON *hist_json(const bus_hist_t *h)
+{
+    cJSON *obj = cJSON_CreateObject();
+    cJSON_AddNumberToObject(obj, "count", h->count);
+    cJSON_AddNumberToObject(obj, "avg_ms", h->count ? (double)(h->total_us / h->count) / 1000.0 : 0);
+    cJSON_AddNumberToObject(obj, "max_ms", (double)h->max_us / 1000.0);
+    /* Bucket i counts samples below le_ms[i]; the last one is unbounded */
+    cJSON *le = cJSON_AddArrayToObject(obj, "le_ms");
+    cJSON *buckets = cJSON_AddArrayToObject(obj, "buckets");
+    for (int i = 0; i < BUS_HIST_BUCKETS; i++) {
+        if (i < BUS_HIST_BUCKETS - 1) cJSON_AddItemToArray(le, cJSON_CreateNumber(s_hist_bounds_ms[i]));
+        cJSON_AddItemToArray(buckets, cJSON_CreateNumber(h->bucket[i]));
+    }
+    return obj;
+}
+
+char *message_bus_metrics_json(void)
+{
+    bus_metrics_t m;
+    message_bus_get_metrics(&m);
+    channel_stats_t ch[MIMI_CHANNEL_MAX];
+    int n = channel_get_stats(ch, MIMI_CHANNEL_MAX);
+
+    cJSON *root = cJSON_CreateObject();
+    if (!root) return NULL;
+    cJSON_AddNumberToObject(root, "uptime_ms", (double)(esp_timer_get_time() / 1000));
+
+    cJSON *inbound = cJSON_AddObjectToObject(root, "inbound");
+    for (int c = 0; c < MIMI_PRIO_COUNT; c++) {
+        const bus_class_stats_t *s = &m.inbound[c];
+        cJSON *cls = cJSON_AddObjectToObject(inbound, message_bus_prio_name(c));
+        cJSON_AddNumberToObject(cls, "depth", s->depth);
+        cJSON_AddNumberToObject(cls, "depth_max", s->depth_max);
+        cJSON_AddNumberToObject(cls, "capacity", s->capacity);
+        cJSON_AddNumberToObject(cls, "spilled_now", s->spilled_now);
+        cJSON_AddNumberToObject(cls, "pushed", s->pushed);
+        cJSON_AddNumberToObject(cls, "spilled", s->spilled);
+        cJSON_AddNumberToObject(cls, "dropped", s->dropped);
+        cJSON_AddItemToObject(cls, "enqueue_wait", hist_json(&s->wait));
+    }
+
+    cJSON *producers = cJSON_AddArrayToObject(root, "producers");
+    for (int i = 0; i < m.producer_count; i++) {
+        cJSON *p = cJSON_CreateObject();
+        cJSON_AddStringToObject(p, "class", message_bus_prio_name(m.producers[i].prio));
+        cJSON_AddStringToObject(p, "channel", m.producers[i].channel);
+        cJSON_AddNumberToObject(p, "pushed", m.producers[i].pushed);
+        cJSON_AddNumberToObject(p, "dropped", m.producers[i].dropped);
+        cJSON_AddItemToArray(producers, p);
+    }
+
+    cJSON *outbound = cJSON_AddObjectToObject(root, "outbound");
+    cJSON_AddNumberToObject(outbound, "unknown_channel", m.outbound_unknown);
+    for (int i = 0; i < n; i++) {
+        cJSON *c = cJSON_AddObjectToObject(outbound, ch[i].name);
+        cJSON_AddNumberToObject(c, "lanes", ch[i].lanes);
+        cJSON_AddNumberToObject(c, "depth", ch[i].depth);
+        cJSON_AddNumberToObject(c, "depth_max", ch[i].depth_max);
+        cJSON_AddNumberToObject(c, "capacity", ch[i].capacity);
+        cJSON_AddNumberToObject(c, "sent", ch[i].sent);
+        cJSON_AddNumberToObject(c, "failed", ch[i].failed);
+        cJSON_AddNumberToObject(c, "dropped", ch[i].dropped);
+        cJSON_AddItemToObject(c, "enqueue_wait", hist_json(&ch[i].wait));
+        cJSON_AddItemToObject(c, "e2e", hist_json(&ch[i].e2e));
+    }
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
 }
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "mimi_config.h"
+#include "bus/payload_pool.h"
 
 /* Channel identifiers */
 #define MIMI_CHAN_TELEGRAM   "telegram"
@@ -10,38 +14,117 @@
 #define MIMI_CHAN_CLI        "cli"
 #define MIMI_CHAN_SYSTEM     "system"
 
+/* Inbound priority classes; zero-initialized messages are interactive */
+typedef enum {
+    MIMI_PRIO_INTERACTIVE = 0,      /* Telegram, WebSocket: a person is waiting */
+    MIMI_PRIO_SCHEDULED,            /* cron jobs */
+    MIMI_PRIO_BACKGROUND,           /* heartbeat: deferred while interactive work is pending */
+    MIMI_PRIO_COUNT,
+} mimi_prio_t;
+
 /* Message types on the bus */
 typedef struct {
     char channel[16];       /* "telegram", "websocket", "cli" */
     char chat_id[32];       /* Telegram chat_id or WS client id */
-    char *content;          /* Heap-allocated message text (caller must free) */
+    char *content;          /* Pooled payload (payload_pool.h): payload_release(), never free() */
+    int64_t enqueue_us;     /* esp_timer time of the inbound push, set by the bus */
+    int64_t origin_us;      /* outbound: enqueue_us of the message it answers (0 = status/unsolicited) */
+    uint8_t prio;           /* mimi_prio_t */
 } mimi_msg_t;
 
 /**
- * Initialize the message bus (inbound + outbound FreeRTOS queues).
+ * Initialize the message bus (inbound queues per priority class, their PSRAM
+ * spill rings) and its payload pool. Outbound queues belong to the channels
+ * (channel_registry.h).
  */
 esp_err_t message_bus_init(void);
 
 /**
- * Push a message to the inbound queue (towards Agent Loop).
- * The bus takes ownership of msg->content.
+ * Push a message to the inbound queue of its class (towards Agent Loop).
+ * A full queue overflows into the class's PSRAM spill ring; only when that
+ * is full too does the push wait up to a second and then fail.
+ * The bus takes over the caller's reference to msg->content; on failure
+ * the caller still holds it.
  */
 esp_err_t message_bus_push_inbound(const mimi_msg_t *msg);
 
 /**
- * Pop a message from the inbound queue (blocking).
- * Caller must free msg->content when done.
+ * Pop the next inbound message (blocking), choosing the class with
+ * prio_sched_pick(); background messages wait while interactive ones are
+ * queued. Within a class, order is FIFO.
+ * Caller must payload_release(msg->content) when done.
  */
 esp_err_t message_bus_pop_inbound(mimi_msg_t *msg, uint32_t timeout_ms);
 
 /**
- * Push a message to the outbound queue (towards channels).
- * The bus takes ownership of msg->content.
+ * Push a message to the outbound queue of its channel (channel_push()).
+ * The bus takes over the caller's reference to msg->content; on failure
+ * the caller still holds it.
  */
 esp_err_t message_bus_push_outbound(const mimi_msg_t *msg);
 
+/* Weighted round robin over the priority classes (MIMI_BUS_WEIGHT_*) */
+typedef struct {
+    int credit[MIMI_PRIO_COUNT];
+} prio_sched_t;
+
+/**
+ * Pick the class to serve next among those marked ready: the highest ready
+ * class with credit left, refilling credits once every ready class is out.
+ * With MIMI_BUS_STRICT_PRIO, simply the highest ready class.
+ * @return class, or -1 if none is ready
+ */
+int prio_sched_pick(prio_sched_t *s, const bool ready[MIMI_PRIO_COUNT]);
+
+const char *message_bus_prio_name(int prio);
+
+/* Latency histogram: <1 ms, <10 ms, <100 ms, <1 s, <10 s, <60 s, longer */
+#define BUS_HIST_BUCKETS  7
+
+typedef struct {
+    uint32_t count;
+    uint32_t bucket[BUS_HIST_BUCKETS];
+    int64_t total_us;
+    int64_t max_us;
+} bus_hist_t;
+
+/* Upper bound of bucket i in ms (the last bucket has none) */
+uint32_t bus_hist_bound_ms(int i);
+
+/* Record one sample; callers serialise access to h */
+void bus_hist_add(bus_hist_t *h, int64_t us);
+
+typedef struct {
+    int depth;                      /* queued now, including spilled */
+    int depth_max;
+    int capacity;                   /* queue + spill */
+    int spilled_now;                /* of which in the PSRAM spill ring */
+    uint32_t pushed;
+    uint32_t spilled;               /* pushes that overflowed into the spill ring */
+    uint32_t dropped;               /* pushes that failed: queue and spill full */
+    bus_hist_t wait;                /* time a push spent waiting for room */
+} bus_class_stats_t;
+
+/* Inbound traffic of one producer: priority class + channel (cron to Telegram = scheduled/telegram) */
+typedef struct {
+    uint8_t prio;
+    char channel[16];
+    uint32_t pushed;
+    uint32_t dropped;
+} bus_producer_stats_t;
+
+typedef struct {
+    bus_class_stats_t inbound[MIMI_PRIO_COUNT];
+    bus_producer_stats_t producers[MIMI_BUS_PRODUCERS_MAX];
+    int producer_count;
+    uint32_t outbound_unknown;      /* pushes to an unregistered channel */
+} bus_metrics_t;
+
+/* Inbound side; the outbound side is per channel, see channel_get_stats() */
+void message_bus_get_metrics(bus_metrics_t *out);
+
 /**
- * Pop a message from the outbound queue (blocking).
- * Caller must free msg->content when done.
+ * Inbound metrics plus every channel's outbound stats as one JSON document,
+ * as served on GET /metrics. Caller releases it with cJSON_free().
  */
-esp_err_t message_bus_pop_outbound(mimi_msg_t *msg, uint32_t timeout_ms);
+char *message_bus_metrics_json(void);
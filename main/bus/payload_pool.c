@@ -0,0 +1,253 @@
+#include "payload_pool.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+static const char *TAG = "payload";
+
+#define PAYLOAD_MAGIC   0x4D504C44u     /* "MPLD" */
+#define CLASS_HEAP      (-1)
+#define STRESS_MAX_PRODUCERS  8
+#define STRESS_MAX_LEN        3000
+
+/* Sits right in front of the text; 16 bytes keep the text 8-byte aligned */
+typedef struct {
+    uint32_t magic;
+    int32_t refs;
+    uint32_t len;
+    int16_t cls;                        /* slab class, CLASS_HEAP for fallbacks */
+    uint16_t block;                     /* index within the slab */
+} payload_hdr_t;
+
+typedef struct {
+    size_t size;                        /* text capacity including the NUL */
+    int count;
+    size_t stride;
+    uint8_t *base;
+    uint16_t *free_idx;                 /* stack of free block indexes */
+    int free_top;
+} payload_class_t;
+
+static payload_class_t s_classes[PAYLOAD_CLASSES] = {
+    { .size = MIMI_BUS_POOL_SMALL_SIZE,  .count = MIMI_BUS_POOL_SMALL_COUNT },
+    { .size = MIMI_BUS_POOL_MEDIUM_SIZE, .count = MIMI_BUS_POOL_MEDIUM_COUNT },
+    { .size = MIMI_BUS_POOL_LARGE_SIZE,  .count = MIMI_BUS_POOL_LARGE_COUNT },
+};
+static SemaphoreHandle_t s_lock;
+static payload_pool_stats_t s_stats;
+
+static payload_hdr_t *hdr_of(const char *p)
+{
+    return (payload_hdr_t *)(p - sizeof(payload_hdr_t));
+}
+
+esp_err_t payload_pool_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    size_t total = 0;
+    for (int c = 0; c < PAYLOAD_CLASSES; c++) {
+        payload_class_t *pc = &s_classes[c];
+        pc->stride = (sizeof(payload_hdr_t) + pc->size + 7) & ~(size_t)7;
+        pc->base = heap_caps_malloc(pc->stride * pc->count, MALLOC_CAP_SPIRAM);
+        pc->free_idx = heap_caps_malloc(sizeof(uint16_t) * pc->count, MALLOC_CAP_SPIRAM);
+        if (!pc->base || !pc->free_idx) {
+            ESP_LOGE(TAG, "Failed to allocate %u-byte payload slab", (unsigned)pc->size);
+            return ESP_ERR_NO_MEM;
+        }
+        for (int i = 0; i < pc->count; i++) pc->free_idx[i] = pc->count - 1 - i;
+        pc->free_top = pc->count;
+        total += pc->stride * pc->count;
+
+        s_stats.cls[c].size = pc->size;
+        s_stats.cls[c].count = pc->count;
+    }
+
+    ESP_LOGI(TAG, "Payload pool ready: %u/%u/%u-byte classes, %u bytes PSRAM",
+             (unsigned)s_classes[0].size, (unsigned)s_classes[1].size,
+             (unsigned)s_classes[2].size, (unsigned)total);
+    return ESP_OK;
+}
+
+/* ── Payloads ─────────────────────────────────────────────────── */
+
+char *payload_alloc(size_t len)
+{
+    payload_hdr_t *hdr = NULL;
+
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int c = 0; c < PAYLOAD_CLASSES && !hdr; c++) {
+            payload_class_t *pc = &s_classes[c];
+            if (len >= pc->size || pc->free_top == 0) continue;
+            uint16_t block = pc->free_idx[--pc->free_top];
+            hdr = (payload_hdr_t *)(pc->base + pc->stride * block);
+            hdr->cls = c;
+            hdr->block = block;
+            s_stats.allocs++;
+            int in_use = ++s_stats.cls[c].in_use;
+            if (in_use > s_stats.cls[c].high_water) s_stats.cls[c].high_water = in_use;
+        }
+        if (!hdr) s_stats.fallbacks++;
+        xSemaphoreGive(s_lock);
+    }
+
+    if (!hdr) {
+        hdr = heap_caps_malloc(sizeof(payload_hdr_t) + len + 1, MALLOC_CAP_SPIRAM);
+        if (!hdr) return NULL;
+        hdr->cls = CLASS_HEAP;
+        hdr->block = 0;
+    }
+
+    hdr->magic = PAYLOAD_MAGIC;
+    hdr->refs = 1;
+    hdr->len = len;
+    char *p = (char *)(hdr + 1);
+    p[0] = '\0';
+    p[len] = '\0';
+    return p;
+}
+
+char *payload_dup(const char *text)
+{
+    size_t len = strlen(text);
+    char *p = payload_alloc(len);
+    if (p) memcpy(p, text, len + 1);
+    return p;
+}
+
+char *payload_ref(char *p)
+{
+    if (!p) return NULL;
+    __atomic_fetch_add(&hdr_of(p)->refs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s_stats.refs, 1, __ATOMIC_RELAXED);
+    return p;
+}
+
+void payload_release(char *p)
+{
+    if (!p) return;
+    payload_hdr_t *hdr = hdr_of(p);
+    if (hdr->magic != PAYLOAD_MAGIC) {
+        ESP_LOGE(TAG, "Release of a non-payload pointer %p (double release?)", p);
+        return;
+    }
+    if (__atomic_sub_fetch(&hdr->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+    hdr->magic = 0;
+    if (hdr->cls == CLASS_HEAP) {
+        free(hdr);
+        __atomic_fetch_add(&s_stats.released, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    payload_class_t *pc = &s_classes[hdr->cls];
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    pc->free_idx[pc->free_top++] = hdr->block;
+    s_stats.cls[hdr->cls].in_use--;
+    s_stats.released++;
+    xSemaphoreGive(s_lock);
+}
+
+size_t payload_len(const char *p)
+{
+    return p ? hdr_of(p)->len : 0;
+}
+
+void payload_pool_get_stats(payload_pool_stats_t *out)
+{
+    if (!s_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
+
+/* ── Stress test ──────────────────────────────────────────────── */
+
+typedef struct {
+    int iterations;
+    bool use_pool;
+    const char *source;                 /* STRESS_MAX_LEN bytes of text */
+    SemaphoreHandle_t done;
+} stress_ctx_t;
+
+static void stress_task(void *arg)
+{
+    stress_ctx_t *ctx = (stress_ctx_t *)arg;
+    uint32_t seed = (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+
+    for (int i = 0; i < ctx->iterations; i++) {
+        /* Mostly short texts, like chat messages, with the odd long reply */
+        seed = seed * 1103515245u + 12345u;
+        size_t len = (seed >> 8) % 8 == 0 ? (seed >> 12) % STRESS_MAX_LEN : (seed >> 12) % 200;
+
+        if (ctx->use_pool) {
+            char *p = payload_alloc(len);
+            if (!p) continue;
+            memcpy(p, ctx->source, len);
+            char *second = payload_ref(p);
+            payload_release(p);
+            payload_release(second);
+        } else {
+            char *p = malloc(len + 1);
+            if (!p) continue;
+            memcpy(p, ctx->source, len);
+            p[len] = '\0';
+            char *second = strdup(p);
+            free(p);
+            free(second);
+        }
+    }
+
+    xSemaphoreGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t stress_run(stress_ctx_t *ctx, int producers, int64_t *elapsed_us)
+{
+    int64_t start_us = esp_timer_get_time();
+    int started = 0;
+    for (int i = 0; i < producers; i++) {
+        if (xTaskCreate(stress_task, "bus_stress", 3 * 1024, ctx, 2, NULL) == pdPASS) started++;
+    }
+    for (int i = 0; i < started; i++) xSemaphoreTake(ctx->done, portMAX_DELAY);
+    *elapsed_us = esp_timer_get_time() - start_us;
+    return started == producers ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t payload_pool_stress(int producers, int iterations, int64_t *pool_us, int64_t *malloc_us)
+{
+    if (producers < 1 || producers > STRESS_MAX_PRODUCERS || iterations < 1) return ESP_ERR_INVALID_ARG;
+
+    char *source = heap_caps_malloc(STRESS_MAX_LEN, MALLOC_CAP_SPIRAM);
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(producers, 0);
+    if (!source || !done) {
+        free(source);
+        if (done) vSemaphoreDelete(done);
+        return ESP_ERR_NO_MEM;
+    }
+    memset(source, 'x', STRESS_MAX_LEN);
+
+    stress_ctx_t ctx = { .iterations = iterations, .use_pool = true, .source = source, .done = done };
+    esp_err_t err = stress_run(&ctx, producers, pool_us);
+    if (err == ESP_OK) {
+        ctx.use_pool = false;
+        err = stress_run(&ctx, producers, malloc_us);
+    }
+
+    vSemaphoreDelete(done);
+    free(source);
+    return err;
+}
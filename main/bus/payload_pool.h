@@ -0,0 +1,77 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Refcounted message payloads (mimi_msg_t.content) carved from size-classed
+ * PSRAM slabs. A payload is a plain NUL-terminated char * to readers; it is
+ * written once by its producer and read-only after the first push. Every
+ * holder drops its reference with payload_release(); never free() one.
+ * Payloads larger than the biggest class, or allocated while a class is
+ * exhausted, come from the heap with the same header and are released the
+ * same way.
+ */
+
+#define PAYLOAD_CLASSES  3
+
+/**
+ * Carve the slabs (MIMI_BUS_POOL_*) from PSRAM.
+ */
+esp_err_t payload_pool_init(void);
+
+/**
+ * Writable payload of len bytes plus the terminating NUL (set to ""),
+ * with one reference.
+ * @return NULL if out of memory
+ */
+char *payload_alloc(size_t len);
+
+/**
+ * Payload holding a copy of text, with one reference.
+ */
+char *payload_dup(const char *text);
+
+/**
+ * Take another reference, e.g. to push the same text again or to several
+ * queues. No copy is made.
+ * @return p
+ */
+char *payload_ref(char *p);
+
+/**
+ * Drop one reference; the last one returns the block to its slab.
+ * NULL is ignored.
+ */
+void payload_release(char *p);
+
+/**
+ * Length of the text without strlen().
+ */
+size_t payload_len(const char *p);
+
+typedef struct {
+    uint32_t allocs;                        /* payloads served from a slab (heap mallocs avoided) */
+    uint32_t refs;                          /* extra references taken (copies avoided) */
+    uint32_t fallbacks;                     /* payloads that had to come from the heap */
+    uint32_t released;                      /* payloads whose last reference was dropped */
+    struct {
+        size_t size;                        /* capacity of a block */
+        int count;
+        int in_use;
+        int high_water;
+    } cls[PAYLOAD_CLASSES];
+} payload_pool_stats_t;
+
+void payload_pool_get_stats(payload_pool_stats_t *out);
+
+/**
+ * Stress test on the device: producers tasks each create iterations
+ * payloads of varying size, take a second reference (broadcast) and
+ * release both, then repeat with strdup + a second strdup + free.
+ * Blocks until every producer is done.
+ * @param pool_us    Wall time of the payload run
+ * @param malloc_us  Wall time of the strdup/free run
+ */
+esp_err_t payload_pool_stress(int producers, int iterations, int64_t *pool_us, int64_t *malloc_us);
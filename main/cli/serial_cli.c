@@ -3,9 +3,16 @@
 #include "wifi/wifi_manager.h"
 #include "telegram/telegram_bot.h"
 #include "llm/llm_proxy.h"
+#include "bus/message_bus.h"
+#include "bus/channel_registry.h"
 #include "memory/memory_store.h"
 #include "memory/session_mgr.h"
+#include "memory/session_compact.h"
 #include "proxy/http_proxy.h"
+#include "proxy/http_pool.h"
+#include "agent/agent_loop.h"
+#include "agent/context_builder.h"
+#include "agent/history_summary.h"
 #include "tools/tool_registry.h"
 #include "tools/tool_web_search.h"
 #include "cron/cron_service.h"
@@ -20,6 +27,7 @@
 #include "esp_console.h"
 #include "esp_system.h"
 #include "esp_heap_caps.h"
+#include "cJSON.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "argtable3/argtable3.h"
@@ -126,6 +134,39 @@ static int cmd_set_model_provider(int argc, char **argv)
     return 0;
 }
 
+/* --- set_llm_endpoint command --- */
+static struct {
+    struct arg_str *url;
+    struct arg_str *auth;
+    struct arg_int *max_tokens;
+    struct arg_end *end;
+} endpoint_args;
+
+static int cmd_set_llm_endpoint(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&endpoint_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, endpoint_args.end, argv[0]);
+        return 1;
+    }
+    const char *auth = endpoint_args.auth->count ? endpoint_args.auth->sval[0] : "";
+    int max_tokens = endpoint_args.max_tokens->count ? endpoint_args.max_tokens->ival[0] : 0;
+    if (llm_set_endpoint(endpoint_args.url->sval[0], auth, max_tokens) != ESP_OK) {
+        printf("Invalid endpoint. Usage: set_llm_endpoint http://192.168.1.50:8080/v1/chat/completions [--auth none]\n");
+        return 1;
+    }
+    printf("LLM endpoint set.\n");
+    return 0;
+}
+
+/* --- clear_llm_endpoint command --- */
+static int cmd_clear_llm_endpoint(int argc, char **argv)
+{
+    llm_clear_endpoint();
+    printf("LLM endpoint reset to provider default.\n");
+    return 0;
+}
+
 /* --- memory_read command --- */
 static int cmd_memory_read(int argc, char **argv)
 {
@@ -190,6 +231,25 @@ static int cmd_session_clear(int argc, char **argv)
     return 0;
 }
 
+/* --- session_export command --- */
+static struct {
+    struct arg_str *chat_id;
+    struct arg_end *end;
+} session_export_args;
+
+static int cmd_session_export(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&session_export_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, session_export_args.end, argv[0]);
+        return 1;
+    }
+    if (session_export(session_export_args.chat_id->sval[0]) != ESP_OK) {
+        printf("Session not found.\n");
+    }
+    return 0;
+}
+
 /* --- heap_info command --- */
 static int cmd_heap_info(int argc, char **argv)
 {
@@ -202,6 +262,23 @@ static int cmd_heap_info(int argc, char **argv)
     return 0;
 }
 
+/* --- net_stats command --- */
+static int cmd_net_stats(int argc, char **argv)
+{
+    http_pool_dump();
+
+    proxy_stats_t px;
+    http_proxy_get_stats(&px);
+    printf("Proxy tunnels: %u (avg %u ms), failed %u\n",
+           (unsigned)px.tunnels, px.tunnels ? (unsigned)(px.tunnel_ms_total / px.tunnels) : 0,
+           (unsigned)px.tunnel_failed);
+    printf("Proxy TLS: resumed %u (avg %u ms), full %u (avg %u ms), failed %u\n",
+           (unsigned)px.tls_resumed, px.tls_resumed ? (unsigned)(px.tls_resumed_ms_total / px.tls_resumed) : 0,
+           (unsigned)px.tls_full, px.tls_full ? (unsigned)(px.tls_full_ms_total / px.tls_full) : 0,
+           (unsigned)px.tls_failed);
+    return 0;
+}
+
 /* --- set_proxy command --- */
 static struct {
     struct arg_str *host;
@@ -229,6 +306,205 @@ static int cmd_clear_proxy(int argc, char **argv)
     return 0;
 }
 
+/* --- agent_stats command --- */
+static int cmd_agent_stats(int argc, char **argv)
+{
+    agent_loop_stats_t st;
+    agent_loop_get_stats(&st);
+    printf("Agent workers: %d (%d busy), pending %d (max %u)\n",
+           st.workers, st.busy_workers, st.pending, (unsigned)st.pending_max);
+    printf("Turns: %u (%u messages coalesced into earlier ones)\n",
+           (unsigned)st.turns, (unsigned)st.coalesced);
+    printf("Queue wait: avg %lld ms, max %lld ms\n",
+           st.turns ? (long long)(st.wait_ms_total / st.turns) : 0LL, (long long)st.wait_ms_max);
+    printf("Processing: avg %lld ms, max %lld ms\n",
+           st.turns ? (long long)(st.busy_ms_total / st.turns) : 0LL, (long long)st.busy_ms_max);
+    for (int c = 0; c < MIMI_PRIO_COUNT; c++) {
+        printf("  %-11s %u turns, wait avg %lld ms, max %lld ms\n", message_bus_prio_name(c),
+               (unsigned)st.cls[c].turns,
+               st.cls[c].turns ? (long long)(st.cls[c].wait_ms_total / st.cls[c].turns) : 0LL,
+               (long long)st.cls[c].wait_ms_max);
+    }
+    printf("Turn arena: last %u bytes, peak %u bytes, %u heap fallbacks\n",
+           (unsigned)st.arena_last, (unsigned)st.arena_peak, (unsigned)st.arena_fallbacks);
+    uint32_t cancelled = st.stopped + st.superseded;
+    printf("Cancelled: %u stopped, %u superseded, %u queued messages dropped; took avg %lld ms, max %lld ms\n",
+           (unsigned)st.stopped, (unsigned)st.superseded, (unsigned)st.stop_dropped,
+           cancelled ? (long long)(st.cancel_ms_total / cancelled) : 0LL, (long long)st.cancel_ms_max);
+    if (cancelled) {
+        printf("  spent %lld ms, %u tokens; cut %u LLM requests, %u tool calls; saved ~%lld ms\n",
+               (long long)st.cancel_busy_ms_total, (unsigned)st.cancel_tokens,
+               (unsigned)st.cancel_llm_aborted, (unsigned)st.cancel_tools, (long long)st.cancel_saved_ms);
+    }
+
+    history_summary_stats_t sum;
+    history_summary_get_stats(&sum);
+    printf("Summaries: %u (%u LLM, %u extractive), %u messages folded, avg %lld ms, max %lld ms\n",
+           (unsigned)sum.runs, (unsigned)sum.llm, (unsigned)sum.fallback, (unsigned)sum.folded,
+           sum.runs ? (long long)(sum.ms_total / sum.runs) : 0LL, (long long)sum.ms_max);
+    return 0;
+}
+
+/* --- stop command --- */
+static struct {
+    struct arg_str *chat_id;
+    struct arg_str *channel;
+    struct arg_end *end;
+} stop_args;
+
+static int cmd_stop(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&stop_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, stop_args.end, argv[0]);
+        return 1;
+    }
+    const char *chat_id = stop_args.chat_id->count > 0 ? stop_args.chat_id->sval[0] : NULL;
+    const char *channel = stop_args.channel->count > 0 ? stop_args.channel->sval[0] : NULL;
+    int dropped = 0;
+    int turns = agent_loop_stop(channel, chat_id, &dropped);
+    printf("Cancelled %d running turn(s), dropped %d queued message(s).\n", turns, dropped);
+    return 0;
+}
+
+/* --- prompt_stats command --- */
+static int cmd_prompt_stats(int argc, char **argv)
+{
+    context_dump();
+    return 0;
+}
+
+/* --- compact_stats command --- */
+static struct {
+    struct arg_lit *now;
+    struct arg_end *end;
+} compact_stats_args;
+
+static int cmd_compact_stats(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&compact_stats_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, compact_stats_args.end, argv[0]);
+        return 1;
+    }
+    session_compact_stats_t st;
+    session_compact_get_stats(&st);
+    printf("Sessions: %d logs, %u bytes (quota %u)\n",
+           st.chats, (unsigned)st.total_bytes, (unsigned)MIMI_SESSION_TOTAL_QUOTA);
+    printf("Passes: %u, logs compacted: %u, JSONL migrated: %u\n",
+           (unsigned)st.passes, (unsigned)st.compactions, (unsigned)st.migrations);
+    printf("Reclaimed: %llu bytes in %lld ms (last pass %lld ms)\n",
+           (unsigned long long)st.bytes_reclaimed, (long long)st.time_ms_total,
+           (long long)st.last_pass_ms);
+    if (compact_stats_args.now->count > 0) {
+        session_compact_kick();
+        printf("Compaction pass started.\n");
+    }
+    return 0;
+}
+
+/* --- bus_stats command --- */
+static struct {
+    struct arg_int *stress;
+    struct arg_int *iterations;
+    struct arg_lit *json;
+    struct arg_end *end;
+} bus_stats_args;
+
+static void print_hist(const char *label, const bus_hist_t *h)
+{
+    if (h->count == 0) return;
+    printf("    %-13s n=%u avg %lld ms, max %lld ms |", label, (unsigned)h->count,
+           (long long)(h->total_us / h->count / 1000), (long long)(h->max_us / 1000));
+    for (int i = 0; i < BUS_HIST_BUCKETS; i++) {
+        if (i < BUS_HIST_BUCKETS - 1) printf(" <%ums:%u", (unsigned)bus_hist_bound_ms(i), (unsigned)h->bucket[i]);
+        else printf(" more:%u", (unsigned)h->bucket[i]);
+    }
+    printf("\n");
+}
+
+static int cmd_bus_stats(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&bus_stats_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, bus_stats_args.end, argv[0]);
+        return 1;
+    }
+
+    if (bus_stats_args.json->count > 0) {
+        char *json = message_bus_metrics_json();
+        if (!json) {
+            printf("Out of memory\n");
+            return 1;
+        }
+        printf("%s\n", json);
+        cJSON_free(json);
+        return 0;
+    }
+
+    if (bus_stats_args.stress->count > 0) {
+        int producers = bus_stats_args.stress->ival[0];
+        int iterations = bus_stats_args.iterations->count > 0 ? bus_stats_args.iterations->ival[0] : 5000;
+        int64_t pool_us = 0, malloc_us = 0;
+        esp_err_t err = payload_pool_stress(producers, iterations, &pool_us, &malloc_us);
+        if (err != ESP_OK) {
+            printf("Stress run failed: %s\n", esp_err_to_name(err));
+            return 1;
+        }
+        long long ops = (long long)producers * iterations;
+        printf("%d producers x %d payloads (alloc + broadcast ref + 2 releases):\n", producers, iterations);
+        printf("  pool:   %lld ms, %lld ops/s\n", (long long)(pool_us / 1000),
+               pool_us ? ops * 1000000LL / pool_us : 0LL);
+        printf("  malloc: %lld ms, %lld ops/s (strdup copy instead of ref)\n", (long long)(malloc_us / 1000),
+               malloc_us ? ops * 1000000LL / malloc_us : 0LL);
+    }
+
+    payload_pool_stats_t st;
+    payload_pool_get_stats(&st);
+    printf("Payloads: %u from slabs, %u extra refs, %u heap fallbacks, %u released\n",
+           (unsigned)st.allocs, (unsigned)st.refs, (unsigned)st.fallbacks, (unsigned)st.released);
+    printf("Heap allocations avoided: %u\n", (unsigned)(st.allocs + st.refs));
+    for (int c = 0; c < PAYLOAD_CLASSES; c++) {
+        printf("  %5u B class: %d/%d in use, high-water %d\n",
+               (unsigned)st.cls[c].size, st.cls[c].in_use, st.cls[c].count, st.cls[c].high_water);
+    }
+
+    bus_metrics_t m;
+    message_bus_get_metrics(&m);
+    const bus_class_stats_t *in = m.inbound;
+    printf("Inbound (queue %d + spill %d per class, %s):\n", MIMI_BUS_QUEUE_LEN, MIMI_BUS_SPILL_LEN,
+           MIMI_BUS_STRICT_PRIO ? "strict priority" : "weighted");
+    for (int c = 0; c < MIMI_PRIO_COUNT; c++) {
+        printf("  %-11s queued %d/%d (%d spilled, max %d), pushed %u, spilled %u, dropped %u\n",
+               message_bus_prio_name(c), in[c].depth, in[c].capacity, in[c].spilled_now, in[c].depth_max,
+               (unsigned)in[c].pushed, (unsigned)in[c].spilled, (unsigned)in[c].dropped);
+        print_hist("enqueue wait", &in[c].wait);
+    }
+    printf("Producers:\n");
+    for (int i = 0; i < m.producer_count; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "%s/%s", message_bus_prio_name(m.producers[i].prio), m.producers[i].channel);
+        printf("  %-24s pushed %u, dropped %u\n", key,
+               (unsigned)m.producers[i].pushed, (unsigned)m.producers[i].dropped);
+    }
+
+    channel_stats_t ch[MIMI_CHANNEL_MAX];
+    int n = channel_get_stats(ch, MIMI_CHANNEL_MAX);
+    printf("Outbound channels:\n");
+    for (int i = 0; i < n; i++) {
+        uint32_t sends = ch[i].sent + ch[i].failed;
+        printf("  %-10s lanes %d, queued %d/%d (max %d), sent %u, failed %u, dropped %u, "
+               "send avg %lld ms, max %lld ms\n",
+               ch[i].name, ch[i].lanes, ch[i].depth, ch[i].capacity, ch[i].depth_max,
+               (unsigned)ch[i].sent, (unsigned)ch[i].failed, (unsigned)ch[i].dropped,
+               sends ? (long long)(ch[i].send_ms_total / sends) : 0LL, (long long)ch[i].send_ms_max);
+        print_hist("enqueue wait", &ch[i].wait);
+        print_hist("end-to-end", &ch[i].e2e);
+    }
+    if (m.outbound_unknown) printf("  %u replies to unregistered channels\n", (unsigned)m.outbound_unknown);
+    return 0;
+}
+
 /* --- set_search_key command --- */
 static struct {
     struct arg_str *key;
@@ -464,6 +740,9 @@ static int cmd_config_show(int argc, char **argv)
     print_config("API Key",    MIMI_NVS_LLM,    MIMI_NVS_KEY_API_KEY,  MIMI_SECRET_API_KEY,    true);
     print_config("Model",      MIMI_NVS_LLM,    MIMI_NVS_KEY_MODEL,    MIMI_SECRET_MODEL,      false);
     print_config("Provider",   MIMI_NVS_LLM,    MIMI_NVS_KEY_PROVIDER, MIMI_SECRET_MODEL_PROVIDER, false);
+    print_config("LLM URL",    MIMI_NVS_LLM,    MIMI_NVS_KEY_LLM_URL,  MIMI_SECRET_LLM_API_URL, false);
+    print_config("LLM Auth",   MIMI_NVS_LLM,    MIMI_NVS_KEY_LLM_AUTH, MIMI_SECRET_LLM_AUTH,   false);
+    print_config("Max Tokens", MIMI_NVS_LLM,    MIMI_NVS_KEY_LLM_MAX_TOKENS, MIMI_SECRET_LLM_MAX_TOKENS, false);
     print_config("Proxy Host", MIMI_NVS_PROXY,  MIMI_NVS_KEY_PROXY_HOST, MIMI_SECRET_PROXY_HOST, false);
     print_config("Proxy Port", MIMI_NVS_PROXY,  MIMI_NVS_KEY_PROXY_PORT, MIMI_SECRET_PROXY_PORT, false);
     print_config("Search Key", MIMI_NVS_SEARCH, MIMI_NVS_KEY_API_KEY,  MIMI_SECRET_SEARCH_KEY, true);
@@ -642,6 +921,28 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&provider_cmd);
 
+    /* set_llm_endpoint */
+    endpoint_args.url = arg_str1(NULL, NULL, "<url>", "Full request URL (http:// skips TLS)");
+    endpoint_args.auth = arg_str0(NULL, "auth", "<style>", "bearer|x-api-key|none (default: per provider)");
+    endpoint_args.max_tokens = arg_int0(NULL, "max-tokens", "<n>", "Completion token limit");
+    endpoint_args.end = arg_end(3);
+    esp_console_cmd_t endpoint_cmd = {
+        .command = "set_llm_endpoint",
+        .help = "Use a custom LLM endpoint, e.g. a LAN server "
+                "(set_llm_endpoint http://192.168.1.50:8080/v1/chat/completions --auth none)",
+        .func = &cmd_set_llm_endpoint,
+        .argtable = &endpoint_args,
+    };
+    esp_console_cmd_register(&endpoint_cmd);
+
+    /* clear_llm_endpoint */
+    esp_console_cmd_t clear_endpoint_cmd = {
+        .command = "clear_llm_endpoint",
+        .help = "Go back to the provider's default LLM endpoint",
+        .func = &cmd_clear_llm_endpoint,
+    };
+    esp_console_cmd_register(&clear_endpoint_cmd);
+
     /* skill_list */
     esp_console_cmd_t skill_list_cmd = {
         .command = "skill_list",
@@ -710,6 +1011,17 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&sess_clear_cmd);
 
+    /* session_export */
+    session_export_args.chat_id = arg_str1(NULL, NULL, "<chat_id>", "Chat ID to export");
+    session_export_args.end = arg_end(1);
+    esp_console_cmd_t sess_export_cmd = {
+        .command = "session_export",
+        .help = "Print a session as JSONL",
+        .func = &cmd_session_export,
+        .argtable = &session_export_args,
+    };
+    esp_console_cmd_register(&sess_export_cmd);
+
     /* heap_info */
     esp_console_cmd_t heap_cmd = {
         .command = "heap_info",
@@ -718,6 +1030,66 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&heap_cmd);
 
+    /* net_stats */
+    esp_console_cmd_t net_stats_cmd = {
+        .command = "net_stats",
+        .help = "Show HTTP connection pool state and reuse counters",
+        .func = &cmd_net_stats,
+    };
+    esp_console_cmd_register(&net_stats_cmd);
+
+    /* agent_stats */
+    esp_console_cmd_t agent_stats_cmd = {
+        .command = "agent_stats",
+        .help = "Show agent worker load (queue wait per priority class vs processing time) and history summaries",
+        .func = &cmd_agent_stats,
+    };
+    esp_console_cmd_register(&agent_stats_cmd);
+
+    /* stop */
+    stop_args.chat_id = arg_str0(NULL, NULL, "<chat_id>", "Chat to stop (default: all)");
+    stop_args.channel = arg_str0("c", "channel", "<channel>", "Only this channel (telegram, websocket, ...)");
+    stop_args.end = arg_end(2);
+    esp_console_cmd_t stop_cmd = {
+        .command = "stop",
+        .help = "Cancel running agent turns and drop queued messages, like /stop in a chat",
+        .func = &cmd_stop,
+        .argtable = &stop_args,
+    };
+    esp_console_cmd_register(&stop_cmd);
+
+    /* prompt_stats */
+    esp_console_cmd_t prompt_stats_cmd = {
+        .command = "prompt_stats",
+        .help = "Show cached system prompt sections and the last turn's token budget",
+        .func = &cmd_prompt_stats,
+    };
+    esp_console_cmd_register(&prompt_stats_cmd);
+
+    /* bus_stats */
+    bus_stats_args.stress = arg_int0(NULL, "stress", "<producers>", "Run the payload pool stress test (1-8 tasks)");
+    bus_stats_args.iterations = arg_int0(NULL, "iterations", "<n>", "Payloads per producer (default 5000)");
+    bus_stats_args.json = arg_lit0(NULL, "json", "Print the GET /metrics document instead");
+    bus_stats_args.end = arg_end(3);
+    esp_console_cmd_t bus_stats_cmd = {
+        .command = "bus_stats",
+        .help = "Show queue depths, enqueue waits, drops per producer and end-to-end latency",
+        .func = &cmd_bus_stats,
+        .argtable = &bus_stats_args,
+    };
+    esp_console_cmd_register(&bus_stats_cmd);
+
+    /* compact_stats */
+    compact_stats_args.now = arg_lit0(NULL, "now", "Start a compaction pass now");
+    compact_stats_args.end = arg_end(1);
+    esp_console_cmd_t compact_stats_cmd = {
+        .command = "compact_stats",
+        .help = "Show session compaction: bytes reclaimed, time spent",
+        .func = &cmd_compact_stats,
+        .argtable = &compact_stats_args,
+    };
+    esp_console_cmd_register(&compact_stats_cmd);
+
     /* set_search_key */
     search_key_args.key = arg_str1(NULL, NULL, "<key>", "Brave Search API key");
     search_key_args.end = arg_end(1);
@@ -218,14 +218,14 @@ static esp_err_t cron_save_jobs(void)
     FILE *f = fopen(MIMI_CRON_FILE, "w");
     if (!f) {
         ESP_LOGE(TAG, "Failed to open %s for writing", MIMI_CRON_FILE);
-        free(json_str);
+        cJSON_free(json_str);
         return ESP_FAIL;
     }
 
     size_t len = strlen(json_str);
     size_t written = fwrite(json_str, 1, len, f);
     fclose(f);
-    free(json_str);
+    cJSON_free(json_str);
 
     if (written != len) {
         ESP_LOGE(TAG, "Cron save incomplete: %d/%d bytes", (int)written, (int)len);
@@ -258,13 +258,14 @@ static void cron_process_due_jobs(void)
         memset(&msg, 0, sizeof(msg));
         strncpy(msg.channel, job->channel, sizeof(msg.channel) - 1);
         strncpy(msg.chat_id, job->chat_id, sizeof(msg.chat_id) - 1);
-        msg.content = strdup(job->message);
+        msg.content = payload_dup(job->message);
+        msg.prio = MIMI_PRIO_SCHEDULED;
 
         if (msg.content) {
             esp_err_t err = message_bus_push_inbound(&msg);
             if (err != ESP_OK) {
                 ESP_LOGW(TAG, "Failed to push cron message: %s", esp_err_to_name(err));
-                free(msg.content);
+                payload_release(msg.content);
             }
         }
 
@@ -130,9 +130,9 @@ static esp_err_t ws_handler(httpd_req_t *req)
         mimi_msg_t msg = {0};
         strncpy(msg.channel, MIMI_CHAN_WEBSOCKET, sizeof(msg.channel) - 1);
         strncpy(msg.chat_id, chat_id, sizeof(msg.chat_id) - 1);
-        msg.content = strdup(content->valuestring);
-        if (msg.content) {
-            message_bus_push_inbound(&msg);
+        msg.content = payload_dup(content->valuestring);
+        if (msg.content && message_bus_push_inbound(&msg) != ESP_OK) {
+            payload_release(msg.content);
         }
     }
 
@@ -140,6 +140,21 @@ static esp_err_t ws_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/* Plain HTTP GET on the gateway port: bus and channel metrics as JSON */
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    char *json = message_bus_metrics_json();
+    if (!json) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "out of memory");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    esp_err_t ret = httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+    cJSON_free(json);
+    return ret;
+}
+
 esp_err_t ws_server_start(void)
 {
     memset(s_clients, 0, sizeof(s_clients));
@@ -164,6 +179,13 @@ esp_err_t ws_server_start(void)
     };
     httpd_register_uri_handler(s_server, &ws_uri);
 
+    httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_handler,
+    };
+    httpd_register_uri_handler(s_server, &metrics_uri);
+
     ESP_LOGI(TAG, "WebSocket server started on port %d", MIMI_WS_PORT);
     return ESP_OK;
 }
@@ -196,7 +218,7 @@ esp_err_t ws_server_send(const char *chat_id, const char *text)
     };
 
     esp_err_t ret = httpd_ws_send_frame_async(s_server, client->fd, &ws_pkt);
-    free(json_str);
+    cJSON_free(json_str);
 
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "Failed to send to %s: %s", chat_id, esp_err_to_name(ret));
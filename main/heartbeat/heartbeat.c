@@ -73,6 +73,9 @@ static bool heartbeat_has_tasks(void)
 
 /* ── Send heartbeat to agent ──────────────────────────────────── */
 
+/* The prompt never changes: built once, every push takes a reference */
+static char *s_prompt;
+
 static bool heartbeat_send(void)
 {
     if (!heartbeat_has_tasks()) {
@@ -84,7 +87,9 @@ static bool heartbeat_send(void)
     memset(&msg, 0, sizeof(msg));
     strncpy(msg.channel, MIMI_CHAN_SYSTEM, sizeof(msg.channel) - 1);
     strncpy(msg.chat_id, "heartbeat", sizeof(msg.chat_id) - 1);
-    msg.content = strdup(HEARTBEAT_PROMPT);
+    if (!s_prompt) s_prompt = payload_dup(HEARTBEAT_PROMPT);
+    msg.content = payload_ref(s_prompt);
+    msg.prio = MIMI_PRIO_BACKGROUND;
 
     if (!msg.content) {
         ESP_LOGE(TAG, "Failed to allocate heartbeat prompt");
@@ -94,7 +99,7 @@ static bool heartbeat_send(void)
     esp_err_t err = message_bus_push_inbound(&msg);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to push heartbeat message: %s", esp_err_to_name(err));
-        free(msg.content);
+        payload_release(msg.content);
         return false;
     }
 
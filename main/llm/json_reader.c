@@ -0,0 +1,380 @@
+#include "json_reader.h"
+
+#include <string.h>
+#include "esp_log.h"
+
+static const char *TAG = "json_reader";
+
+enum {
+    S_VALUE,          /* expecting a value */
+    S_OBJ_FIRST,      /* after '{': key or '}' */
+    S_OBJ_KEY,        /* after ',' in an object: key */
+    S_COLON,
+    S_AFTER,          /* after a value: ',' or closing bracket */
+    S_ARR_FIRST,      /* after '[': value or ']' */
+    S_STRING,
+    S_ESC,
+    S_UESC,
+    S_NUMBER,
+    S_LITERAL,
+    S_DONE,
+};
+
+/* ── Helpers ──────────────────────────────────────────────────── */
+
+static bool is_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool in_object(const jr_t *r)
+{
+    return (r->is_obj >> r->depth) & 1u;
+}
+
+static esp_err_t emit(jr_t *r, jr_event_t ev, const char *data, size_t len)
+{
+    if (r->capture_depth >= 0) return ESP_OK;   /* inside a raw capture */
+    return r->cb(r, ev, data, len);
+}
+
+static esp_err_t fail(jr_t *r, char c)
+{
+    ESP_LOGW(TAG, "Unexpected '%c' (0x%02x) in state %d, depth %d",
+             (c >= 0x20 && c < 0x7f) ? c : '?', (unsigned char)c, r->state, r->depth);
+    return ESP_ERR_INVALID_RESPONSE;
+}
+
+static void value_done(jr_t *r)
+{
+    r->state = (r->depth == 0) ? S_DONE : S_AFTER;
+}
+
+static esp_err_t str_out(jr_t *r, const char *s, size_t n)
+{
+    if (r->in_key) {
+        size_t room = sizeof(r->key) - 1 - r->key_len;
+        size_t copy = n < room ? n : room;
+        memcpy(r->key + r->key_len, s, copy);
+        r->key_len += copy;
+        r->key[r->key_len] = '\0';
+        return ESP_OK;
+    }
+    return n ? emit(r, JR_STR_PART, s, n) : ESP_OK;
+}
+
+static esp_err_t utf8_out(jr_t *r, uint32_t cp)
+{
+    char u[4];
+    size_t n;
+    if (cp < 0x80) {
+        u[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        u[0] = (char)(0xC0 | (cp >> 6));
+        u[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        u[0] = (char)(0xE0 | (cp >> 12));
+        u[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        u[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        u[0] = (char)(0xF0 | (cp >> 18));
+        u[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        u[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        u[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    return str_out(r, u, n);
+}
+
+static esp_err_t finish_uesc(jr_t *r)
+{
+    uint32_t cp = r->uesc;
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        r->high_surrogate = cp;          /* low half follows as another \uXXXX */
+        return ESP_OK;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF && r->high_surrogate) {
+        cp = 0x10000 + ((r->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+    }
+    r->high_surrogate = 0;
+    return utf8_out(r, cp);
+}
+
+static esp_err_t open_container(jr_t *r, bool obj, size_t i, size_t *raw_start)
+{
+    if (r->depth + 1 >= JR_MAX_DEPTH) {
+        ESP_LOGW(TAG, "Nesting deeper than %d", JR_MAX_DEPTH);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    r->capture_req = false;
+    esp_err_t err = emit(r, obj ? JR_OBJ_BEGIN : JR_ARR_BEGIN, NULL, 0);
+    if (err != ESP_OK) return err;
+    if (r->capture_req && r->capture_depth < 0) {
+        r->capture_depth = r->depth;
+        *raw_start = i;
+    }
+    r->capture_req = false;
+
+    r->depth++;
+    if (obj) {
+        r->is_obj |= 1u << r->depth;
+    } else {
+        r->is_obj &= ~(1u << r->depth);
+        r->key[0] = '\0';
+        r->key_len = 0;
+    }
+    r->index[r->depth] = 0;
+    r->state = obj ? S_OBJ_FIRST : S_ARR_FIRST;
+    return ESP_OK;
+}
+
+static esp_err_t close_container(jr_t *r, bool obj, const char *data, size_t i, size_t *raw_start)
+{
+    if (r->depth == 0 || in_object(r) != obj) return fail(r, data[i]);
+    r->depth--;
+
+    if (r->capture_depth == r->depth) {
+        esp_err_t err = r->cb(r, JR_RAW, data + *raw_start, i + 1 - *raw_start);
+        r->capture_depth = -1;
+        if (err != ESP_OK) return err;
+    }
+    if (r->depth > 0 && !in_object(r)) {
+        r->key[0] = '\0';
+        r->key_len = 0;
+    }
+
+    value_done(r);
+    return emit(r, obj ? JR_OBJ_END : JR_ARR_END, NULL, 0);
+}
+
+static esp_err_t finish_token(jr_t *r)
+{
+    r->tok[r->tok_len] = '\0';
+    esp_err_t err;
+    if (r->state == S_NUMBER) {
+        err = emit(r, JR_NUMBER, r->tok, r->tok_len);
+    } else if (strcmp(r->tok, "true") == 0) {
+        err = emit(r, JR_TRUE, NULL, 0);
+    } else if (strcmp(r->tok, "false") == 0) {
+        err = emit(r, JR_FALSE, NULL, 0);
+    } else if (strcmp(r->tok, "null") == 0) {
+        err = emit(r, JR_NULL, NULL, 0);
+    } else {
+        ESP_LOGW(TAG, "Bad literal: %s", r->tok);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    value_done(r);
+    return err;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+void jr_init(jr_t *r, jr_cb_t cb, void *ctx)
+{
+    memset(r, 0, sizeof(*r));
+    r->cb = cb;
+    r->ctx = ctx;
+    r->state = S_VALUE;
+    r->capture_depth = -1;
+    r->err = ESP_OK;
+}
+
+void jr_capture(jr_t *r)
+{
+    r->capture_req = true;
+}
+
+bool jr_done(const jr_t *r)
+{
+    return r->state == S_DONE;
+}
+
+esp_err_t jr_feed(jr_t *r, const char *data, size_t len)
+{
+    size_t i = 0;
+    size_t raw_start = 0;
+    esp_err_t err = r->err;
+
+    while (err == ESP_OK && i < len) {
+        char c = data[i];
+
+        switch (r->state) {
+        case S_VALUE:
+            if (is_ws(c)) {
+                i++;
+            } else if (c == '{' || c == '[') {
+                err = open_container(r, c == '{', i, &raw_start);
+                i++;
+            } else if (c == '"') {
+                r->in_key = false;
+                r->state = S_STRING;
+                i++;
+            } else if (c == '-' || (c >= '0' && c <= '9')) {
+                r->tok_len = 0;
+                r->state = S_NUMBER;
+            } else if (c == 't' || c == 'f' || c == 'n') {
+                r->tok_len = 0;
+                r->state = S_LITERAL;
+            } else {
+                err = fail(r, c);
+            }
+            break;
+
+        case S_OBJ_FIRST:
+        case S_OBJ_KEY:
+            if (is_ws(c)) {
+                i++;
+            } else if (c == '"') {
+                r->in_key = true;
+                r->key_len = 0;
+                r->key[0] = '\0';
+                r->state = S_STRING;
+                i++;
+            } else if (c == '}' && r->state == S_OBJ_FIRST) {
+                err = close_container(r, true, data, i, &raw_start);
+                i++;
+            } else {
+                err = fail(r, c);
+            }
+            break;
+
+        case S_COLON:
+            if (is_ws(c)) {
+                i++;
+            } else if (c == ':') {
+                r->state = S_VALUE;
+                i++;
+            } else {
+                err = fail(r, c);
+            }
+            break;
+
+        case S_ARR_FIRST:
+            if (is_ws(c)) {
+                i++;
+            } else if (c == ']') {
+                err = close_container(r, false, data, i, &raw_start);
+                i++;
+            } else {
+                r->state = S_VALUE;
+            }
+            break;
+
+        case S_AFTER:
+            if (is_ws(c)) {
+                i++;
+            } else if (c == ',') {
+                if (in_object(r)) {
+                    r->state = S_OBJ_KEY;
+                } else {
+                    r->index[r->depth]++;
+                    r->state = S_VALUE;
+                }
+                i++;
+            } else if (c == '}' || c == ']') {
+                err = close_container(r, c == '}', data, i, &raw_start);
+                i++;
+            } else {
+                err = fail(r, c);
+            }
+            break;
+
+        case S_STRING: {
+            /* Plain runs are passed through without copying */
+            size_t start = i;
+            while (i < len && data[i] != '"' && data[i] != '\\') i++;
+            if (i > start) err = str_out(r, data + start, i - start);
+            if (err != ESP_OK || i == len) break;
+
+            if (data[i] == '\\') {
+                r->state = S_ESC;
+            } else if (r->in_key) {
+                r->in_key = false;
+                r->state = S_COLON;
+            } else {
+                value_done(r);
+                err = emit(r, JR_STR_END, NULL, 0);
+            }
+            i++;
+            break;
+        }
+
+        case S_ESC: {
+            char out = 0;
+            switch (c) {
+            case '"':  out = '"'; break;
+            case '\\': out = '\\'; break;
+            case '/':  out = '/'; break;
+            case 'b':  out = '\b'; break;
+            case 'f':  out = '\f'; break;
+            case 'n':  out = '\n'; break;
+            case 'r':  out = '\r'; break;
+            case 't':  out = '\t'; break;
+            case 'u':
+                r->uesc = 0;
+                r->uesc_digits = 0;
+                r->state = S_UESC;
+                break;
+            default:
+                err = fail(r, c);
+                break;
+            }
+            if (out) {
+                err = str_out(r, &out, 1);
+                r->state = S_STRING;
+            }
+            i++;
+            break;
+        }
+
+        case S_UESC: {
+            int v;
+            if (c >= '0' && c <= '9') v = c - '0';
+            else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+            else {
+                err = fail(r, c);
+                break;
+            }
+            r->uesc = (r->uesc << 4) | (uint32_t)v;
+            if (++r->uesc_digits == 4) {
+                err = finish_uesc(r);
+                r->state = S_STRING;
+            }
+            i++;
+            break;
+        }
+
+        case S_NUMBER:
+        case S_LITERAL: {
+            bool part = (r->state == S_NUMBER)
+                ? ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')
+                : (c >= 'a' && c <= 'z');
+            if (!part) {
+                err = finish_token(r);   /* c is re-examined in the next state */
+                break;
+            }
+            if (r->tok_len < sizeof(r->tok) - 1) r->tok[r->tok_len++] = c;
+            i++;
+            break;
+        }
+
+        case S_DONE:
+        default:
+            i = len;   /* trailing bytes after the document are ignored */
+            break;
+        }
+    }
+
+    /* Pass the captured span of this chunk through */
+    if (err == ESP_OK && r->capture_depth >= 0 && raw_start < len) {
+        err = r->cb(r, JR_RAW, data + raw_start, len - raw_start);
+    }
+
+    r->err = err;
+    return err;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ── Incremental (SAX-style) JSON tokenizer ───────────────────── */
+
+#define JR_MAX_DEPTH  32
+#define JR_KEY_SIZE   64
+
+typedef enum {
+    JR_OBJ_BEGIN,
+    JR_OBJ_END,
+    JR_ARR_BEGIN,
+    JR_ARR_END,
+    JR_STR_PART,        /* decoded string bytes; a string may arrive in several parts */
+    JR_STR_END,         /* end of the current string value (data empty) */
+    JR_NUMBER,          /* number literal text */
+    JR_TRUE,
+    JR_FALSE,
+    JR_NULL,
+    JR_RAW,             /* verbatim bytes of a captured container, see jr_capture() */
+} jr_event_t;
+
+typedef struct jr jr_t;
+
+/**
+ * Event callback. For every event, r->depth is the number of containers
+ * enclosing the value, r->key is its member name (empty inside arrays) and
+ * r->index its position inside an array. Returning an error stops the reader.
+ */
+typedef esp_err_t (*jr_cb_t)(jr_t *r, jr_event_t ev, const char *data, size_t len);
+
+struct jr {
+    jr_cb_t cb;
+    void *ctx;
+
+    int state;
+    int depth;
+    uint32_t is_obj;                 /* bit per depth: container is an object */
+    uint16_t index[JR_MAX_DEPTH];    /* element index per array depth */
+    char key[JR_KEY_SIZE];
+    size_t key_len;
+    bool in_key;
+
+    char tok[32];                    /* number / literal being read */
+    size_t tok_len;
+    uint32_t uesc;                   /* \uXXXX accumulator */
+    int uesc_digits;
+    uint32_t high_surrogate;
+
+    int capture_depth;               /* >= 0 while a container is passed through as JR_RAW */
+    bool capture_req;
+
+    esp_err_t err;
+};
+
+/** Reset the reader for a new document. */
+void jr_init(jr_t *r, jr_cb_t cb, void *ctx);
+
+/**
+ * Called from a JR_OBJ_BEGIN / JR_ARR_BEGIN callback: deliver the whole
+ * container (including its brackets) as JR_RAW spans instead of events.
+ * The matching JR_OBJ_END / JR_ARR_END is still reported.
+ */
+void jr_capture(jr_t *r);
+
+/** Feed body bytes (any fragmentation). Returns the first error. */
+esp_err_t jr_feed(jr_t *r, const char *data, size_t len);
+
+/** True once the top-level value is complete. */
+bool jr_done(const jr_t *r);
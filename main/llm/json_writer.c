@@ -0,0 +1,293 @@
+#include "json_writer.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+/* ── Output layer ─────────────────────────────────────────────── */
+
+static void flush(jw_t *w)
+{
+    if (w->len && w->err == ESP_OK) {
+        w->err = w->sink(w->buf, w->len, w->ctx);
+    }
+    w->len = 0;
+}
+
+static void put_raw(jw_t *w, const char *s, size_t n)
+{
+    w->total += n;
+    if (w->err != ESP_OK) return;
+
+    while (n > 0) {
+        size_t room = JW_BUF_SIZE - w->len;
+        if (room == 0) {
+            flush(w);
+            if (w->err != ESP_OK) return;
+            continue;
+        }
+        size_t take = n < room ? n : room;
+        memcpy(w->buf + w->len, s, take);
+        w->len += take;
+        s += take;
+        n -= take;
+    }
+}
+
+/*
+ * Emit bytes with `level` rounds of JSON string escaping. Level 0 is raw;
+ * level 1 escapes string content; level 2 is used when a whole document is
+ * embedded as a string value (jw_cjson_as_str).
+ */
+static void emit(jw_t *w, const char *s, size_t n, int level)
+{
+    if (level <= 0) {
+        put_raw(w, s, n);
+        return;
+    }
+
+    size_t run = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+        const char *esc = NULL;
+        char ubuf[8];
+
+        switch (c) {
+        case '"':  esc = "\\\""; break;
+        case '\\': esc = "\\\\"; break;
+        case '\b': esc = "\\b"; break;
+        case '\f': esc = "\\f"; break;
+        case '\n': esc = "\\n"; break;
+        case '\r': esc = "\\r"; break;
+        case '\t': esc = "\\t"; break;
+        default:
+            if (c < 0x20) {
+                snprintf(ubuf, sizeof(ubuf), "\\u%04x", c);
+                esc = ubuf;
+            }
+            break;
+        }
+        if (!esc) {
+            run++;
+            continue;
+        }
+        if (run) emit(w, s + i - run, run, level - 1);
+        run = 0;
+        emit(w, esc, strlen(esc), level - 1);
+    }
+    if (run) emit(w, s + n - run, run, level - 1);
+}
+
+static void put(jw_t *w, const char *s, size_t n)
+{
+    emit(w, s, n, w->escape);
+}
+
+static void put_str_body(jw_t *w, const char *s, size_t n)
+{
+    emit(w, s, n, w->escape + 1);
+}
+
+/* ── Structure ────────────────────────────────────────────────── */
+
+static bool is_first(jw_t *w)
+{
+    return (w->first >> w->depth) & 1u;
+}
+
+static void value_prefix(jw_t *w)
+{
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    if (w->depth > 0) {
+        if (!is_first(w)) put(w, ",", 1);
+        w->first &= ~(1u << w->depth);
+    }
+}
+
+static void open_container(jw_t *w, char c)
+{
+    value_prefix(w);
+    put(w, &c, 1);
+    if (w->depth + 1 >= JW_MAX_DEPTH) {
+        w->err = ESP_ERR_INVALID_SIZE;
+        return;
+    }
+    w->depth++;
+    w->first |= 1u << w->depth;
+}
+
+static void close_container(jw_t *w, char c)
+{
+    if (w->depth > 0) w->depth--;
+    put(w, &c, 1);
+}
+
+void jw_init(jw_t *w, jw_sink_t sink, void *ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->sink = sink;
+    w->ctx = ctx;
+    w->err = ESP_OK;
+}
+
+void jw_obj_begin(jw_t *w) { open_container(w, '{'); }
+void jw_obj_end(jw_t *w)   { close_container(w, '}'); }
+void jw_arr_begin(jw_t *w) { open_container(w, '['); }
+void jw_arr_end(jw_t *w)   { close_container(w, ']'); }
+
+void jw_key(jw_t *w, const char *key)
+{
+    if (!is_first(w)) put(w, ",", 1);
+    w->first &= ~(1u << w->depth);
+    put(w, "\"", 1);
+    put_str_body(w, key, strlen(key));
+    put(w, "\":", 2);
+    w->after_key = true;
+}
+
+/* ── Scalars ──────────────────────────────────────────────────── */
+
+void jw_str_begin(jw_t *w)
+{
+    value_prefix(w);
+    put(w, "\"", 1);
+}
+
+void jw_str_part(jw_t *w, const char *s, size_t len)
+{
+    put_str_body(w, s, len);
+}
+
+void jw_str_end(jw_t *w)
+{
+    put(w, "\"", 1);
+}
+
+void jw_str(jw_t *w, const char *s)
+{
+    if (!s) {
+        value_prefix(w);
+        put(w, "null", 4);
+        return;
+    }
+    jw_str_begin(w);
+    put_str_body(w, s, strlen(s));
+    jw_str_end(w);
+}
+
+void jw_int(jw_t *w, long long v)
+{
+    char num[24];
+    int n = snprintf(num, sizeof(num), "%lld", v);
+    value_prefix(w);
+    put(w, num, n);
+}
+
+void jw_bool(jw_t *w, bool v)
+{
+    value_prefix(w);
+    if (v) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void jw_raw(jw_t *w, const char *json, size_t len)
+{
+    value_prefix(w);
+    put(w, json, len);
+}
+
+/* Same number formatting rules as cJSON_PrintUnformatted */
+static void put_number(jw_t *w, const cJSON *item)
+{
+    double d = item->valuedouble;
+    char num[32];
+    int n;
+
+    if (isnan(d) || isinf(d)) {
+        n = snprintf(num, sizeof(num), "null");
+    } else if (d == (double)item->valueint) {
+        n = snprintf(num, sizeof(num), "%d", item->valueint);
+    } else {
+        n = snprintf(num, sizeof(num), "%1.15g", d);
+        double back = 0;
+        if (sscanf(num, "%lg", &back) != 1 || back != d) {
+            n = snprintf(num, sizeof(num), "%1.17g", d);
+        }
+    }
+    put(w, num, n);
+}
+
+void jw_cjson(jw_t *w, const cJSON *item)
+{
+    if (!item || w->err != ESP_OK) return;
+
+    switch (item->type & 0xFF) {
+    case cJSON_NULL:
+        value_prefix(w);
+        put(w, "null", 4);
+        break;
+    case cJSON_False:
+        jw_bool(w, false);
+        break;
+    case cJSON_True:
+        jw_bool(w, true);
+        break;
+    case cJSON_Number:
+        value_prefix(w);
+        put_number(w, item);
+        break;
+    case cJSON_String:
+        jw_str(w, item->valuestring ? item->valuestring : "");
+        break;
+    case cJSON_Raw:
+        if (item->valuestring) jw_raw(w, item->valuestring, strlen(item->valuestring));
+        break;
+    case cJSON_Array: {
+        jw_arr_begin(w);
+        for (const cJSON *c = item->child; c; c = c->next) jw_cjson(w, c);
+        jw_arr_end(w);
+        break;
+    }
+    case cJSON_Object: {
+        jw_obj_begin(w);
+        for (const cJSON *c = item->child; c; c = c->next) {
+            jw_key(w, c->string ? c->string : "");
+            jw_cjson(w, c);
+        }
+        jw_obj_end(w);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void jw_cjson_as_str(jw_t *w, const cJSON *item)
+{
+    jw_str_begin(w);
+
+    /* Serialize as a standalone document one escaping level deeper */
+    int depth = w->depth;
+    uint32_t first = w->first;
+    w->escape++;
+    w->depth = 0;
+    w->after_key = false;
+    jw_cjson(w, item);
+    w->escape--;
+    w->depth = depth;
+    w->first = first;
+
+    jw_str_end(w);
+}
+
+esp_err_t jw_finish(jw_t *w)
+{
+    flush(w);
+    return w->err;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ── Streaming JSON writer ────────────────────────────────────── */
+
+#define JW_BUF_SIZE   1024
+#define JW_MAX_DEPTH  32
+
+/** Output sink. Receives the document in order; returning an error stops the writer. */
+typedef esp_err_t (*jw_sink_t)(const char *data, size_t len, void *ctx);
+
+typedef struct {
+    jw_sink_t sink;
+    void *ctx;
+    char buf[JW_BUF_SIZE];
+    size_t len;
+    size_t total;                /* bytes emitted so far, including buffered */
+    uint32_t first;              /* bit per depth: next member is the first */
+    int depth;
+    bool after_key;
+    int escape;                  /* >0 while a nested document is written as a string value */
+    esp_err_t err;
+} jw_t;
+
+/** Start a document written through sink (required). */
+void jw_init(jw_t *w, jw_sink_t sink, void *ctx);
+
+void jw_obj_begin(jw_t *w);
+void jw_obj_end(jw_t *w);
+void jw_arr_begin(jw_t *w);
+void jw_arr_end(jw_t *w);
+void jw_key(jw_t *w, const char *key);
+
+void jw_str(jw_t *w, const char *s);                     /* NULL writes null */
+void jw_int(jw_t *w, long long v);
+void jw_bool(jw_t *w, bool v);
+
+/* A string value assembled from several pieces */
+void jw_str_begin(jw_t *w);
+void jw_str_part(jw_t *w, const char *s, size_t len);
+void jw_str_end(jw_t *w);
+
+/** Copy an already-serialized JSON value verbatim. */
+void jw_raw(jw_t *w, const char *json, size_t len);
+
+/** Serialize a cJSON subtree in place (no intermediate print buffer). */
+void jw_cjson(jw_t *w, const cJSON *item);
+
+/** Serialize a cJSON subtree as a JSON-encoded string value (e.g. OpenAI "arguments"). */
+void jw_cjson_as_str(jw_t *w, const cJSON *item);
+
+/** Flush buffered output. Returns the first error seen. */
+esp_err_t jw_finish(jw_t *w);
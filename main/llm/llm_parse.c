@@ -0,0 +1,295 @@
+#include "llm_parse.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "llm_parse";
+
+#define PARSE_GROW_MIN 256
+
+/* Container roles; only the paths that feed llm_response_t are tracked */
+enum {
+    R_OTHER = 0,
+    R_ROOT,
+    R_CONTENT,          /* Anthropic: root.content[] */
+    R_BLOCK,            /* Anthropic: content block */
+    R_INPUT,            /* Anthropic: tool_use input (captured raw) */
+    R_CHOICES,          /* OpenAI: root.choices[] */
+    R_CHOICE,           /* OpenAI: choices[0] */
+    R_MESSAGE,          /* OpenAI: choices[0].message */
+    R_TOOL_CALLS,       /* OpenAI: message.tool_calls[] */
+    R_TOOL_CALL,
+    R_FUNCTION,
+    R_USAGE,            /* root.usage (both formats) */
+    R_USAGE_DETAILS,    /* OpenAI: usage.prompt_tokens_details */
+};
+
+/* ── Output helpers (PSRAM) ───────────────────────────────────── */
+
+static esp_err_t str_append(char **dst, size_t *len, size_t *cap, const char *src, size_t n)
+{
+    if (n == 0) return ESP_OK;
+    if (*len + n + 1 > *cap) {
+        size_t new_cap = *cap ? *cap : PARSE_GROW_MIN;
+        while (*len + n + 1 > new_cap) new_cap *= 2;
+        char *tmp = heap_caps_realloc(*dst, new_cap, MALLOC_CAP_SPIRAM);
+        if (!tmp) return ESP_ERR_NO_MEM;
+        *dst = tmp;
+        *cap = new_cap;
+    }
+    memcpy(*dst + *len, src, n);
+    *len += n;
+    (*dst)[*len] = '\0';
+    return ESP_OK;
+}
+
+static void fixed_append(char *dst, size_t size, const char *src, size_t n)
+{
+    size_t len = strlen(dst);
+    size_t room = size - 1 - len;
+    size_t copy = n < room ? n : room;
+    memcpy(dst + len, src, copy);
+    dst[len + copy] = '\0';
+}
+
+static esp_err_t emit_input(llm_parse_t *p, const char *json, size_t n)
+{
+    if (p->pending < 0) return ESP_OK;
+    llm_tool_call_t *call = &p->resp->calls[p->pending];
+    return str_append(&call->input, &call->input_len, &p->input_cap[p->pending], json, n);
+}
+
+/* ── Tool call slots ──────────────────────────────────────────── */
+
+static void block_open(llm_parse_t *p, bool is_tool)
+{
+    llm_response_t *resp = p->resp;
+    p->pending_tool = is_tool;
+    p->pending = -1;
+    if (resp->call_count < MIMI_MAX_TOOL_CALLS) {
+        p->pending = resp->call_count;
+    }
+}
+
+static esp_err_t block_close(llm_parse_t *p)
+{
+    llm_response_t *resp = p->resp;
+    int slot = p->pending;
+    p->pending = -1;
+    if (slot < 0) {
+        if (p->pending_tool) ESP_LOGW(TAG, "Dropping tool call: limit %d reached", MIMI_MAX_TOOL_CALLS);
+        return ESP_OK;
+    }
+
+    llm_tool_call_t *call = &resp->calls[slot];
+    if (!p->pending_tool) {
+        /* Not a tool_use block after all: release anything written to the slot */
+        free(call->input);
+        memset(call, 0, sizeof(*call));
+        p->input_cap[slot] = 0;
+        return ESP_OK;
+    }
+
+    resp->call_count++;
+    if (!call->input) {
+        p->pending = slot;
+        esp_err_t err = emit_input(p, "{}", 2);
+        p->pending = -1;
+        return err;
+    }
+    return ESP_OK;
+}
+
+/* ── Event handling ───────────────────────────────────────────── */
+
+static int role_for(llm_parse_t *p, int parent, const jr_t *r, bool obj)
+{
+    const char *key = r->key;
+
+    if (r->depth == 0) return obj ? R_ROOT : R_OTHER;
+
+    if (p->format == LLM_STREAM_FMT_OPENAI) {
+        switch (parent) {
+        case R_ROOT:
+            if (obj && strcmp(key, "usage") == 0) return R_USAGE;
+            return (!obj && strcmp(key, "choices") == 0) ? R_CHOICES : R_OTHER;
+        case R_USAGE:      return (obj && strcmp(key, "prompt_tokens_details") == 0) ? R_USAGE_DETAILS : R_OTHER;
+        case R_CHOICES:    return (obj && r->index[r->depth] == 0) ? R_CHOICE : R_OTHER;
+        case R_CHOICE:     return (obj && strcmp(key, "message") == 0) ? R_MESSAGE : R_OTHER;
+        case R_MESSAGE:    return (!obj && strcmp(key, "tool_calls") == 0) ? R_TOOL_CALLS : R_OTHER;
+        case R_TOOL_CALLS: return obj ? R_TOOL_CALL : R_OTHER;
+        case R_TOOL_CALL:  return (obj && strcmp(key, "function") == 0) ? R_FUNCTION : R_OTHER;
+        default:           return R_OTHER;
+        }
+    }
+
+    switch (parent) {
+    case R_ROOT:
+        if (obj && strcmp(key, "usage") == 0) return R_USAGE;
+        return (!obj && strcmp(key, "content") == 0) ? R_CONTENT : R_OTHER;
+    case R_CONTENT: return obj ? R_BLOCK : R_OTHER;
+    case R_BLOCK:   return strcmp(key, "input") == 0 ? R_INPUT : R_OTHER;
+    default:        return R_OTHER;
+    }
+}
+
+static esp_err_t on_string_part(llm_parse_t *p, int parent, const char *key,
+                                const char *data, size_t len)
+{
+    llm_response_t *resp = p->resp;
+    llm_tool_call_t *call = p->pending >= 0 ? &resp->calls[p->pending] : NULL;
+
+    switch (parent) {
+    case R_ROOT:
+    case R_CHOICE:
+        if (strcmp(key, "stop_reason") == 0 || strcmp(key, "finish_reason") == 0) break;
+        return ESP_OK;
+    case R_BLOCK:
+        if (strcmp(key, "type") == 0) break;
+        if (strcmp(key, "text") == 0) {
+            return str_append(&resp->text, &resp->text_len, &p->text_cap, data, len);
+        }
+        if (call && strcmp(key, "id") == 0) fixed_append(call->id, sizeof(call->id), data, len);
+        if (call && strcmp(key, "name") == 0) fixed_append(call->name, sizeof(call->name), data, len);
+        return ESP_OK;
+    case R_MESSAGE:
+        if (strcmp(key, "content") == 0) {
+            return str_append(&resp->text, &resp->text_len, &p->text_cap, data, len);
+        }
+        return ESP_OK;
+    case R_TOOL_CALL:
+        if (call && strcmp(key, "id") == 0) fixed_append(call->id, sizeof(call->id), data, len);
+        return ESP_OK;
+    case R_FUNCTION:
+        if (call && strcmp(key, "name") == 0) fixed_append(call->name, sizeof(call->name), data, len);
+        /* OpenAI arguments are a JSON document encoded as a string: decoded bytes are the input */
+        if (strcmp(key, "arguments") == 0) return emit_input(p, data, len);
+        return ESP_OK;
+    default:
+        return ESP_OK;
+    }
+
+    /* Short enum-like values are collected and handled at JR_STR_END */
+    size_t room = sizeof(p->scratch) - 1 - p->scratch_len;
+    size_t copy = len < room ? len : room;
+    memcpy(p->scratch + p->scratch_len, data, copy);
+    p->scratch_len += copy;
+    p->scratch[p->scratch_len] = '\0';
+    return ESP_OK;
+}
+
+static void on_string_end(llm_parse_t *p, int parent, const char *key)
+{
+    if (p->scratch_len == 0) return;
+
+    if (parent == R_ROOT && strcmp(key, "stop_reason") == 0) {
+        p->resp->tool_use = (strcmp(p->scratch, "tool_use") == 0);
+    } else if (parent == R_CHOICE && strcmp(key, "finish_reason") == 0) {
+        p->resp->tool_use = (strcmp(p->scratch, "tool_calls") == 0);
+    } else if (parent == R_BLOCK && strcmp(key, "type") == 0) {
+        p->pending_tool = (strcmp(p->scratch, "tool_use") == 0);
+    }
+    p->scratch_len = 0;
+    p->scratch[0] = '\0';
+}
+
+static void on_number(llm_parse_t *p, int parent, const char *key, const char *num)
+{
+    llm_usage_t *u = &p->resp->usage;
+    uint32_t v = (uint32_t)strtoul(num, NULL, 10);
+
+    if (parent == R_USAGE) {
+        if (strcmp(key, "input_tokens") == 0 || strcmp(key, "prompt_tokens") == 0) {
+            u->input_tokens = v;
+        } else if (strcmp(key, "output_tokens") == 0 || strcmp(key, "completion_tokens") == 0) {
+            u->output_tokens = v;
+        } else if (strcmp(key, "cache_read_input_tokens") == 0) {
+            u->cache_read_tokens = v;
+        } else if (strcmp(key, "cache_creation_input_tokens") == 0) {
+            u->cache_creation_tokens = v;
+        }
+    } else if (parent == R_USAGE_DETAILS && strcmp(key, "cached_tokens") == 0) {
+        u->cache_read_tokens = v;
+    }
+}
+
+static esp_err_t on_event(jr_t *r, jr_event_t ev, const char *data, size_t len)
+{
+    llm_parse_t *p = (llm_parse_t *)r->ctx;
+    int parent = r->depth > 0 ? p->role[r->depth - 1] : R_OTHER;
+
+    switch (ev) {
+    case JR_OBJ_BEGIN:
+    case JR_ARR_BEGIN: {
+        int role = role_for(p, parent, r, ev == JR_OBJ_BEGIN);
+        p->role[r->depth] = (uint8_t)role;
+        if (role == R_BLOCK) block_open(p, false);      /* type decides later */
+        if (role == R_TOOL_CALL) block_open(p, true);
+        if (role == R_INPUT) jr_capture(r);
+        return ESP_OK;
+    }
+
+    case JR_OBJ_END:
+    case JR_ARR_END: {
+        int role = p->role[r->depth];
+        p->role[r->depth] = R_OTHER;
+        if (role == R_BLOCK || role == R_TOOL_CALL) return block_close(p);
+        return ESP_OK;
+    }
+
+    case JR_RAW:
+        /* Only tool_use input is captured: its bytes are already valid JSON */
+        return emit_input(p, data, len);
+
+    case JR_STR_PART:
+        return on_string_part(p, parent, r->key, data, len);
+
+    case JR_STR_END:
+        on_string_end(p, parent, r->key);
+        return ESP_OK;
+
+    case JR_NUMBER:
+        on_number(p, parent, r->key, data);
+        return ESP_OK;
+
+    default:
+        return ESP_OK;
+    }
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+void llm_parse_init(llm_parse_t *p, llm_stream_format_t format, llm_response_t *resp)
+{
+    memset(p, 0, sizeof(*p));
+    p->format = format;
+    p->resp = resp;
+    p->pending = -1;
+    memset(resp, 0, sizeof(*resp));
+    jr_init(&p->reader, on_event, p);
+}
+
+esp_err_t llm_parse_feed(llm_parse_t *p, const char *data, size_t len)
+{
+    return jr_feed(&p->reader, data, len);
+}
+
+esp_err_t llm_parse_finish(llm_parse_t *p)
+{
+    if (p->reader.err != ESP_OK) return p->reader.err;
+    if (!jr_done(&p->reader)) {
+        ESP_LOGW(TAG, "Response body ended mid-document");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    llm_response_t *resp = p->resp;
+    if (p->format == LLM_STREAM_FMT_OPENAI) {
+        if (resp->call_count > 0) resp->tool_use = true;
+        /* prompt_tokens includes the cached part; Anthropic reports them separately */
+        if (resp->usage.input_tokens >= resp->usage.cache_read_tokens) {
+            resp->usage.input_tokens -= resp->usage.cache_read_tokens;
+        }
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "mimi_config.h"
+#include "llm/llm_proxy.h"
+#include "llm/llm_stream.h"
+#include "llm/json_reader.h"
+
+/* ── One-pass parser for non-streaming LLM responses ──────────── */
+
+typedef struct {
+    llm_stream_format_t format;
+    llm_response_t *resp;
+    jr_t reader;
+
+    uint8_t role[JR_MAX_DEPTH];      /* what each open container is, by depth */
+    char scratch[32];                /* short string values (type, stop_reason) */
+    size_t scratch_len;
+
+    int pending;                     /* call slot filled by the current block, -1 if none */
+    bool pending_tool;               /* current block is a tool call */
+
+    size_t text_cap;
+    size_t input_cap[MIMI_MAX_TOOL_CALLS];
+} llm_parse_t;
+
+/**
+ * Reset a response parser. resp is zeroed and filled while bytes are fed:
+ * text is appended as it is decoded and each tool call's input is copied
+ * as the raw bytes of the response (no re-serialization).
+ */
+void llm_parse_init(llm_parse_t *p, llm_stream_format_t format, llm_response_t *resp);
+
+/** Feed raw response body bytes (any fragmentation). */
+esp_err_t llm_parse_feed(llm_parse_t *p, const char *data, size_t len);
+
+/**
+ * Finalize resp. Returns ESP_ERR_INVALID_RESPONSE if the body was not a
+ * complete JSON document.
+ */
+esp_err_t llm_parse_finish(llm_parse_t *p);
@@ -1,12 +1,17 @@
 #include "llm_proxy.h"
+#include "llm_stream.h"
+#include "llm_parse.h"
+#include "json_writer.h"
 #include "mimi_config.h"
-#include "proxy/http_proxy.h"
+#include "proxy/http_pool.h"
+#include "agent/turn_arena.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_http_client.h"
-#include "esp_crt_bundle.h"
 #include "esp_heap_caps.h"
 #include "nvs.h"
 #include "cJSON.h"
@@ -18,20 +23,29 @@ static const char *TAG = "llm";
 #define LLM_DUMP_MAX_BYTES   (16 * 1024)
 #define LLM_DUMP_CHUNK_BYTES 320
 
+/* Request bytes captured while sending for llm_log_prefix() */
+#if MIMI_LLM_LOG_VERBOSE_PAYLOAD
+#define LLM_LOG_CAPTURE_BYTES LLM_DUMP_MAX_BYTES
+#else
+#define LLM_LOG_CAPTURE_BYTES MIMI_LLM_LOG_PREVIEW_BYTES
+#endif
+
 static char s_api_key[LLM_API_KEY_MAX_LEN] = {0};
 static char s_model[LLM_MODEL_MAX_LEN] = MIMI_LLM_DEFAULT_MODEL;
 static char s_provider[16] = MIMI_LLM_PROVIDER_DEFAULT;
 
-static void llm_log_payload(const char *label, const char *payload)
-{
-    if (!payload) {
-        ESP_LOGI(TAG, "%s: <null>", label);
-        return;
-    }
+/* Endpoint profile: empty / 0 fields fall back to the provider defaults */
+static char s_api_url[MIMI_LLM_API_URL_MAX_LEN] = {0};
+static char s_auth_style[12] = {0};
+static int s_max_tokens = 0;
 
-    size_t total = strlen(payload);
+static SemaphoreHandle_t s_tools_lock = NULL;   /* see request_tools_json() */
+
+/* Log the first `avail` bytes of a payload whose full size is `total` */
+static void llm_log_prefix(const char *label, const char *payload, size_t avail, size_t total)
+{
 #if MIMI_LLM_LOG_VERBOSE_PAYLOAD
-    size_t shown = total > LLM_DUMP_MAX_BYTES ? LLM_DUMP_MAX_BYTES : total;
+    size_t shown = avail > LLM_DUMP_MAX_BYTES ? LLM_DUMP_MAX_BYTES : avail;
     ESP_LOGI(TAG, "%s (%u bytes)%s",
              label,
              (unsigned)total,
@@ -49,7 +63,7 @@ static void llm_log_payload(const char *label, const char *payload)
     }
 #else
     if (MIMI_LLM_LOG_PREVIEW_BYTES > 0) {
-        size_t shown = total > MIMI_LLM_LOG_PREVIEW_BYTES ? MIMI_LLM_LOG_PREVIEW_BYTES : total;
+        size_t shown = avail > MIMI_LLM_LOG_PREVIEW_BYTES ? MIMI_LLM_LOG_PREVIEW_BYTES : avail;
         char preview[MIMI_LLM_LOG_PREVIEW_BYTES + 1];
         memcpy(preview, payload, shown);
         preview[shown] = '\0';
@@ -81,83 +95,72 @@ static void safe_copy(char *dst, size_t dst_size, const char *src)
     dst[n] = '\0';
 }
 
-/* ── Response buffer ──────────────────────────────────────────── */
-
-typedef struct {
-    char *data;
-    size_t len;
-    size_t cap;
-} resp_buf_t;
+/* ── Provider helpers ──────────────────────────────────────────── */
 
-static esp_err_t resp_buf_init(resp_buf_t *rb, size_t initial_cap)
+static bool provider_is_openai(void)
 {
-    rb->data = heap_caps_calloc(1, initial_cap, MALLOC_CAP_SPIRAM);
-    if (!rb->data) return ESP_ERR_NO_MEM;
-    rb->len = 0;
-    rb->cap = initial_cap;
-    return ESP_OK;
+    return strcmp(s_provider, "openai") == 0;
 }
 
-static esp_err_t resp_buf_append(resp_buf_t *rb, const char *data, size_t len)
+static const char *llm_api_url(void)
 {
-    while (rb->len + len >= rb->cap) {
-        size_t new_cap = rb->cap * 2;
-        char *tmp = heap_caps_realloc(rb->data, new_cap, MALLOC_CAP_SPIRAM);
-        if (!tmp) return ESP_ERR_NO_MEM;
-        rb->data = tmp;
-        rb->cap = new_cap;
-    }
-    memcpy(rb->data + rb->len, data, len);
-    rb->len += len;
-    rb->data[rb->len] = '\0';
-    return ESP_OK;
+    if (s_api_url[0]) return s_api_url;
+    return provider_is_openai() ? MIMI_OPENAI_API_URL : MIMI_LLM_API_URL;
 }
 
-static void resp_buf_free(resp_buf_t *rb)
+/* "bearer", "x-api-key" or "none" */
+static const char *llm_auth_style(void)
 {
-    free(rb->data);
-    rb->data = NULL;
-    rb->len = 0;
-    rb->cap = 0;
+    if (s_auth_style[0]) return s_auth_style;
+    return provider_is_openai() ? "bearer" : "x-api-key";
 }
 
-/* ── HTTP event handler (for esp_http_client direct path) ─────── */
-
-static esp_err_t http_event_handler(esp_http_client_event_t *evt)
+static int llm_max_tokens(void)
 {
-    resp_buf_t *rb = (resp_buf_t *)evt->user_data;
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
-        resp_buf_append(rb, (const char *)evt->data, evt->data_len);
-    }
-    return ESP_OK;
+    return s_max_tokens > 0 ? s_max_tokens : MIMI_LLM_MAX_TOKENS;
 }
 
-/* ── Provider helpers ──────────────────────────────────────────── */
-
-static bool provider_is_openai(void)
+/* LAN servers usually run without a key; everything else needs one */
+static bool llm_has_credentials(void)
 {
-    return strcmp(s_provider, "openai") == 0;
+    return s_api_key[0] || strcmp(llm_auth_style(), "none") == 0;
 }
 
-static const char *llm_api_url(void)
+static bool auth_style_valid(const char *auth)
 {
-    return provider_is_openai() ? MIMI_OPENAI_API_URL : MIMI_LLM_API_URL;
+    return strcmp(auth, "bearer") == 0 || strcmp(auth, "x-api-key") == 0 ||
+           strcmp(auth, "none") == 0;
 }
 
-static const char *llm_api_host(void)
+static bool api_url_valid(const char *url)
 {
-    return provider_is_openai() ? "api.openai.com" : "api.anthropic.com";
+    const char *host;
+    if (strncmp(url, "https://", 8) == 0) {
+        host = url + 8;
+    } else if (strncmp(url, "http://", 7) == 0) {
+        host = url + 7;
+    } else {
+        return false;
+    }
+    return host[0] && host[0] != '/' && host[0] != ':' &&
+           strlen(url) < MIMI_LLM_API_URL_MAX_LEN;
 }
 
-static const char *llm_api_path(void)
+static int parse_max_tokens(const char *s)
 {
-    return provider_is_openai() ? "/v1/chat/completions" : "/v1/messages";
+    char *end = NULL;
+    long v = strtol(s, &end, 10);
+    if (!s[0] || *end || v <= 0 || v > 1000000) return 0;
+    return (int)v;
 }
 
 /* ── Init ─────────────────────────────────────────────────────── */
 
 esp_err_t llm_proxy_init(void)
 {
+    s_tools_lock = xSemaphoreCreateMutex();
+    if (!s_tools_lock) return ESP_ERR_NO_MEM;
+
     /* Start with build-time defaults */
     if (MIMI_SECRET_API_KEY[0] != '\0') {
         safe_copy(s_api_key, sizeof(s_api_key), MIMI_SECRET_API_KEY);
@@ -168,6 +171,15 @@ esp_err_t llm_proxy_init(void)
     if (MIMI_SECRET_MODEL_PROVIDER[0] != '\0') {
         safe_copy(s_provider, sizeof(s_provider), MIMI_SECRET_MODEL_PROVIDER);
     }
+    if (MIMI_SECRET_LLM_API_URL[0] != '\0') {
+        safe_copy(s_api_url, sizeof(s_api_url), MIMI_SECRET_LLM_API_URL);
+    }
+    if (MIMI_SECRET_LLM_AUTH[0] != '\0') {
+        safe_copy(s_auth_style, sizeof(s_auth_style), MIMI_SECRET_LLM_AUTH);
+    }
+    if (MIMI_SECRET_LLM_MAX_TOKENS[0] != '\0') {
+        s_max_tokens = parse_max_tokens(MIMI_SECRET_LLM_MAX_TOKENS);
+    }
 
     /* NVS overrides take highest priority (set via CLI) */
     nvs_handle_t nvs;
@@ -187,10 +199,38 @@ esp_err_t llm_proxy_init(void)
         if (nvs_get_str(nvs, MIMI_NVS_KEY_PROVIDER, provider_tmp, &len) == ESP_OK && provider_tmp[0]) {
             safe_copy(s_provider, sizeof(s_provider), provider_tmp);
         }
+        char url_tmp[MIMI_LLM_API_URL_MAX_LEN] = {0};
+        len = sizeof(url_tmp);
+        if (nvs_get_str(nvs, MIMI_NVS_KEY_LLM_URL, url_tmp, &len) == ESP_OK && url_tmp[0]) {
+            safe_copy(s_api_url, sizeof(s_api_url), url_tmp);
+        }
+        char auth_tmp[sizeof(s_auth_style)] = {0};
+        len = sizeof(auth_tmp);
+        if (nvs_get_str(nvs, MIMI_NVS_KEY_LLM_AUTH, auth_tmp, &len) == ESP_OK && auth_tmp[0]) {
+            safe_copy(s_auth_style, sizeof(s_auth_style), auth_tmp);
+        }
+        char tok_tmp[12] = {0};
+        len = sizeof(tok_tmp);
+        if (nvs_get_str(nvs, MIMI_NVS_KEY_LLM_MAX_TOKENS, tok_tmp, &len) == ESP_OK && tok_tmp[0]) {
+            s_max_tokens = parse_max_tokens(tok_tmp);
+        }
         nvs_close(nvs);
     }
 
-    if (s_api_key[0]) {
+    if (s_api_url[0] && !api_url_valid(s_api_url)) {
+        ESP_LOGW(TAG, "Ignoring invalid endpoint URL: %s", s_api_url);
+        s_api_url[0] = '\0';
+    }
+    if (s_auth_style[0] && !auth_style_valid(s_auth_style)) {
+        ESP_LOGW(TAG, "Ignoring invalid auth style: %s", s_auth_style);
+        s_auth_style[0] = '\0';
+    }
+    if (s_api_url[0]) {
+        ESP_LOGI(TAG, "Custom endpoint: %s (auth: %s, max_tokens: %d)",
+                 s_api_url, llm_auth_style(), llm_max_tokens());
+    }
+
+    if (llm_has_credentials()) {
         ESP_LOGI(TAG, "LLM proxy initialized (provider: %s, model: %s)", s_provider, s_model);
     } else {
         ESP_LOGW(TAG, "No API key. Use CLI: set_api_key <KEY>");
@@ -198,118 +238,173 @@ esp_err_t llm_proxy_init(void)
     return ESP_OK;
 }
 
-/* ── Direct path: esp_http_client ───────────────────────────── */
+/* ── Shared HTTP dispatch (pooled, direct or via proxy) ─────────── */
 
-static esp_err_t llm_http_direct(const char *post_data, resp_buf_t *rb, int *out_status)
-{
-    esp_http_client_config_t config = {
-        .url = llm_api_url(),
-        .event_handler = http_event_handler,
-        .user_data = rb,
-        .timeout_ms = 120 * 1000,
-        .buffer_size = 4096,
-        .buffer_size_tx = 4096,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
+/* One generation of the provider-ready tools array, see request_tools_json() */
+typedef struct {
+    int32_t refs;                        /* the cache's own + one per request */
+    char json[];
+} tools_gen_t;
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) return ESP_FAIL;
+typedef struct {
+    const char *system_prompt;
+    const cJSON *messages;
+    size_t stable_len;                   /* cacheable system prompt prefix */
+    const char *tools;                   /* provider-ready array, see request_tools_json() */
+    tools_gen_t *tools_held;             /* reference keeping tools alive, or NULL */
+    bool stream;
+    int max_tokens;                      /* 0 = llm_max_tokens() */
+} llm_body_t;
 
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    if (provider_is_openai()) {
-        if (s_api_key[0]) {
-            char auth[LLM_API_KEY_MAX_LEN + 16];
-            snprintf(auth, sizeof(auth), "Bearer %s", s_api_key);
-            esp_http_client_set_header(client, "Authorization", auth);
-        }
-    } else {
-        esp_http_client_set_header(client, "x-api-key", s_api_key);
-        esp_http_client_set_header(client, "anthropic-version", MIMI_LLM_API_VERSION);
-    }
-    esp_http_client_set_post_field(client, post_data, strlen(post_data));
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+} log_capture_t;
 
-    esp_err_t err = esp_http_client_perform(client);
-    *out_status = esp_http_client_get_status_code(client);
-    esp_http_client_cleanup(client);
-    return err;
+static esp_err_t log_capture_sink(const char *data, size_t len, void *ctx)
+{
+    log_capture_t *lc = (log_capture_t *)ctx;
+    size_t room = lc->cap - lc->len;
+    size_t n = len < room ? len : room;
+    memcpy(lc->buf + lc->len, data, n);
+    lc->len += n;
+    return ESP_OK;
 }
 
-/* ── Proxy path: manual HTTP over CONNECT tunnel ────────────── */
+/* Body writer state: bytes pass through to the connection, the first ones are kept for the log */
+typedef struct {
+    const llm_body_t *body;
+    const char *label;
+    http_pool_sink_t sink;
+    void *sink_ctx;
+    log_capture_t log;
+} body_out_t;
+
+static esp_err_t body_out_sink(const char *data, size_t len, void *ctx)
+{
+    body_out_t *bo = (body_out_t *)ctx;
+    if (bo->log.buf) log_capture_sink(data, len, &bo->log);
+    return bo->sink(data, len, bo->sink_ctx);
+}
+
+static void write_request(jw_t *w, const llm_body_t *body);
 
-static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *out_status)
+/*
+ * Single pass: the body is serialized straight into the connection with
+ * chunked transfer encoding, so no sizing pass is needed for Content-Length.
+ */
+static esp_err_t llm_body_writer(http_pool_sink_t sink, void *sink_ctx, void *body_ctx)
 {
-    proxy_conn_t *conn = proxy_conn_open(llm_api_host(), 443, 30000);
-    if (!conn) return ESP_ERR_HTTP_CONNECT;
+    body_out_t *bo = (body_out_t *)body_ctx;
+    bo->sink = sink;
+    bo->sink_ctx = sink_ctx;
+    bo->log.len = 0;
 
-    int body_len = strlen(post_data);
-    char header[1024];
-    int hlen = 0;
-    if (provider_is_openai()) {
-        hlen = snprintf(header, sizeof(header),
-            "POST %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Content-Type: application/json\r\n"
-            "Authorization: Bearer %s\r\n"
-            "Content-Length: %d\r\n"
-            "Connection: close\r\n\r\n",
-            llm_api_path(), llm_api_host(), s_api_key, body_len);
-    } else {
-        hlen = snprintf(header, sizeof(header),
-            "POST %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Content-Type: application/json\r\n"
-            "x-api-key: %s\r\n"
-            "anthropic-version: %s\r\n"
-            "Content-Length: %d\r\n"
-            "Connection: close\r\n\r\n",
-            llm_api_path(), llm_api_host(), s_api_key, MIMI_LLM_API_VERSION, body_len);
-    }
+    jw_t w;
+    jw_init(&w, body_out_sink, bo);
+    write_request(&w, bo->body);
+    esp_err_t err = jw_finish(&w);
 
-    if (proxy_conn_write(conn, header, hlen) < 0 ||
-        proxy_conn_write(conn, post_data, body_len) < 0) {
-        proxy_conn_close(conn);
-        return ESP_ERR_HTTP_WRITE_DATA;
-    }
+    llm_log_prefix(bo->label, bo->log.buf ? bo->log.buf : "", bo->log.len, w.total);
+    return err;
+}
 
-    /* Read full response into buffer */
-    char tmp[4096];
-    while (1) {
-        int n = proxy_conn_read(conn, tmp, sizeof(tmp), 120000);
-        if (n <= 0) break;
-        if (resp_buf_append(rb, tmp, n) != ESP_OK) break;
+static esp_err_t llm_http_post(const llm_body_t *body, const char *label,
+                               http_body_cb_t on_body, void *ctx, int *out_status)
+{
+    http_pool_header_t headers[3];
+    int n = 0;
+    char auth[LLM_API_KEY_MAX_LEN + 16];
+
+    const char *style = llm_auth_style();
+
+    headers[n++] = (http_pool_header_t){ "Content-Type", "application/json" };
+    if (strcmp(style, "bearer") == 0 && s_api_key[0]) {
+        snprintf(auth, sizeof(auth), "Bearer %s", s_api_key);
+        headers[n++] = (http_pool_header_t){ "Authorization", auth };
+    } else if (strcmp(style, "x-api-key") == 0) {
+        headers[n++] = (http_pool_header_t){ "x-api-key", s_api_key };
     }
-    proxy_conn_close(conn);
-
-    /* Parse status line */
-    *out_status = 0;
-    if (rb->len > 5 && strncmp(rb->data, "HTTP/", 5) == 0) {
-        const char *sp = strchr(rb->data, ' ');
-        if (sp) *out_status = atoi(sp + 1);
+    if (!provider_is_openai()) {
+        headers[n++] = (http_pool_header_t){ "anthropic-version", MIMI_LLM_API_VERSION };
     }
 
-    /* Strip HTTP headers, keep body only */
-    char *body = strstr(rb->data, "\r\n\r\n");
-    if (body) {
-        body += 4;
-        size_t blen = rb->len - (body - rb->data);
-        memmove(rb->data, body, blen);
-        rb->len = blen;
-        rb->data[rb->len] = '\0';
+    body_out_t bo = { .body = body, .label = label };
+    if (LLM_LOG_CAPTURE_BYTES > 0) {
+        bo.log.buf = heap_caps_calloc(1, LLM_LOG_CAPTURE_BYTES, MALLOC_CAP_SPIRAM);
+        bo.log.cap = bo.log.buf ? LLM_LOG_CAPTURE_BYTES : 0;
     }
 
-    return ESP_OK;
+    http_pool_req_t req = {
+        .url = llm_api_url(),
+        .method = HTTP_METHOD_POST,
+        .headers = headers,
+        .header_count = n,
+        .body_writer = llm_body_writer,
+        .body_ctx = &bo,
+        .on_body = on_body,
+        .user_data = ctx,
+        .timeout_ms = 120 * 1000,
+    };
+    esp_err_t err = http_pool_perform(&req, out_status);
+    free(bo.log.buf);
+    return err;
 }
 
-/* ── Shared HTTP dispatch ─────────────────────────────────────── */
+/* ── Streaming transport (SSE) ────────────────────────────────── */
+
+#define LLM_STREAM_ERR_BODY 512
 
-static esp_err_t llm_http_call(const char *post_data, resp_buf_t *rb, int *out_status)
+typedef struct {
+    llm_stream_t *stream;
+    int status;
+    char err_body[LLM_STREAM_ERR_BODY];  /* first bytes of a non-200 body, for logging */
+    size_t err_len;
+} stream_ctx_t;
+
+static esp_err_t stream_on_body(int status, const char *data, size_t len, void *ctx)
 {
-    if (http_proxy_is_enabled()) {
-        return llm_http_via_proxy(post_data, rb, out_status);
-    } else {
-        return llm_http_direct(post_data, rb, out_status);
+    stream_ctx_t *sc = (stream_ctx_t *)ctx;
+    sc->status = status;
+    if (status != 200) {
+        size_t room = sizeof(sc->err_body) - 1 - sc->err_len;
+        size_t n = len < room ? len : room;
+        memcpy(sc->err_body + sc->err_len, data, n);
+        sc->err_len += n;
+        sc->err_body[sc->err_len] = '\0';
+        return ESP_OK;
     }
+    return llm_stream_feed(sc->stream, data, len);
+}
+
+/* ── Buffered transport: one-pass parse as chunks arrive ───────── */
+
+typedef struct {
+    llm_parse_t *parser;
+    int status;
+    log_capture_t log;                   /* response prefix for llm_log_prefix() */
+    size_t total;
+    char err_body[LLM_STREAM_ERR_BODY];  /* first bytes of a non-200 body, for logging */
+    size_t err_len;
+} parse_ctx_t;
+
+static esp_err_t parse_on_body(int status, const char *data, size_t len, void *ctx)
+{
+    parse_ctx_t *pc = (parse_ctx_t *)ctx;
+    pc->status = status;
+    pc->total += len;
+    if (pc->log.buf) log_capture_sink(data, len, &pc->log);
+
+    if (status != 200) {
+        size_t room = sizeof(pc->err_body) - 1 - pc->err_len;
+        size_t n = len < room ? len : room;
+        memcpy(pc->err_body + pc->err_len, data, n);
+        pc->err_len += n;
+        pc->err_body[pc->err_len] = '\0';
+        return ESP_OK;
+    }
+    return llm_parse_feed(pc->parser, data, len);
 }
 
 static cJSON *convert_tools_openai(const char *tools_json)
@@ -346,139 +441,368 @@ static cJSON *convert_tools_openai(const char *tools_json)
     return out;
 }
 
-static cJSON *convert_messages_openai(const char *system_prompt, cJSON *messages)
+#if MIMI_LLM_PROMPT_CACHE
+/* Mark the last tool as a cache breakpoint: the whole tools array is cached */
+static cJSON *mark_tools_cacheable(const char *tools_json)
 {
-    cJSON *out = cJSON_CreateArray();
-    if (system_prompt && system_prompt[0]) {
-        cJSON *sys = cJSON_CreateObject();
-        cJSON_AddStringToObject(sys, "role", "system");
-        cJSON_AddStringToObject(sys, "content", system_prompt);
-        cJSON_AddItemToArray(out, sys);
-    }
-
-    if (!messages || !cJSON_IsArray(messages)) return out;
-
-    cJSON *msg;
-    cJSON_ArrayForEach(msg, messages) {
-        cJSON *role = cJSON_GetObjectItem(msg, "role");
-        cJSON *content = cJSON_GetObjectItem(msg, "content");
-        if (!role || !cJSON_IsString(role)) continue;
-
-        if (content && cJSON_IsString(content)) {
-            cJSON *m = cJSON_CreateObject();
-            cJSON_AddStringToObject(m, "role", role->valuestring);
-            cJSON_AddStringToObject(m, "content", content->valuestring);
-            cJSON_AddItemToArray(out, m);
-            continue;
-        }
+    cJSON *arr = cJSON_Parse(tools_json);
+    cJSON *last = cJSON_IsArray(arr) ? cJSON_GetArrayItem(arr, cJSON_GetArraySize(arr) - 1) : NULL;
+    if (!last) {
+        cJSON_Delete(arr);
+        return NULL;
+    }
+    cJSON *cc = cJSON_CreateObject();
+    cJSON_AddStringToObject(cc, "type", "ephemeral");
+    cJSON_AddItemToObject(last, "cache_control", cc);
+    return arr;
+}
+#endif
 
-        if (!content || !cJSON_IsArray(content)) continue;
-
-        if (strcmp(role->valuestring, "assistant") == 0) {
-            cJSON *m = cJSON_CreateObject();
-            cJSON_AddStringToObject(m, "role", "assistant");
-
-            /* collect text */
-            char *text_buf = NULL;
-            size_t off = 0;
-            cJSON *block;
-            cJSON *tool_calls = NULL;
-            cJSON_ArrayForEach(block, content) {
-                cJSON *btype = cJSON_GetObjectItem(block, "type");
-                if (btype && cJSON_IsString(btype) && strcmp(btype->valuestring, "text") == 0) {
-                    cJSON *text = cJSON_GetObjectItem(block, "text");
-                    if (text && cJSON_IsString(text)) {
-                        size_t tlen = strlen(text->valuestring);
-                        char *tmp = realloc(text_buf, off + tlen + 1);
-                        if (tmp) {
-                            text_buf = tmp;
-                            memcpy(text_buf + off, text->valuestring, tlen);
-                            off += tlen;
-                            text_buf[off] = '\0';
-                        }
-                    }
-                } else if (btype && cJSON_IsString(btype) && strcmp(btype->valuestring, "tool_use") == 0) {
-                    if (!tool_calls) tool_calls = cJSON_CreateArray();
-                    cJSON *id = cJSON_GetObjectItem(block, "id");
-                    cJSON *name = cJSON_GetObjectItem(block, "name");
-                    cJSON *input = cJSON_GetObjectItem(block, "input");
-                    if (!name || !cJSON_IsString(name)) continue;
-
-                    cJSON *tc = cJSON_CreateObject();
-                    if (id && cJSON_IsString(id)) {
-                        cJSON_AddStringToObject(tc, "id", id->valuestring);
-                    }
-                    cJSON_AddStringToObject(tc, "type", "function");
-                    cJSON *func = cJSON_CreateObject();
-                    cJSON_AddStringToObject(func, "name", name->valuestring);
-                    if (input) {
-                        char *args = cJSON_PrintUnformatted(input);
-                        if (args) {
-                            cJSON_AddStringToObject(func, "arguments", args);
-                            free(args);
-                        }
-                    }
-                    cJSON_AddItemToObject(tc, "function", func);
-                    cJSON_AddItemToArray(tool_calls, tc);
-                }
-            }
-            if (text_buf) {
-                cJSON_AddStringToObject(m, "content", text_buf);
-            } else {
-                cJSON_AddStringToObject(m, "content", "");
+/*
+ * Provider-ready tools are cached: the registry's tools JSON only changes at
+ * boot. Agent workers share the cache; each generation is refcounted, so one
+ * replaced after a provider switch lives until the last request sending it
+ * releases it.
+ */
+static tools_gen_t *s_req_tools = NULL;
+static bool s_req_tools_openai = false;
+static size_t s_req_tools_src_len = 0;
+static uint32_t s_req_tools_src_hash = 0;
+
+static uint32_t fnv1a(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void tools_gen_release(tools_gen_t *gen)
+{
+    if (gen && __atomic_sub_fetch(&gen->refs, 1, __ATOMIC_ACQ_REL) == 0) free(gen);
+}
+
+static tools_gen_t *tools_gen_new(const char *json)
+{
+    size_t len = strlen(json);
+    tools_gen_t *gen = heap_caps_malloc(sizeof(*gen) + len + 1, MALLOC_CAP_SPIRAM);
+    if (!gen) return NULL;
+    gen->refs = 1;
+    memcpy(gen->json, json, len + 1);
+    return gen;
+}
+
+/*
+ * Provider-ready tools array for a request. When it comes from the cache,
+ * *held is a reference the caller drops with tools_gen_release().
+ */
+static const char *request_tools_json(const char *tools_json, tools_gen_t **held)
+{
+    *held = NULL;
+    if (!tools_json) return NULL;
+
+    bool openai = provider_is_openai();
+#if !MIMI_LLM_PROMPT_CACHE
+    if (!openai) return tools_json;      /* Anthropic takes the registry format as is */
+#endif
+
+    size_t len = strlen(tools_json);
+    uint32_t hash = fnv1a(tools_json, len);
+
+    xSemaphoreTake(s_tools_lock, portMAX_DELAY);
+    if (!s_req_tools || openai != s_req_tools_openai ||
+        len != s_req_tools_src_len || hash != s_req_tools_src_hash) {
+        tools_gen_release(s_req_tools);
+        s_req_tools = NULL;
+
+        /* The rendered array is kept across turns */
+        turn_arena_escape_begin();
+        cJSON *tools = NULL;
+        if (openai) {
+            tools = convert_tools_openai(tools_json);
+        }
+#if MIMI_LLM_PROMPT_CACHE
+        else {
+            tools = mark_tools_cacheable(tools_json);
+        }
+#endif
+        if (tools) {
+            char *printed = cJSON_PrintUnformatted(tools);
+            cJSON_Delete(tools);
+            if (printed) {
+                s_req_tools = tools_gen_new(printed);
+                cJSON_free(printed);
             }
-            if (tool_calls) {
-                cJSON_AddItemToObject(m, "tool_calls", tool_calls);
+        }
+        turn_arena_escape_end();
+        s_req_tools_openai = openai;
+        s_req_tools_src_len = len;
+        s_req_tools_src_hash = hash;
+    }
+    const char *out = openai ? NULL : tools_json;
+    if (s_req_tools) {
+        __atomic_fetch_add(&s_req_tools->refs, 1, __ATOMIC_RELAXED);
+        *held = s_req_tools;
+        out = s_req_tools->json;
+    }
+    xSemaphoreGive(s_tools_lock);
+    return out;
+}
+
+/* ── Request body writer (no intermediate DOM) ────────────────── */
+
+static bool block_is(const cJSON *block, const char *type)
+{
+    const char *btype = cJSON_GetStringValue(cJSON_GetObjectItem(block, "type"));
+    return btype && strcmp(btype, type) == 0;
+}
+
+static bool has_block(const cJSON *content, const char *type)
+{
+    const cJSON *block;
+    cJSON_ArrayForEach(block, content) {
+        if (block_is(block, type)) return true;
+    }
+    return false;
+}
+
+/* Concatenate the text blocks of a content array into one string value */
+static void write_joined_text(jw_t *w, const cJSON *content)
+{
+    const cJSON *block;
+    jw_str_begin(w);
+    cJSON_ArrayForEach(block, content) {
+        if (!block_is(block, "text")) continue;
+        const char *text = cJSON_GetStringValue(cJSON_GetObjectItem(block, "text"));
+        if (text) jw_str_part(w, text, strlen(text));
+    }
+    jw_str_end(w);
+}
+
+static void write_assistant_openai(jw_t *w, const cJSON *content)
+{
+    jw_obj_begin(w);
+    jw_key(w, "role");
+    jw_str(w, "assistant");
+    jw_key(w, "content");
+    write_joined_text(w, content);
+
+    if (has_block(content, "tool_use")) {
+        jw_key(w, "tool_calls");
+        jw_arr_begin(w);
+        const cJSON *block;
+        cJSON_ArrayForEach(block, content) {
+            if (!block_is(block, "tool_use")) continue;
+            const char *id = cJSON_GetStringValue(cJSON_GetObjectItem(block, "id"));
+            const char *name = cJSON_GetStringValue(cJSON_GetObjectItem(block, "name"));
+            const cJSON *input = cJSON_GetObjectItem(block, "input");
+            if (!name) continue;
+
+            jw_obj_begin(w);
+            if (id) {
+                jw_key(w, "id");
+                jw_str(w, id);
             }
-            cJSON_AddItemToArray(out, m);
-            free(text_buf);
-        } else if (strcmp(role->valuestring, "user") == 0) {
-            /* tool_result blocks become role=tool */
-            cJSON *block;
-            bool has_user_text = false;
-            char *text_buf = NULL;
-            size_t off = 0;
-            cJSON_ArrayForEach(block, content) {
-                cJSON *btype = cJSON_GetObjectItem(block, "type");
-                if (btype && cJSON_IsString(btype) && strcmp(btype->valuestring, "tool_result") == 0) {
-                    cJSON *tool_id = cJSON_GetObjectItem(block, "tool_use_id");
-                    cJSON *tcontent = cJSON_GetObjectItem(block, "content");
-                    if (!tool_id || !cJSON_IsString(tool_id)) continue;
-                    cJSON *tm = cJSON_CreateObject();
-                    cJSON_AddStringToObject(tm, "role", "tool");
-                    cJSON_AddStringToObject(tm, "tool_call_id", tool_id->valuestring);
-                    if (tcontent && cJSON_IsString(tcontent)) {
-                        cJSON_AddStringToObject(tm, "content", tcontent->valuestring);
-                    } else {
-                        cJSON_AddStringToObject(tm, "content", "");
-                    }
-                    cJSON_AddItemToArray(out, tm);
-                } else if (btype && cJSON_IsString(btype) && strcmp(btype->valuestring, "text") == 0) {
-                    cJSON *text = cJSON_GetObjectItem(block, "text");
-                    if (text && cJSON_IsString(text)) {
-                        size_t tlen = strlen(text->valuestring);
-                        char *tmp = realloc(text_buf, off + tlen + 1);
-                        if (tmp) {
-                            text_buf = tmp;
-                            memcpy(text_buf + off, text->valuestring, tlen);
-                            off += tlen;
-                            text_buf[off] = '\0';
-                        }
-                        has_user_text = true;
-                    }
-                }
+            jw_key(w, "type");
+            jw_str(w, "function");
+            jw_key(w, "function");
+            jw_obj_begin(w);
+            jw_key(w, "name");
+            jw_str(w, name);
+            if (input) {
+                jw_key(w, "arguments");
+                jw_cjson_as_str(w, input);
             }
-            if (has_user_text) {
-                cJSON *um = cJSON_CreateObject();
-                cJSON_AddStringToObject(um, "role", "user");
-                cJSON_AddStringToObject(um, "content", text_buf);
-                cJSON_AddItemToArray(out, um);
+            jw_obj_end(w);
+            jw_obj_end(w);
+        }
+        jw_arr_end(w);
+    }
+    jw_obj_end(w);
+}
+
+/* tool_result blocks become role=tool messages, remaining text one user message */
+static void write_user_openai(jw_t *w, const cJSON *content)
+{
+    const cJSON *block;
+    cJSON_ArrayForEach(block, content) {
+        if (!block_is(block, "tool_result")) continue;
+        const char *tool_id = cJSON_GetStringValue(cJSON_GetObjectItem(block, "tool_use_id"));
+        const char *tcontent = cJSON_GetStringValue(cJSON_GetObjectItem(block, "content"));
+        if (!tool_id) continue;
+
+        jw_obj_begin(w);
+        jw_key(w, "role");
+        jw_str(w, "tool");
+        jw_key(w, "tool_call_id");
+        jw_str(w, tool_id);
+        jw_key(w, "content");
+        jw_str(w, tcontent ? tcontent : "");
+        jw_obj_end(w);
+    }
+
+    bool has_text = false;
+    cJSON_ArrayForEach(block, content) {
+        if (block_is(block, "text") && cJSON_IsString(cJSON_GetObjectItem(block, "text"))) {
+            has_text = true;
+            break;
+        }
+    }
+    if (has_text) {
+        jw_obj_begin(w);
+        jw_key(w, "role");
+        jw_str(w, "user");
+        jw_key(w, "content");
+        write_joined_text(w, content);
+        jw_obj_end(w);
+    }
+}
+
+static void write_messages_openai(jw_t *w, const char *system_prompt, const cJSON *messages)
+{
+    jw_arr_begin(w);
+    if (system_prompt && system_prompt[0]) {
+        jw_obj_begin(w);
+        jw_key(w, "role");
+        jw_str(w, "system");
+        jw_key(w, "content");
+        jw_str(w, system_prompt);
+        jw_obj_end(w);
+    }
+
+    const cJSON *list = cJSON_IsArray(messages) ? messages : NULL;
+    const cJSON *msg;
+    cJSON_ArrayForEach(msg, list) {
+        const char *role = cJSON_GetStringValue(cJSON_GetObjectItem(msg, "role"));
+        const cJSON *content = cJSON_GetObjectItem(msg, "content");
+        if (!role) continue;
+
+        if (cJSON_IsString(content)) {
+            jw_obj_begin(w);
+            jw_key(w, "role");
+            jw_str(w, role);
+            jw_key(w, "content");
+            jw_str(w, content->valuestring);
+            jw_obj_end(w);
+        } else if (cJSON_IsArray(content)) {
+            if (strcmp(role, "assistant") == 0) {
+                write_assistant_openai(w, content);
+            } else if (strcmp(role, "user") == 0) {
+                write_user_openai(w, content);
             }
-            free(text_buf);
         }
     }
+    jw_arr_end(w);
+}
 
-    return out;
+/*
+ * With prompt caching the system prompt becomes two text blocks: the stable
+ * prefix carries the cache breakpoint, the per-turn remainder follows it.
+ */
+static void write_system_anthropic(jw_t *w, const char *system_prompt, size_t stable_len)
+{
+    size_t total = strlen(system_prompt);
+#if MIMI_LLM_PROMPT_CACHE
+    if (stable_len > 0 && stable_len <= total) {
+        jw_arr_begin(w);
+        jw_obj_begin(w);
+        jw_key(w, "type");
+        jw_str(w, "text");
+        jw_key(w, "text");
+        jw_str_begin(w);
+        jw_str_part(w, system_prompt, stable_len);
+        jw_str_end(w);
+        jw_key(w, "cache_control");
+        jw_obj_begin(w);
+        jw_key(w, "type");
+        jw_str(w, "ephemeral");
+        jw_obj_end(w);
+        jw_obj_end(w);
+        if (stable_len < total) {
+            jw_obj_begin(w);
+            jw_key(w, "type");
+            jw_str(w, "text");
+            jw_key(w, "text");
+            jw_str(w, system_prompt + stable_len);
+            jw_obj_end(w);
+        }
+        jw_arr_end(w);
+        return;
+    }
+#else
+    (void)stable_len;
+#endif
+    jw_str_begin(w);
+    jw_str_part(w, system_prompt, total);
+    jw_str_end(w);
+}
+
+static void write_request(jw_t *w, const llm_body_t *body)
+{
+    bool openai = provider_is_openai();
+
+    jw_obj_begin(w);
+    jw_key(w, "model");
+    jw_str(w, s_model);
+    jw_key(w, openai ? "max_completion_tokens" : "max_tokens");
+    jw_int(w, body->max_tokens > 0 ? body->max_tokens : llm_max_tokens());
+    if (body->stream) {
+        jw_key(w, "stream");
+        jw_bool(w, true);
+        if (openai) {
+            /* Without it OpenAI never sends the final usage chunk */
+            jw_key(w, "stream_options");
+            jw_obj_begin(w);
+            jw_key(w, "include_usage");
+            jw_bool(w, true);
+            jw_obj_end(w);
+        }
+    }
+
+    if (openai) {
+        jw_key(w, "messages");
+        write_messages_openai(w, body->system_prompt, body->messages);
+        if (body->tools) {
+            jw_key(w, "tools");
+            jw_raw(w, body->tools, strlen(body->tools));
+            jw_key(w, "tool_choice");
+            jw_str(w, "auto");
+        }
+    } else {
+        if (body->system_prompt) {
+            jw_key(w, "system");
+            write_system_anthropic(w, body->system_prompt, body->stable_len);
+        }
+        /* History is serialized from the caller's tree: no duplicate, no print buffer */
+        if (body->messages) {
+            jw_key(w, "messages");
+            jw_cjson(w, body->messages);
+        }
+        if (body->tools) {
+            jw_key(w, "tools");
+            jw_raw(w, body->tools, strlen(body->tools));
+        }
+    }
+    jw_obj_end(w);
+}
+
+static void llm_body_prepare(llm_body_t *body, const char *system_prompt, size_t stable_len,
+                             cJSON *messages, const char *tools_json, bool stream)
+{
+    body->system_prompt = system_prompt;
+    body->stable_len = stable_len;
+    body->messages = messages;
+    body->tools = request_tools_json(tools_json, &body->tools_held);
+    body->stream = stream;
+    body->max_tokens = 0;
+}
+
+static void llm_body_release(llm_body_t *body)
+{
+    tools_gen_release(body->tools_held);
+    body->tools_held = NULL;
+    body->tools = NULL;
 }
 
 /* ── Public: chat with tools (non-streaming) ──────────────────── */
@@ -496,225 +820,156 @@ void llm_response_free(llm_response_t *resp)
     resp->tool_use = false;
 }
 
+/* Non-streaming request: the response is parsed as it arrives */
+static esp_err_t llm_chat_post(const llm_body_t *body, const char *label, llm_response_t *resp)
+{
+    parse_ctx_t *pc = heap_caps_calloc(1, sizeof(*pc), MALLOC_CAP_SPIRAM);
+    llm_parse_t *parser = heap_caps_calloc(1, sizeof(*parser), MALLOC_CAP_SPIRAM);
+    if (!pc || !parser) {
+        free(pc);
+        free(parser);
+        return ESP_ERR_NO_MEM;
+    }
+    if (LLM_LOG_CAPTURE_BYTES > 0) {
+        pc->log.buf = heap_caps_calloc(1, LLM_LOG_CAPTURE_BYTES, MALLOC_CAP_SPIRAM);
+        pc->log.cap = pc->log.buf ? LLM_LOG_CAPTURE_BYTES : 0;
+    }
+    llm_parse_init(parser, provider_is_openai() ? LLM_STREAM_FMT_OPENAI : LLM_STREAM_FMT_ANTHROPIC,
+                   resp);
+    pc->parser = parser;
+
+    /* The response is parsed as it arrives: no body buffer, no cJSON tree */
+    char log_label[48];
+    snprintf(log_label, sizeof(log_label), "%s request", label);
+    int status = 0;
+    esp_err_t err = llm_http_post(body, log_label, parse_on_body, pc, &status);
+
+    snprintf(log_label, sizeof(log_label), "%s %s", label,
+             err == ESP_OK ? "raw response" : "partial response");
+    llm_log_prefix(log_label, pc->log.buf ? pc->log.buf : "", pc->log.len, pc->total);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
+    } else if (status != 200) {
+        ESP_LOGE(TAG, "API error %d: %s", status, pc->err_body);
+        err = ESP_FAIL;
+    } else {
+        err = llm_parse_finish(parser);
+        if (err != ESP_OK) ESP_LOGE(TAG, "Failed to parse API response JSON");
+    }
+
+    free(pc->log.buf);
+    free(pc);
+    free(parser);
+
+    if (err != ESP_OK) {
+        llm_response_free(resp);
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Response: %d bytes text, %d tool calls, stop=%s",
+             (int)resp->text_len, resp->call_count,
+             resp->tool_use ? "tool_use" : "end_turn");
+    ESP_LOGI(TAG, "Usage: in=%u out=%u cache_read=%u cache_write=%u",
+             (unsigned)resp->usage.input_tokens, (unsigned)resp->usage.output_tokens,
+             (unsigned)resp->usage.cache_read_tokens, (unsigned)resp->usage.cache_creation_tokens);
+
+    return ESP_OK;
+}
+
 esp_err_t llm_chat_tools(const char *system_prompt,
+                         size_t stable_len,
                          cJSON *messages,
                          const char *tools_json,
                          llm_response_t *resp)
 {
     memset(resp, 0, sizeof(*resp));
 
-    if (s_api_key[0] == '\0') return ESP_ERR_INVALID_STATE;
+    if (!llm_has_credentials()) return ESP_ERR_INVALID_STATE;
 
-    /* Build request body (non-streaming) */
-    cJSON *body = cJSON_CreateObject();
-    cJSON_AddStringToObject(body, "model", s_model);
-    if (provider_is_openai()) {
-        cJSON_AddNumberToObject(body, "max_completion_tokens", MIMI_LLM_MAX_TOKENS);
-    } else {
-        cJSON_AddNumberToObject(body, "max_tokens", MIMI_LLM_MAX_TOKENS);
-    }
+    /* Request body (non-streaming) is serialized straight into the connection */
+    llm_body_t body;
+    llm_body_prepare(&body, system_prompt, stable_len, messages, tools_json, false);
 
-    if (provider_is_openai()) {
-        cJSON *openai_msgs = convert_messages_openai(system_prompt, messages);
-        cJSON_AddItemToObject(body, "messages", openai_msgs);
+    ESP_LOGI(TAG, "Calling LLM API with tools (provider: %s, model: %s)", s_provider, s_model);
+    esp_err_t err = llm_chat_post(&body, "LLM tools", resp);
+    llm_body_release(&body);
+    return err;
+}
 
-        if (tools_json) {
-            cJSON *tools = convert_tools_openai(tools_json);
-            if (tools) {
-                cJSON_AddItemToObject(body, "tools", tools);
-                cJSON_AddStringToObject(body, "tool_choice", "auto");
-            }
-        }
-    } else {
-        cJSON_AddStringToObject(body, "system", system_prompt);
+esp_err_t llm_complete(const char *system_prompt, cJSON *messages, int max_tokens, llm_response_t *resp)
+{
+    memset(resp, 0, sizeof(*resp));
 
-        /* Deep-copy messages so caller keeps ownership */
-        cJSON *msgs_copy = cJSON_Duplicate(messages, 1);
-        cJSON_AddItemToObject(body, "messages", msgs_copy);
+    if (!llm_has_credentials()) return ESP_ERR_INVALID_STATE;
 
-        /* Add tools array if provided */
-        if (tools_json) {
-            cJSON *tools = cJSON_Parse(tools_json);
-            if (tools) {
-                cJSON_AddItemToObject(body, "tools", tools);
-            }
-        }
-    }
+    llm_body_t body;
+    llm_body_prepare(&body, system_prompt, 0, messages, NULL, false);
+    body.max_tokens = max_tokens;
 
-    char *post_data = cJSON_PrintUnformatted(body);
-    cJSON_Delete(body);
-    if (!post_data) return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "Calling LLM API for completion (model: %s, max_tokens: %d)", s_model, max_tokens);
+    return llm_chat_post(&body, "LLM completion", resp);
+}
 
-    ESP_LOGI(TAG, "Calling LLM API with tools (provider: %s, model: %s, body: %d bytes)",
-             s_provider, s_model, (int)strlen(post_data));
-    llm_log_payload("LLM tools request", post_data);
+/* ── Public: chat with tools (streaming) ──────────────────────── */
 
-    /* HTTP call */
-    resp_buf_t rb;
-    if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
-        free(post_data);
-        return ESP_ERR_NO_MEM;
-    }
+esp_err_t llm_chat_tools_stream(const char *system_prompt,
+                                size_t stable_len,
+                                cJSON *messages,
+                                const char *tools_json,
+                                llm_stream_cb_t on_text,
+                                void *user_ctx,
+                                llm_response_t *resp)
+{
+    memset(resp, 0, sizeof(*resp));
 
-    int status = 0;
-    esp_err_t err = llm_http_call(post_data, &rb, &status);
-    free(post_data);
+    if (!llm_has_credentials()) return ESP_ERR_INVALID_STATE;
 
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
-        llm_log_payload("LLM tools partial response", rb.data);
-        resp_buf_free(&rb);
-        return err;
-    }
+    llm_body_t body;
+    llm_body_prepare(&body, system_prompt, stable_len, messages, tools_json, true);
 
-    llm_log_payload("LLM tools raw response", rb.data);
+    ESP_LOGI(TAG, "Calling LLM API streaming (provider: %s, model: %s)", s_provider, s_model);
 
-    if (status != 200) {
-        ESP_LOGE(TAG, "API error %d: %.500s", status, rb.data ? rb.data : "");
-        resp_buf_free(&rb);
-        return ESP_FAIL;
+    stream_ctx_t *sc = heap_caps_calloc(1, sizeof(*sc), MALLOC_CAP_SPIRAM);
+    llm_stream_t *stream = heap_caps_calloc(1, sizeof(*stream), MALLOC_CAP_SPIRAM);
+    if (!sc || !stream) {
+        free(sc);
+        free(stream);
+        llm_body_release(&body);
+        return ESP_ERR_NO_MEM;
     }
+    llm_stream_init(stream, provider_is_openai() ? LLM_STREAM_FMT_OPENAI : LLM_STREAM_FMT_ANTHROPIC,
+                    resp, on_text, user_ctx);
+    sc->stream = stream;
 
-    /* Parse full JSON response */
-    cJSON *root = cJSON_Parse(rb.data);
-    resp_buf_free(&rb);
+    int status = 0;
+    esp_err_t err = llm_http_post(&body, "LLM stream request", stream_on_body, sc, &status);
+    llm_body_release(&body);
 
-    if (!root) {
-        ESP_LOGE(TAG, "Failed to parse API response JSON");
-        return ESP_FAIL;
+    if (err == ESP_OK && status != 200) {
+        ESP_LOGE(TAG, "API error %d: %s", status, sc->err_body);
+        err = ESP_FAIL;
     }
-
-    if (provider_is_openai()) {
-        cJSON *choices = cJSON_GetObjectItem(root, "choices");
-        cJSON *choice0 = choices && cJSON_IsArray(choices) ? cJSON_GetArrayItem(choices, 0) : NULL;
-        if (choice0) {
-            cJSON *finish = cJSON_GetObjectItem(choice0, "finish_reason");
-            if (finish && cJSON_IsString(finish)) {
-                resp->tool_use = (strcmp(finish->valuestring, "tool_calls") == 0);
-            }
-
-            cJSON *message = cJSON_GetObjectItem(choice0, "message");
-            if (message) {
-                cJSON *content = cJSON_GetObjectItem(message, "content");
-                if (content && cJSON_IsString(content)) {
-                    size_t tlen = strlen(content->valuestring);
-                    resp->text = calloc(1, tlen + 1);
-                    if (resp->text) {
-                        memcpy(resp->text, content->valuestring, tlen);
-                        resp->text_len = tlen;
-                    }
-                }
-
-                cJSON *tool_calls = cJSON_GetObjectItem(message, "tool_calls");
-                if (tool_calls && cJSON_IsArray(tool_calls)) {
-                    cJSON *tc;
-                    cJSON_ArrayForEach(tc, tool_calls) {
-                        if (resp->call_count >= MIMI_MAX_TOOL_CALLS) break;
-                        llm_tool_call_t *call = &resp->calls[resp->call_count];
-                        cJSON *id = cJSON_GetObjectItem(tc, "id");
-                        cJSON *func = cJSON_GetObjectItem(tc, "function");
-                        if (id && cJSON_IsString(id)) {
-                            strncpy(call->id, id->valuestring, sizeof(call->id) - 1);
-                        }
-                        if (func) {
-                            cJSON *name = cJSON_GetObjectItem(func, "name");
-                            cJSON *args = cJSON_GetObjectItem(func, "arguments");
-                            if (name && cJSON_IsString(name)) {
-                                strncpy(call->name, name->valuestring, sizeof(call->name) - 1);
-                            }
-                            if (args && cJSON_IsString(args)) {
-                                call->input = strdup(args->valuestring);
-                                if (call->input) {
-                                    call->input_len = strlen(call->input);
-                                }
-                            }
-                        }
-                        resp->call_count++;
-                    }
-                    if (resp->call_count > 0) {
-                        resp->tool_use = true;
-                    }
-                }
-            }
-        }
+    if (err == ESP_OK) {
+        err = llm_stream_finish(stream);
     } else {
-        /* stop_reason */
-        cJSON *stop_reason = cJSON_GetObjectItem(root, "stop_reason");
-        if (stop_reason && cJSON_IsString(stop_reason)) {
-            resp->tool_use = (strcmp(stop_reason->valuestring, "tool_use") == 0);
-        }
-
-        /* Iterate content blocks */
-        cJSON *content = cJSON_GetObjectItem(root, "content");
-        if (content && cJSON_IsArray(content)) {
-            /* Accumulate total text length first */
-            size_t total_text = 0;
-            cJSON *block;
-            cJSON_ArrayForEach(block, content) {
-                cJSON *btype = cJSON_GetObjectItem(block, "type");
-                if (btype && strcmp(btype->valuestring, "text") == 0) {
-                    cJSON *text = cJSON_GetObjectItem(block, "text");
-                    if (text && cJSON_IsString(text)) {
-                        total_text += strlen(text->valuestring);
-                    }
-                }
-            }
+        ESP_LOGE(TAG, "Streaming request failed: %s", esp_err_to_name(err));
+    }
 
-            /* Allocate and copy text */
-            if (total_text > 0) {
-                resp->text = calloc(1, total_text + 1);
-                if (resp->text) {
-                    cJSON_ArrayForEach(block, content) {
-                        cJSON *btype = cJSON_GetObjectItem(block, "type");
-                        if (!btype || strcmp(btype->valuestring, "text") != 0) continue;
-                        cJSON *text = cJSON_GetObjectItem(block, "text");
-                        if (!text || !cJSON_IsString(text)) continue;
-                        size_t tlen = strlen(text->valuestring);
-                        memcpy(resp->text + resp->text_len, text->valuestring, tlen);
-                        resp->text_len += tlen;
-                    }
-                    resp->text[resp->text_len] = '\0';
-                }
-            }
+    free(stream);
+    free(sc);
 
-            /* Extract tool_use blocks */
-            cJSON_ArrayForEach(block, content) {
-                cJSON *btype = cJSON_GetObjectItem(block, "type");
-                if (!btype || strcmp(btype->valuestring, "tool_use") != 0) continue;
-                if (resp->call_count >= MIMI_MAX_TOOL_CALLS) break;
-
-                llm_tool_call_t *call = &resp->calls[resp->call_count];
-
-                cJSON *id = cJSON_GetObjectItem(block, "id");
-                if (id && cJSON_IsString(id)) {
-                    strncpy(call->id, id->valuestring, sizeof(call->id) - 1);
-                }
-
-                cJSON *name = cJSON_GetObjectItem(block, "name");
-                if (name && cJSON_IsString(name)) {
-                    strncpy(call->name, name->valuestring, sizeof(call->name) - 1);
-                }
-
-                cJSON *input = cJSON_GetObjectItem(block, "input");
-                if (input) {
-                    char *input_str = cJSON_PrintUnformatted(input);
-                    if (input_str) {
-                        call->input = input_str;
-                        call->input_len = strlen(input_str);
-                    }
-                }
-
-                resp->call_count++;
-            }
-        }
+    if (err != ESP_OK) {
+        llm_response_free(resp);
+        return err;
     }
 
-    cJSON_Delete(root);
-
-    ESP_LOGI(TAG, "Response: %d bytes text, %d tool calls, stop=%s",
+    ESP_LOGI(TAG, "Stream response: %d bytes text, %d tool calls, stop=%s",
              (int)resp->text_len, resp->call_count,
              resp->tool_use ? "tool_use" : "end_turn");
-
+    ESP_LOGI(TAG, "Usage: in=%u out=%u cache_read=%u cache_write=%u",
+             (unsigned)resp->usage.input_tokens, (unsigned)resp->usage.output_tokens,
+             (unsigned)resp->usage.cache_read_tokens, (unsigned)resp->usage.cache_creation_tokens);
     return ESP_OK;
 }
 
@@ -758,3 +1013,54 @@ esp_err_t llm_set_provider(const char *provider)
     ESP_LOGI(TAG, "Provider set to: %s", s_provider);
     return ESP_OK;
 }
+
+esp_err_t llm_set_endpoint(const char *url, const char *auth, int max_tokens)
+{
+    if (!url || !api_url_valid(url)) {
+        ESP_LOGE(TAG, "Endpoint must be http://host[:port]/path or https://...");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (auth && auth[0] && !auth_style_valid(auth)) {
+        ESP_LOGE(TAG, "Auth style must be bearer, x-api-key or none");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (max_tokens < 0) return ESP_ERR_INVALID_ARG;
+
+    char tok_str[12];
+    snprintf(tok_str, sizeof(tok_str), "%d", max_tokens);
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) return err;
+    err = nvs_set_str(nvs, MIMI_NVS_KEY_LLM_URL, url);
+    if (err == ESP_OK) err = nvs_set_str(nvs, MIMI_NVS_KEY_LLM_AUTH, auth ? auth : "");
+    if (err == ESP_OK) err = nvs_set_str(nvs, MIMI_NVS_KEY_LLM_MAX_TOKENS, max_tokens > 0 ? tok_str : "");
+    if (err == ESP_OK) err = nvs_commit(nvs);
+    nvs_close(nvs);
+    if (err != ESP_OK) return err;
+
+    safe_copy(s_api_url, sizeof(s_api_url), url);
+    safe_copy(s_auth_style, sizeof(s_auth_style), auth);
+    s_max_tokens = max_tokens;
+    ESP_LOGI(TAG, "Endpoint set to: %s (auth: %s, max_tokens: %d)",
+             s_api_url, llm_auth_style(), llm_max_tokens());
+    return ESP_OK;
+}
+
+esp_err_t llm_clear_endpoint(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_erase_key(nvs, MIMI_NVS_KEY_LLM_URL);
+        nvs_erase_key(nvs, MIMI_NVS_KEY_LLM_AUTH);
+        nvs_erase_key(nvs, MIMI_NVS_KEY_LLM_MAX_TOKENS);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+
+    s_api_url[0] = '\0';
+    s_auth_style[0] = '\0';
+    s_max_tokens = 0;
+    ESP_LOGI(TAG, "Endpoint reset to provider default: %s", llm_api_url());
+    return ESP_OK;
+}
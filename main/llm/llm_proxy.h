@@ -3,6 +3,7 @@
 #include "esp_err.h"
 #include "cJSON.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #include "mimi_config.h"
@@ -27,6 +28,23 @@ esp_err_t llm_set_provider(const char *provider);
  */
 esp_err_t llm_set_model(const char *model);
 
+/**
+ * Point the configured provider's wire format at a custom endpoint and save
+ * it to NVS, e.g. a llama.cpp / vLLM server on the LAN with provider "openai".
+ *
+ * @param url         Full request URL: http(s)://host[:port]/path. Plain
+ *                    http:// is connected directly, without TLS or proxy.
+ * @param auth        "bearer", "x-api-key", "none", or NULL/"" for the
+ *                    provider default
+ * @param max_tokens  Completion limit, 0 = MIMI_LLM_MAX_TOKENS
+ */
+esp_err_t llm_set_endpoint(const char *url, const char *auth, int max_tokens);
+
+/**
+ * Remove the custom endpoint from NVS and go back to the provider default.
+ */
+esp_err_t llm_clear_endpoint(void);
+
 /* ── Tool Use Support ──────────────────────────────────────────── */
 
 typedef struct {
@@ -36,26 +54,68 @@ typedef struct {
     size_t input_len;
 } llm_tool_call_t;
 
+/* Token accounting reported by the API (0 when the provider omits a field) */
+typedef struct {
+    uint32_t input_tokens;                       /* uncached input */
+    uint32_t output_tokens;
+    uint32_t cache_read_tokens;                  /* input served from the prompt cache */
+    uint32_t cache_creation_tokens;              /* input written to the prompt cache */
+} llm_usage_t;
+
 typedef struct {
     char *text;                                  /* accumulated text blocks */
     size_t text_len;
     llm_tool_call_t calls[MIMI_MAX_TOOL_CALLS];
     int call_count;
     bool tool_use;                               /* stop_reason == "tool_use" */
+    llm_usage_t usage;
 } llm_response_t;
 
 void llm_response_free(llm_response_t *resp);
 
+/**
+ * Streaming text callback. Called from the HTTP task for every text delta,
+ * in order, as soon as it is decoded. delta is not NUL-terminated.
+ */
+typedef void (*llm_stream_cb_t)(const char *delta, size_t len, void *user_ctx);
+
 /**
  * Send a chat completion request with tools to the configured LLM API (non-streaming).
  *
  * @param system_prompt  System prompt string
+ * @param stable_len     Length of the system prompt prefix that is the same every
+ *                       turn; with MIMI_LLM_PROMPT_CACHE it gets its own cache
+ *                       breakpoint (Anthropic). 0 = no system breakpoint.
  * @param messages       cJSON array of messages (caller owns)
  * @param tools_json     Pre-built JSON string of tools array, or NULL for no tools
  * @param resp           Output: structured response with text and tool calls
  * @return ESP_OK on success
  */
 esp_err_t llm_chat_tools(const char *system_prompt,
+                         size_t stable_len,
                          cJSON *messages,
                          const char *tools_json,
                          llm_response_t *resp);
+
+/**
+ * Plain completion without tools, for internal housekeeping such as
+ * history summaries: no cache breakpoint, output capped at max_tokens
+ * (0 = the configured limit). Same endpoint and model as the agent.
+ */
+esp_err_t llm_complete(const char *system_prompt, cJSON *messages, int max_tokens, llm_response_t *resp);
+
+/**
+ * Same as llm_chat_tools(), but requests a server-sent-events stream
+ * ("stream": true) and builds resp incrementally from the event stream.
+ * Only a fixed-size working buffer is held for the wire data.
+ *
+ * @param on_text   Optional callback for text deltas as they arrive
+ * @param user_ctx  Passed through to on_text
+ */
+esp_err_t llm_chat_tools_stream(const char *system_prompt,
+                                size_t stable_len,
+                                cJSON *messages,
+                                const char *tools_json,
+                                llm_stream_cb_t on_text,
+                                void *user_ctx,
+                                llm_response_t *resp);
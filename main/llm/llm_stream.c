@@ -0,0 +1,327 @@
+#include "llm_stream.h"
+#include "agent/turn_arena.h"
+
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+
+static const char *TAG = "llm_stream";
+
+#define STREAM_GROW_MIN 256
+
+/* ── Growable output strings (PSRAM) ──────────────────────────── */
+
+static esp_err_t str_append(char **dst, size_t *len, size_t *cap, const char *src, size_t n)
+{
+    if (n == 0) return ESP_OK;
+    if (*len + n + 1 > *cap) {
+        size_t new_cap = *cap ? *cap : STREAM_GROW_MIN;
+        while (*len + n + 1 > new_cap) new_cap *= 2;
+        char *tmp = heap_caps_realloc(*dst, new_cap, MALLOC_CAP_SPIRAM);
+        if (!tmp) return ESP_ERR_NO_MEM;
+        *dst = tmp;
+        *cap = new_cap;
+    }
+    memcpy(*dst + *len, src, n);
+    *len += n;
+    (*dst)[*len] = '\0';
+    return ESP_OK;
+}
+
+static esp_err_t emit_text(llm_stream_t *s, const char *text, size_t n)
+{
+    llm_response_t *resp = s->resp;
+    esp_err_t err = str_append(&resp->text, &resp->text_len, &s->text_cap, text, n);
+    if (err == ESP_OK && s->on_text && n > 0) {
+        s->on_text(text, n, s->user_ctx);
+    }
+    return err;
+}
+
+static esp_err_t emit_input(llm_stream_t *s, int call_idx, const char *json, size_t n)
+{
+    llm_tool_call_t *call = &s->resp->calls[call_idx];
+    return str_append(&call->input, &call->input_len, &s->input_cap[call_idx], json, n);
+}
+
+static int open_call(llm_stream_t *s, const char *id, const char *name)
+{
+    llm_response_t *resp = s->resp;
+    if (resp->call_count >= MIMI_MAX_TOOL_CALLS) {
+        ESP_LOGW(TAG, "Dropping tool call %s: limit %d reached", name ? name : "?", MIMI_MAX_TOOL_CALLS);
+        return -1;
+    }
+    llm_tool_call_t *call = &resp->calls[resp->call_count];
+    if (id) strncpy(call->id, id, sizeof(call->id) - 1);
+    if (name) strncpy(call->name, name, sizeof(call->name) - 1);
+    return resp->call_count++;
+}
+
+/* Copy the token counters present in a usage object; absent fields are kept */
+static void read_usage(llm_usage_t *u, const cJSON *usage)
+{
+    static const struct {
+        const char *key;
+        size_t off;
+    } fields[] = {
+        { "input_tokens",                offsetof(llm_usage_t, input_tokens) },
+        { "prompt_tokens",               offsetof(llm_usage_t, input_tokens) },
+        { "output_tokens",               offsetof(llm_usage_t, output_tokens) },
+        { "completion_tokens",           offsetof(llm_usage_t, output_tokens) },
+        { "cache_read_input_tokens",     offsetof(llm_usage_t, cache_read_tokens) },
+        { "cache_creation_input_tokens", offsetof(llm_usage_t, cache_creation_tokens) },
+    };
+    if (!cJSON_IsObject(usage)) return;
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        cJSON *v = cJSON_GetObjectItem(usage, fields[i].key);
+        if (cJSON_IsNumber(v)) {
+            *(uint32_t *)((char *)u + fields[i].off) = (uint32_t)v->valuedouble;
+        }
+    }
+    cJSON *details = cJSON_GetObjectItem(usage, "prompt_tokens_details");
+    cJSON *cached = cJSON_GetObjectItem(details, "cached_tokens");
+    if (cJSON_IsNumber(cached)) {
+        u->cache_read_tokens = (uint32_t)cached->valuedouble;
+        if (u->input_tokens >= u->cache_read_tokens) u->input_tokens -= u->cache_read_tokens;
+    }
+}
+
+/* ── Anthropic event handling ─────────────────────────────────── */
+
+static esp_err_t handle_anthropic(llm_stream_t *s, cJSON *ev)
+{
+    const char *type = cJSON_GetStringValue(cJSON_GetObjectItem(ev, "type"));
+    if (!type) return ESP_OK;
+
+    if (strcmp(type, "message_start") == 0) {
+        /* Input and cache counters arrive up front */
+        read_usage(&s->resp->usage, cJSON_GetObjectItem(cJSON_GetObjectItem(ev, "message"), "usage"));
+    } else if (strcmp(type, "content_block_start") == 0) {
+        cJSON *idx = cJSON_GetObjectItem(ev, "index");
+        cJSON *block = cJSON_GetObjectItem(ev, "content_block");
+        const char *btype = cJSON_GetStringValue(cJSON_GetObjectItem(block, "type"));
+        if (!cJSON_IsNumber(idx) || !btype) return ESP_OK;
+
+        int bi = idx->valueint;
+        if (strcmp(btype, "tool_use") == 0 && bi >= 0 && bi < MIMI_LLM_SSE_MAX_BLOCKS) {
+            s->block_call[bi] = open_call(s,
+                cJSON_GetStringValue(cJSON_GetObjectItem(block, "id")),
+                cJSON_GetStringValue(cJSON_GetObjectItem(block, "name")));
+        } else if (strcmp(btype, "text") == 0) {
+            const char *text = cJSON_GetStringValue(cJSON_GetObjectItem(block, "text"));
+            if (text) return emit_text(s, text, strlen(text));
+        }
+    } else if (strcmp(type, "content_block_delta") == 0) {
+        cJSON *idx = cJSON_GetObjectItem(ev, "index");
+        cJSON *delta = cJSON_GetObjectItem(ev, "delta");
+        const char *dtype = cJSON_GetStringValue(cJSON_GetObjectItem(delta, "type"));
+        if (!dtype) return ESP_OK;
+
+        if (strcmp(dtype, "text_delta") == 0) {
+            const char *text = cJSON_GetStringValue(cJSON_GetObjectItem(delta, "text"));
+            if (text) return emit_text(s, text, strlen(text));
+        } else if (strcmp(dtype, "input_json_delta") == 0 && cJSON_IsNumber(idx)) {
+            int bi = idx->valueint;
+            const char *part = cJSON_GetStringValue(cJSON_GetObjectItem(delta, "partial_json"));
+            if (part && bi >= 0 && bi < MIMI_LLM_SSE_MAX_BLOCKS && s->block_call[bi] >= 0) {
+                return emit_input(s, s->block_call[bi], part, strlen(part));
+            }
+        }
+    } else if (strcmp(type, "message_delta") == 0) {
+        cJSON *delta = cJSON_GetObjectItem(ev, "delta");
+        const char *stop = cJSON_GetStringValue(cJSON_GetObjectItem(delta, "stop_reason"));
+        if (stop) {
+            s->resp->tool_use = (strcmp(stop, "tool_use") == 0);
+        }
+        read_usage(&s->resp->usage, cJSON_GetObjectItem(ev, "usage"));
+    } else if (strcmp(type, "message_stop") == 0) {
+        s->done = true;
+    } else if (strcmp(type, "error") == 0) {
+        cJSON *error = cJSON_GetObjectItem(ev, "error");
+        const char *msg = cJSON_GetStringValue(cJSON_GetObjectItem(error, "message"));
+        ESP_LOGE(TAG, "Stream error event: %s", msg ? msg : "(no message)");
+        return ESP_FAIL;
+    }
+    /* content_block_stop, ping: nothing to do */
+    return ESP_OK;
+}
+
+/* ── OpenAI chunk handling ────────────────────────────────────── */
+
+static esp_err_t handle_openai(llm_stream_t *s, cJSON *ev)
+{
+    cJSON *error = cJSON_GetObjectItem(ev, "error");
+    if (error) {
+        const char *msg = cJSON_GetStringValue(cJSON_GetObjectItem(error, "message"));
+        ESP_LOGE(TAG, "Stream error chunk: %s", msg ? msg : "(no message)");
+        return ESP_FAIL;
+    }
+
+    /* Final chunk when the server includes usage in streams */
+    read_usage(&s->resp->usage, cJSON_GetObjectItem(ev, "usage"));
+
+    cJSON *choices = cJSON_GetObjectItem(ev, "choices");
+    cJSON *choice0 = cJSON_IsArray(choices) ? cJSON_GetArrayItem(choices, 0) : NULL;
+    if (!choice0) return ESP_OK;
+
+    cJSON *delta = cJSON_GetObjectItem(choice0, "delta");
+    const char *content = cJSON_GetStringValue(cJSON_GetObjectItem(delta, "content"));
+    if (content) {
+        esp_err_t err = emit_text(s, content, strlen(content));
+        if (err != ESP_OK) return err;
+    }
+
+    cJSON *tool_calls = cJSON_GetObjectItem(delta, "tool_calls");
+    cJSON *tc;
+    cJSON_ArrayForEach(tc, tool_calls) {
+        cJSON *idx = cJSON_GetObjectItem(tc, "index");
+        cJSON *func = cJSON_GetObjectItem(tc, "function");
+        int ci = cJSON_IsNumber(idx) ? idx->valueint : 0;
+        if (ci < 0 || ci >= MIMI_MAX_TOOL_CALLS) continue;
+
+        /* A new index opens the call; later chunks only carry argument fragments */
+        while (s->resp->call_count <= ci) {
+            if (open_call(s, NULL, NULL) < 0) break;
+        }
+        if (ci >= s->resp->call_count) continue;
+
+        llm_tool_call_t *call = &s->resp->calls[ci];
+        const char *id = cJSON_GetStringValue(cJSON_GetObjectItem(tc, "id"));
+        const char *name = cJSON_GetStringValue(cJSON_GetObjectItem(func, "name"));
+        const char *args = cJSON_GetStringValue(cJSON_GetObjectItem(func, "arguments"));
+        if (id && !call->id[0]) strncpy(call->id, id, sizeof(call->id) - 1);
+        if (name && !call->name[0]) strncpy(call->name, name, sizeof(call->name) - 1);
+        if (args) {
+            esp_err_t err = emit_input(s, ci, args, strlen(args));
+            if (err != ESP_OK) return err;
+        }
+    }
+
+    const char *finish = cJSON_GetStringValue(cJSON_GetObjectItem(choice0, "finish_reason"));
+    if (finish) {
+        s->resp->tool_use = (strcmp(finish, "tool_calls") == 0);
+    }
+    return ESP_OK;
+}
+
+/* ── SSE framing ──────────────────────────────────────────────── */
+
+static void dispatch_event(llm_stream_t *s)
+{
+    size_t n = s->data_len;
+    s->data_len = 0;
+
+    if (s->overflow) {
+        /* Skipping it would lose text or tool input silently: fail the request instead */
+        ESP_LOGE(TAG, "SSE event larger than %d bytes, aborting stream", MIMI_LLM_SSE_BUF_SIZE);
+        s->overflow = false;
+        if (s->error == ESP_OK) s->error = ESP_ERR_INVALID_SIZE;
+        return;
+    }
+    if (n == 0 || s->error != ESP_OK) return;
+
+    if (n == 6 && memcmp(s->buf, "[DONE]", 6) == 0) {
+        s->done = true;
+        return;
+    }
+
+    /* Events are parsed and dropped one at a time: give their arena space back */
+    turn_arena_mark_t mark = turn_arena_mark();
+    cJSON *ev = cJSON_ParseWithLength(s->buf, n);
+    if (!ev) {
+        ESP_LOGW(TAG, "Unparseable SSE data (%u bytes)", (unsigned)n);
+        turn_arena_release(&mark);
+        return;
+    }
+
+    s->error = (s->format == LLM_STREAM_FMT_OPENAI) ? handle_openai(s, ev) : handle_anthropic(s, ev);
+    cJSON_Delete(ev);
+    turn_arena_release(&mark);
+}
+
+/* Process the complete line sitting at buf[data_len .. data_len + line_len) */
+static void process_line(llm_stream_t *s)
+{
+    char *line = s->buf + s->data_len;
+    size_t n = s->line_len;
+    s->line_len = 0;
+
+    if (n > 0 && line[n - 1] == '\r') n--;
+
+    if (n == 0) {
+        dispatch_event(s);
+        return;
+    }
+
+    /* Only the data field matters: event names are repeated inside the JSON payload */
+    if (n < 5 || memcmp(line, "data:", 5) != 0 || s->overflow) return;
+
+    size_t skip = (n > 5 && line[5] == ' ') ? 6 : 5;
+    size_t payload = n - skip;
+    size_t sep = (s->data_len > 0) ? 1 : 0;
+
+    /* Multi-line data fields are joined with '\n' per the SSE spec */
+    if (sep) line[0] = '\n';
+    memmove(line + sep, line + skip, payload);
+    s->data_len += sep + payload;
+}
+
+void llm_stream_init(llm_stream_t *s, llm_stream_format_t format, llm_response_t *resp,
+                     llm_stream_cb_t on_text, void *user_ctx)
+{
+    memset(s, 0, sizeof(*s));
+    for (int i = 0; i < MIMI_LLM_SSE_MAX_BLOCKS; i++) s->block_call[i] = -1;
+    s->error = ESP_OK;
+
+    s->format = format;
+    s->resp = resp;
+    s->on_text = on_text;
+    s->user_ctx = user_ctx;
+    memset(resp, 0, sizeof(*resp));
+}
+
+esp_err_t llm_stream_feed(llm_stream_t *s, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len && s->error == ESP_OK; i++) {
+        char c = data[i];
+        if (c == '\n') {
+            process_line(s);
+            continue;
+        }
+        if (s->data_len + s->line_len >= sizeof(s->buf)) {
+            /* Event does not fit the working buffer: drop it, keep framing in sync */
+            s->overflow = true;
+            s->data_len = 0;
+            s->line_len = 0;
+        }
+        s->buf[s->data_len + s->line_len++] = c;
+    }
+    return s->error;
+}
+
+esp_err_t llm_stream_finish(llm_stream_t *s)
+{
+    if (s->line_len > 0) process_line(s);
+    dispatch_event(s);
+
+    llm_response_t *resp = s->resp;
+    for (int i = 0; i < resp->call_count; i++) {
+        if (!resp->calls[i].input) {
+            emit_input(s, i, "{}", 2);
+        }
+    }
+    if (s->format == LLM_STREAM_FMT_OPENAI && resp->call_count > 0) {
+        resp->tool_use = true;
+    }
+
+    if (s->error != ESP_OK) return s->error;
+    if (!s->done) {
+        ESP_LOGW(TAG, "Stream ended without terminal event");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "mimi_config.h"
+#include "llm/llm_proxy.h"
+
+/* ── Incremental SSE parser for streaming LLM responses ───────── */
+
+typedef enum {
+    LLM_STREAM_FMT_ANTHROPIC = 0,   /* message_start / content_block_* / message_delta events */
+    LLM_STREAM_FMT_OPENAI,          /* chat.completion.chunk objects + [DONE] */
+} llm_stream_format_t;
+
+typedef struct {
+    llm_stream_format_t format;
+    llm_response_t *resp;
+    llm_stream_cb_t on_text;
+    void *user_ctx;
+
+    /* Fixed working buffer: committed event data followed by the partial line */
+    char buf[MIMI_LLM_SSE_BUF_SIZE];
+    size_t data_len;                             /* bytes of committed "data:" payload */
+    size_t line_len;                             /* bytes of the current partial line */
+    bool overflow;                               /* current event exceeded buf, skip it */
+
+    size_t text_cap;
+    size_t input_cap[MIMI_MAX_TOOL_CALLS];
+    int block_call[MIMI_LLM_SSE_MAX_BLOCKS];     /* Anthropic block index -> call index */
+
+    bool done;                                   /* message_stop / [DONE] seen */
+    esp_err_t error;
+} llm_stream_t;
+
+/**
+ * Reset a stream parser. resp is zeroed and filled as events arrive.
+ * on_text (optional) is called for every text delta.
+ */
+void llm_stream_init(llm_stream_t *s, llm_stream_format_t format, llm_response_t *resp,
+                     llm_stream_cb_t on_text, void *user_ctx);
+
+/**
+ * Feed raw response body bytes (any fragmentation).
+ * Returns the first error reported by the stream, ESP_OK otherwise.
+ */
+esp_err_t llm_stream_feed(llm_stream_t *s, const char *data, size_t len);
+
+/**
+ * Flush the trailing event and finalize resp (empty tool inputs become "{}").
+ * Returns ESP_ERR_INVALID_RESPONSE if the stream ended before its terminal event.
+ */
+esp_err_t llm_stream_finish(llm_stream_t *s);
@@ -0,0 +1,193 @@
+#include "session_compact.h"
+#include "session_log.h"
+#include "mimi_config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "session_compact";
+
+typedef struct {
+    char chat_id[32];
+    size_t bytes;
+} compact_chat_t;
+
+static TaskHandle_t s_task;
+static SemaphoreHandle_t s_lock;
+static session_compact_stats_t s_stats;
+
+/* Chat ids of "tg_<id>.<ext>" names, NULL if the name does not match */
+static const char *chat_of(const char *name, const char *ext, char *buf, size_t size)
+{
+    size_t len = strlen(name), ext_len = strlen(ext);
+    if (strncmp(name, "tg_", 3) != 0 || len <= 3 + ext_len || strcmp(name + len - ext_len, ext) != 0) {
+        return NULL;
+    }
+    size_t id_len = len - 3 - ext_len;
+    if (id_len >= size) return NULL;
+    memcpy(buf, name + 3, id_len);
+    buf[id_len] = '\0';
+    return buf;
+}
+
+/* Collect every session log; legacy JSONL files are converted on the way */
+static int scan_chats(compact_chat_t **out, uint32_t *migrated)
+{
+    int count = 0, cap = 0;
+    compact_chat_t *chats = NULL;
+    char id[32];
+
+    DIR *dir = opendir(MIMI_SPIFFS_SESSION_DIR);
+    if (!dir) dir = opendir(MIMI_SPIFFS_BASE);      /* SPIFFS is flat */
+    if (!dir) return 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = strrchr(entry->d_name, '/');
+        name = name ? name + 1 : entry->d_name;
+        if (chat_of(name, ".jsonl", id, sizeof(id))) {
+            if (session_log_migrate(id) == ESP_OK) (*migrated)++;
+            continue;
+        }
+        if (!chat_of(name, ".log", id, sizeof(id))) continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            compact_chat_t *tmp = heap_caps_realloc(chats, cap * sizeof(*chats), MALLOC_CAP_SPIRAM);
+            if (!tmp) break;
+            chats = tmp;
+        }
+        strcpy(chats[count].chat_id, id);
+        chats[count].bytes = 0;
+        count++;
+    }
+    closedir(dir);
+    *out = chats;
+    return count;
+}
+
+static int by_size_desc(const void *a, const void *b)
+{
+    size_t sa = ((const compact_chat_t *)a)->bytes;
+    size_t sb = ((const compact_chat_t *)b)->bytes;
+    return sa < sb ? 1 : (sa > sb ? -1 : 0);
+}
+
+static void compact_pass(void)
+{
+    int64_t start_us = esp_timer_get_time();
+    uint32_t compactions = 0, migrated = 0;
+    uint64_t reclaimed_total = 0;
+    size_t total = 0;
+
+    compact_chat_t *chats = NULL;
+    int count = scan_chats(&chats, &migrated);
+
+    /* Per chat: record count and byte quota */
+    for (int i = 0; i < count; i++) {
+        int recs;
+        size_t bytes;
+        if (session_log_stat(chats[i].chat_id, &recs, &bytes) != ESP_OK) continue;
+        if (recs > MIMI_SESSION_KEEP_RECS + MIMI_SESSION_COMPACT_SLACK || bytes > MIMI_SESSION_CHAT_QUOTA) {
+            size_t reclaimed = 0;
+            if (session_log_compact(chats[i].chat_id, MIMI_SESSION_KEEP_RECS, MIMI_SESSION_CHAT_QUOTA,
+                                    MIMI_SESSION_COMPACT_SUMMARY, &reclaimed) == ESP_OK && reclaimed > 0) {
+                compactions++;
+                reclaimed_total += reclaimed;
+                bytes -= reclaimed;
+            }
+        }
+        chats[i].bytes = bytes;
+        total += bytes;
+    }
+
+    /* Global quota: cut the largest chats down to what a turn actually loads */
+    if (total > MIMI_SESSION_TOTAL_QUOTA) {
+        qsort(chats, count, sizeof(*chats), by_size_desc);
+        for (int i = 0; i < count && total > MIMI_SESSION_TOTAL_QUOTA; i++) {
+            size_t reclaimed = 0;
+            if (session_log_compact(chats[i].chat_id, MIMI_SESSION_MAX_MSGS, MIMI_SESSION_CHAT_QUOTA,
+                                    MIMI_SESSION_COMPACT_SUMMARY, &reclaimed) == ESP_OK && reclaimed > 0) {
+                compactions++;
+                reclaimed_total += reclaimed;
+                total -= reclaimed;
+            }
+        }
+        if (total > MIMI_SESSION_TOTAL_QUOTA) {
+            ESP_LOGW(TAG, "Sessions still use %u bytes (quota %u)",
+                     (unsigned)total, (unsigned)MIMI_SESSION_TOTAL_QUOTA);
+        }
+    }
+    free(chats);
+
+    int64_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.passes++;
+    s_stats.compactions += compactions;
+    s_stats.migrations += migrated;
+    s_stats.bytes_reclaimed += reclaimed_total;
+    s_stats.time_ms_total += elapsed_ms;
+    s_stats.last_pass_ms = elapsed_ms;
+    s_stats.chats = count;
+    s_stats.total_bytes = total;
+    xSemaphoreGive(s_lock);
+
+    if (compactions || migrated) {
+        ESP_LOGI(TAG, "Pass: %d chats, %u compacted, %u migrated, %llu bytes reclaimed in %lld ms",
+                 count, (unsigned)compactions, (unsigned)migrated,
+                 (unsigned long long)reclaimed_total, (long long)elapsed_ms);
+    }
+}
+
+static void compact_task(void *arg)
+{
+    (void)arg;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MIMI_SESSION_COMPACT_FIRST_MS));
+    while (1) {
+        compact_pass();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MIMI_SESSION_COMPACT_INTERVAL_MS));
+    }
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+esp_err_t session_compact_start(void)
+{
+    if (s_task) return ESP_OK;
+
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreatePinnedToCore(compact_task, "sess_compact", MIMI_SESSION_COMPACT_STACK, NULL,
+                                MIMI_SESSION_COMPACT_PRIO, &s_task, MIMI_SESSION_COMPACT_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create compaction task");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Session compaction every %d s (keep %d records, %d KB per chat, %d KB total)",
+             MIMI_SESSION_COMPACT_INTERVAL_MS / 1000, MIMI_SESSION_KEEP_RECS,
+             MIMI_SESSION_CHAT_QUOTA / 1024, MIMI_SESSION_TOTAL_QUOTA / 1024);
+    return ESP_OK;
+}
+
+void session_compact_kick(void)
+{
+    if (s_task) xTaskNotifyGive(s_task);
+}
+
+void session_compact_get_stats(session_compact_stats_t *out)
+{
+    if (!s_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
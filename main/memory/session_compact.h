@@ -0,0 +1,34 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* ── Background session compaction ────────────────────────────── */
+
+typedef struct {
+    uint32_t passes;
+    uint32_t compactions;           /* logs rewritten */
+    uint32_t migrations;            /* legacy JSONL files converted */
+    uint64_t bytes_reclaimed;
+    int64_t time_ms_total;          /* spent in passes */
+    int64_t last_pass_ms;
+    int chats;                      /* session logs seen by the last pass */
+    size_t total_bytes;             /* their size after the last pass */
+} session_compact_stats_t;
+
+/**
+ * Start the low-priority compaction task. Every MIMI_SESSION_COMPACT_INTERVAL_MS
+ * it converts leftover JSONL sessions, trims logs that exceed
+ * MIMI_SESSION_KEEP_RECS records or MIMI_SESSION_CHAT_QUOTA bytes, then
+ * shrinks the largest logs while all sessions together exceed
+ * MIMI_SESSION_TOTAL_QUOTA.
+ */
+esp_err_t session_compact_start(void);
+
+/**
+ * Run a pass now instead of waiting for the interval.
+ */
+void session_compact_kick(void);
+
+void session_compact_get_stats(session_compact_stats_t *out);
@@ -0,0 +1,612 @@
+#include "session_log.h"
+#include "mimi_config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+
+static const char *TAG = "session_log";
+
+#define LOG_MAGIC       "MSL1"
+#define LOG_MAGIC_LEN   4
+#define LOG_REC_MAX     (256 * 1024)    /* longer records are treated as corruption */
+#define COPY_CHUNK      4096
+#define SUMMARY_FMT     "compacted=%d from=%lu to=%lu"
+
+/* On-flash record header, followed by len content bytes (no terminator) */
+typedef struct __attribute__((packed)) {
+    uint32_t len;
+    uint32_t ts;
+    uint8_t role;
+    uint8_t reserved[3];
+} session_rec_hdr_t;
+
+static const char *s_roles[] = { "user", "assistant", "system" };
+#define ROLE_SYSTEM     2               /* index in s_roles, used for summary records */
+
+static SemaphoreHandle_t s_lock;
+static uint32_t s_remove_gen;           /* bumped by session_log_remove(), guarded by s_lock */
+
+static void log_path(const char *chat_id, const char *ext, char *buf, size_t size)
+{
+    snprintf(buf, size, "%s/tg_%s.%s", MIMI_SPIFFS_SESSION_DIR, chat_id, ext);
+}
+
+static int role_code(const char *role)
+{
+    for (int i = 0; i < (int)(sizeof(s_roles) / sizeof(s_roles[0])); i++) {
+        if (strcmp(role, s_roles[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static const char *role_name(uint8_t code)
+{
+    return code < sizeof(s_roles) / sizeof(s_roles[0]) ? s_roles[code] : "user";
+}
+
+static long file_size(FILE *f)
+{
+    if (fseek(f, 0, SEEK_END) != 0) return -1;
+    return ftell(f);
+}
+
+static bool read_at(FILE *f, long off, void *buf, size_t len)
+{
+    return fseek(f, off, SEEK_SET) == 0 && fread(buf, 1, len, f) == len;
+}
+
+/* ── Index (caller holds s_lock) ──────────────────────────────── */
+
+/*
+ * Rescan the log and rewrite the index. A torn record at the end (power
+ * loss mid-append) is cut off so later appends stay aligned.
+ */
+static esp_err_t index_rebuild(const char *chat_id)
+{
+    char path[64], idx_path[64];
+    log_path(chat_id, "log", path, sizeof(path));
+    log_path(chat_id, "idx", idx_path, sizeof(idx_path));
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return ESP_ERR_NOT_FOUND;
+    long size = file_size(f);
+    char magic[LOG_MAGIC_LEN];
+    if (size < LOG_MAGIC_LEN || !read_at(f, 0, magic, LOG_MAGIC_LEN) ||
+        memcmp(magic, LOG_MAGIC, LOG_MAGIC_LEN) != 0) {
+        fclose(f);
+        ESP_LOGE(TAG, "%s is not a session log", path);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    FILE *idx = fopen(idx_path, "wb");
+    if (!idx) {
+        fclose(f);
+        return ESP_FAIL;
+    }
+
+    long off = LOG_MAGIC_LEN;
+    int count = 0;
+    session_rec_hdr_t hdr;
+    while (off < size && read_at(f, off, &hdr, sizeof(hdr)) && hdr.len <= LOG_REC_MAX &&
+           off + (long)sizeof(hdr) + (long)hdr.len <= size) {
+        uint32_t o = (uint32_t)off;
+        fwrite(&o, sizeof(o), 1, idx);
+        off += sizeof(hdr) + hdr.len;
+        count++;
+    }
+    fclose(idx);
+    fclose(f);
+
+    if (off < size) {
+        ESP_LOGW(TAG, "%s: dropping %ld bytes of torn record", path, size - off);
+        truncate(path, off);
+    }
+    ESP_LOGI(TAG, "Rebuilt index of %s (%d records)", chat_id, count);
+    return ESP_OK;
+}
+
+/*
+ * Locate the last n records: [*start, log end) holds them. Fails with
+ * ESP_ERR_INVALID_STATE when the index does not end exactly at the end
+ * of the log.
+ */
+static esp_err_t index_tail(const char *chat_id, int max_recs, int *count, int *n, long *start, long *end)
+{
+    char path[64];
+    log_path(chat_id, "idx", path, sizeof(path));
+    FILE *idx = fopen(path, "rb");
+    long idx_size = idx ? file_size(idx) : 0;
+    *count = (int)(idx_size / sizeof(uint32_t));
+    *n = *count < max_recs ? *count : max_recs;
+
+    uint32_t first = LOG_MAGIC_LEN, last = 0;
+    bool ok = idx_size % sizeof(uint32_t) == 0;
+    /* The last offset is needed for the sync check even when no records are wanted (stat) */
+    if (ok && *count > 0) {
+        ok = read_at(idx, (long)(*count - 1) * sizeof(uint32_t), &last, sizeof(last));
+    }
+    if (ok && *n > 0) {
+        ok = read_at(idx, (long)(*count - *n) * sizeof(uint32_t), &first, sizeof(first));
+    }
+    if (idx) fclose(idx);
+
+    log_path(chat_id, "log", path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) return ESP_ERR_NOT_FOUND;
+    *end = file_size(f);
+    if (ok && *count > 0) {
+        session_rec_hdr_t hdr;
+        ok = read_at(f, last, &hdr, sizeof(hdr)) && (long)last + (long)sizeof(hdr) + (long)hdr.len == *end;
+    } else if (ok) {
+        ok = (*end == LOG_MAGIC_LEN);
+    }
+    fclose(f);
+
+    *start = first;
+    return ok ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+/* ── Migration (caller holds s_lock) ──────────────────────────── */
+
+static esp_err_t migrate_locked(const char *chat_id)
+{
+    char jsonl_path[64], tmp_path[64], path[64];
+    snprintf(jsonl_path, sizeof(jsonl_path), "%s/tg_%s.jsonl", MIMI_SPIFFS_SESSION_DIR, chat_id);
+    log_path(chat_id, "tmp", tmp_path, sizeof(tmp_path));
+    log_path(chat_id, "log", path, sizeof(path));
+
+    FILE *in = fopen(jsonl_path, "r");
+    if (!in) return ESP_ERR_NOT_FOUND;
+
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        /* Converted before, the old file just was not deleted yet */
+        fclose(in);
+        remove(jsonl_path);
+        return ESP_OK;
+    }
+
+    FILE *out = fopen(tmp_path, "wb");
+    if (!out) {
+        fclose(in);
+        return ESP_FAIL;
+    }
+    fwrite(LOG_MAGIC, 1, LOG_MAGIC_LEN, out);
+
+    char *line = NULL;
+    size_t cap = 0;
+    int count = 0;
+    bool ok = true;
+    while (ok && getline(&line, &cap, in) > 0) {
+        cJSON *obj = cJSON_Parse(line);
+        if (!obj) continue;
+        const char *role = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "role"));
+        const char *content = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "content"));
+        cJSON *ts = cJSON_GetObjectItem(obj, "ts");
+        if (role && content && role_code(role) >= 0 && strlen(content) <= LOG_REC_MAX) {
+            session_rec_hdr_t hdr = {
+                .len = strlen(content),
+                .ts = cJSON_IsNumber(ts) ? (uint32_t)ts->valuedouble : 0,
+                .role = (uint8_t)role_code(role),
+            };
+            ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1 &&
+                 fwrite(content, 1, hdr.len, out) == hdr.len;
+            count++;
+        }
+        cJSON_Delete(obj);
+    }
+    free(line);
+    fclose(in);
+    if (fclose(out) != 0) ok = false;
+
+    /* The JSONL file stays authoritative until the rename lands */
+    if (!ok || rename(tmp_path, path) != 0) {
+        ESP_LOGE(TAG, "Migration of %s failed", jsonl_path);
+        remove(tmp_path);
+        return ESP_FAIL;
+    }
+    remove(jsonl_path);
+    ESP_LOGI(TAG, "Migrated %s (%d records)", jsonl_path, count);
+    return index_rebuild(chat_id);
+}
+
+/*
+ * The log is missing: finish a compaction that was cut off between
+ * deleting the old log and renaming the new one, or convert legacy JSONL.
+ */
+static esp_err_t restore_locked(const char *chat_id)
+{
+    char path[64], cmp_path[64];
+    log_path(chat_id, "log", path, sizeof(path));
+    log_path(chat_id, "cmp", cmp_path, sizeof(cmp_path));
+
+    struct stat st;
+    if (stat(path, &st) != 0 && stat(cmp_path, &st) == 0 && rename(cmp_path, path) == 0) {
+        ESP_LOGW(TAG, "Recovered compacted log of %s", chat_id);
+        return index_rebuild(chat_id);
+    }
+    return migrate_locked(chat_id);
+}
+
+/* index_tail() that restores a missing log and rebuilds a stale index */
+static esp_err_t tail_locked(const char *chat_id, int max_recs, int *count, int *n, long *start, long *end)
+{
+    esp_err_t err = index_tail(chat_id, max_recs, count, n, start, end);
+    if (err == ESP_ERR_NOT_FOUND && restore_locked(chat_id) == ESP_OK) {
+        err = index_tail(chat_id, max_recs, count, n, start, end);
+    }
+    if (err == ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(TAG, "Index of %s out of sync with its log", chat_id);
+        err = index_rebuild(chat_id);
+        if (err == ESP_OK) err = index_tail(chat_id, max_recs, count, n, start, end);
+    }
+    return err;
+}
+
+static bool copy_range(FILE *in, long from, long to, FILE *out, char *chunk)
+{
+    if (fseek(in, from, SEEK_SET) != 0) return false;
+    while (from < to) {
+        size_t want = to - from < COPY_CHUNK ? (size_t)(to - from) : COPY_CHUNK;
+        if (fread(chunk, 1, want, in) != want || fwrite(chunk, 1, want, out) != want) return false;
+        from += want;
+    }
+    return true;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+esp_err_t session_log_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    return s_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t session_log_append(const char *chat_id, const session_rec_t *recs, int count)
+{
+    if (count <= 0) return ESP_OK;
+
+    size_t total = LOG_MAGIC_LEN;
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(recs[i].content);
+        if (role_code(recs[i].role) < 0 || len > LOG_REC_MAX) return ESP_ERR_INVALID_ARG;
+        total += sizeof(session_rec_hdr_t) + len;
+    }
+
+    char *buf = heap_caps_malloc(total, MALLOC_CAP_SPIRAM);
+    uint32_t *offs = malloc(count * sizeof(uint32_t));
+    if (!buf || !offs) {
+        free(buf);
+        free(offs);
+        return ESP_ERR_NO_MEM;
+    }
+
+    char path[64], idx_path[64];
+    log_path(chat_id, "log", path, sizeof(path));
+    log_path(chat_id, "idx", idx_path, sizeof(idx_path));
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = ESP_OK;
+    FILE *f = fopen(path, "ab");
+    long base = f ? file_size(f) : -1;
+    if (base == 0) {
+        /* New log: an interrupted compaction or legacy JSONL history comes first */
+        fclose(f);
+        remove(path);
+        restore_locked(chat_id);
+        f = fopen(path, "ab");
+        base = f ? file_size(f) : -1;
+    }
+    if (!f || base < 0) {
+        ESP_LOGE(TAG, "Cannot open session log %s", path);
+        if (f) fclose(f);
+        err = ESP_FAIL;
+        goto out;
+    }
+
+    /* Header and content of every record in one buffer, one write */
+    size_t pos = 0;
+    if (base == 0) {
+        memcpy(buf, LOG_MAGIC, LOG_MAGIC_LEN);
+        pos = LOG_MAGIC_LEN;
+    }
+    for (int i = 0; i < count; i++) {
+        session_rec_hdr_t hdr = {
+            .len = strlen(recs[i].content),
+            .ts = recs[i].ts,
+            .role = (uint8_t)role_code(recs[i].role),
+        };
+        offs[i] = (uint32_t)(base + pos);
+        memcpy(buf + pos, &hdr, sizeof(hdr));
+        memcpy(buf + pos + sizeof(hdr), recs[i].content, hdr.len);
+        pos += sizeof(hdr) + hdr.len;
+    }
+    bool ok = fwrite(buf, 1, pos, f) == pos;
+    if (fclose(f) != 0) ok = false;
+    if (!ok) {
+        ESP_LOGE(TAG, "Write to %s failed", path);
+        index_rebuild(chat_id);
+        err = ESP_FAIL;
+        goto out;
+    }
+
+    /* A log with records but no index means the index was lost: rescan instead */
+    struct stat st;
+    if (base > LOG_MAGIC_LEN && stat(idx_path, &st) != 0) {
+        index_rebuild(chat_id);
+        goto out;
+    }
+    FILE *idx = fopen(idx_path, base == 0 ? "wb" : "ab");
+    if (!idx || fwrite(offs, sizeof(uint32_t), count, idx) != (size_t)count) {
+        ESP_LOGW(TAG, "Index append failed for %s, will rebuild on read", chat_id);
+    }
+    if (idx) fclose(idx);
+
+out:
+    xSemaphoreGive(s_lock);
+    free(buf);
+    free(offs);
+    return err;
+}
+
+esp_err_t session_log_read_tail(const char *chat_id, int max_recs, session_rec_cb_t cb, void *ctx)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int count, n;
+    long start, end;
+    esp_err_t err = tail_locked(chat_id, max_recs, &count, &n, &start, &end);
+    if (err != ESP_OK || n == 0) {
+        xSemaphoreGive(s_lock);
+        return err;
+    }
+
+    /* One read covers the tail; +1 leaves room to terminate the last content */
+    size_t span = end - start;
+    char *buf = heap_caps_malloc(span + 1, MALLOC_CAP_SPIRAM);
+    char path[64];
+    log_path(chat_id, "log", path, sizeof(path));
+    FILE *f = buf ? fopen(path, "rb") : NULL;
+    bool ok = f && read_at(f, start, buf, span);
+    if (f) fclose(f);
+    xSemaphoreGive(s_lock);
+
+    if (!ok) {
+        free(buf);
+        return buf ? ESP_FAIL : ESP_ERR_NO_MEM;
+    }
+
+    size_t pos = 0;
+    while (pos + sizeof(session_rec_hdr_t) <= span) {
+        session_rec_hdr_t hdr;
+        memcpy(&hdr, buf + pos, sizeof(hdr));
+        char *content = buf + pos + sizeof(hdr);
+        if (hdr.len > span - pos - sizeof(hdr)) break;
+        /* Borrow the next header's first byte as terminator */
+        char saved = content[hdr.len];
+        content[hdr.len] = '\0';
+        cb(role_name(hdr.role), content, hdr.ts, ctx);
+        content[hdr.len] = saved;
+        pos += sizeof(hdr) + hdr.len;
+    }
+    free(buf);
+    return ESP_OK;
+}
+
+esp_err_t session_log_stat(const char *chat_id, int *count, size_t *bytes)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int n;
+    long start, end;
+    esp_err_t err = tail_locked(chat_id, 0, count, &n, &start, &end);
+    xSemaphoreGive(s_lock);
+    if (err == ESP_OK) *bytes = (size_t)end;
+    return err;
+}
+
+esp_err_t session_log_compact(const char *chat_id, int keep, size_t max_bytes, bool summary,
+                              size_t *reclaimed)
+{
+    *reclaimed = 0;
+    if (keep < 1) keep = 1;
+
+    char path[64], idx_path[64], cmp_path[64];
+    log_path(chat_id, "log", path, sizeof(path));
+    log_path(chat_id, "idx", idx_path, sizeof(idx_path));
+    log_path(chat_id, "cmp", cmp_path, sizeof(cmp_path));
+
+    /* 1. Under the lock: decide which records survive */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t gen = s_remove_gen;
+    int count, n;
+    long start, end;
+    esp_err_t err = tail_locked(chat_id, keep, &count, &n, &start, &end);
+    uint32_t *offs = (err == ESP_OK && n > 0) ? malloc(n * sizeof(uint32_t)) : NULL;
+    FILE *idx = offs ? fopen(idx_path, "rb") : NULL;
+    bool ok = idx && read_at(idx, (long)(count - n) * sizeof(uint32_t), offs, n * sizeof(uint32_t));
+
+    /* Trim further while the kept records alone exceed the byte quota */
+    int k = 0;
+    while (ok && k < n - 1 && (size_t)(end - offs[k]) + LOG_MAGIC_LEN > max_bytes) k++;
+    int dropped = count - n + k;
+
+    char text[96] = "";
+    unsigned long to = 0;
+    if (ok && dropped > 0 && summary) {
+        /* Carry an earlier summary forward so the counts keep adding up */
+        int folded = dropped;
+        unsigned long from = 0;
+        uint32_t last_off = 0;
+        session_rec_hdr_t hdr;
+        FILE *f = fopen(path, "rb");
+        if (f && read_at(f, LOG_MAGIC_LEN, &hdr, sizeof(hdr))) {
+            from = hdr.ts;
+            char prev[sizeof(text)] = "";
+            int prev_n;
+            unsigned long prev_from, prev_to;
+            if (hdr.role == ROLE_SYSTEM && hdr.len < sizeof(prev) && fread(prev, 1, hdr.len, f) == hdr.len &&
+                sscanf(prev, SUMMARY_FMT, &prev_n, &prev_from, &prev_to) == 3) {
+                folded += prev_n - 1;
+                from = prev_from;
+            }
+        }
+        if (f && read_at(idx, (long)(dropped - 1) * sizeof(uint32_t), &last_off, sizeof(last_off)) &&
+            read_at(f, last_off, &hdr, sizeof(hdr))) {
+            to = hdr.ts;
+        }
+        if (f) fclose(f);
+        snprintf(text, sizeof(text), SUMMARY_FMT, folded, from, to);
+    }
+    if (idx) fclose(idx);
+    xSemaphoreGive(s_lock);
+
+    long keep_off = ok ? offs[k] : 0;
+    long snap_end = end;
+    free(offs);
+    session_rec_hdr_t sum_hdr = { .len = strlen(text), .ts = (uint32_t)to, .role = ROLE_SYSTEM };
+    long head = LOG_MAGIC_LEN + (text[0] ? (long)(sizeof(sum_hdr) + sum_hdr.len) : 0);
+    if (!ok || dropped <= 0 || keep_off <= head) return err;
+
+    /* 2. Without the lock: copy the survivors, appends carry on meanwhile */
+    char *chunk = heap_caps_malloc(COPY_CHUNK, MALLOC_CAP_SPIRAM);
+    FILE *out = chunk ? fopen(cmp_path, "wb") : NULL;
+    FILE *in = out ? fopen(path, "rb") : NULL;
+    ok = in && fwrite(LOG_MAGIC, 1, LOG_MAGIC_LEN, out) == LOG_MAGIC_LEN;
+    if (ok && text[0]) {
+        ok = fwrite(&sum_hdr, sizeof(sum_hdr), 1, out) == 1 &&
+             fwrite(text, 1, sum_hdr.len, out) == sum_hdr.len;
+    }
+    ok = ok && copy_range(in, keep_off, snap_end, out, chunk);
+    if (in) fclose(in);
+
+    /* 3. Under the lock again: add what was appended meanwhile, then swap */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    long now_end = -1;
+    if (ok && gen == s_remove_gen) {
+        in = fopen(path, "rb");
+        now_end = in ? file_size(in) : -1;
+        ok = now_end >= snap_end && copy_range(in, snap_end, now_end, out, chunk);
+        if (in) fclose(in);
+    } else {
+        ok = false;
+    }
+    if (out && fclose(out) != 0) ok = false;
+    free(chunk);
+
+    /* SPIFFS cannot rename onto an existing file; restore_locked() covers the gap */
+    if (!ok || remove(path) != 0) {
+        ESP_LOGW(TAG, "Compaction of %s abandoned", chat_id);
+        remove(cmp_path);
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (rename(cmp_path, path) != 0) {
+        ESP_LOGE(TAG, "Rename of %s failed, recovered on next access", cmp_path);
+        xSemaphoreGive(s_lock);
+        return ESP_FAIL;
+    }
+
+    /* Every surviving offset moves down by the same amount */
+    uint32_t *new_offs = NULL;
+    idx = fopen(idx_path, "rb");
+    long idx_size = idx ? file_size(idx) : 0;
+    int total = (int)(idx_size / sizeof(uint32_t)) - dropped;
+    if (total > 0) new_offs = malloc((total + 1) * sizeof(uint32_t));
+    bool idx_ok = new_offs && read_at(idx, (long)dropped * sizeof(uint32_t),
+                                      new_offs + 1, total * sizeof(uint32_t));
+    if (idx) fclose(idx);
+    if (idx_ok) {
+        int first = 1;
+        if (text[0]) {
+            new_offs[0] = LOG_MAGIC_LEN;
+            first = 0;
+        }
+        for (int i = 1; i <= total; i++) new_offs[i] -= (uint32_t)(keep_off - head);
+        idx = fopen(idx_path, "wb");
+        int written = total + 1 - first;
+        idx_ok = idx && fwrite(new_offs + first, sizeof(uint32_t), written, idx) == (size_t)written;
+        if (idx) fclose(idx);
+    }
+    free(new_offs);
+    if (!idx_ok) index_rebuild(chat_id);
+
+    *reclaimed = (size_t)(keep_off - head);
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "Compacted %s: dropped %d records, %u bytes reclaimed",
+             chat_id, dropped, (unsigned)*reclaimed);
+    return ESP_OK;
+}
+
+esp_err_t session_log_migrate(const char *chat_id)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = migrate_locked(chat_id);
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t session_log_export_jsonl(const char *chat_id, FILE *out)
+{
+    char path[64];
+    log_path(chat_id, "log", path, sizeof(path));
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    restore_locked(chat_id);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    long size = file_size(f);
+    long off = LOG_MAGIC_LEN;
+    session_rec_hdr_t hdr;
+    while (off < size && read_at(f, off, &hdr, sizeof(hdr)) && hdr.len <= LOG_REC_MAX) {
+        char *content = heap_caps_malloc(hdr.len + 1, MALLOC_CAP_SPIRAM);
+        if (!content || fread(content, 1, hdr.len, f) != hdr.len) {
+            free(content);
+            break;
+        }
+        content[hdr.len] = '\0';
+
+        cJSON *obj = cJSON_CreateObject();
+        cJSON_AddStringToObject(obj, "role", role_name(hdr.role));
+        cJSON_AddStringToObject(obj, "content", content);
+        cJSON_AddNumberToObject(obj, "ts", (double)hdr.ts);
+        char *line = cJSON_PrintUnformatted(obj);
+        cJSON_Delete(obj);
+        free(content);
+        if (line) {
+            fprintf(out, "%s\n", line);
+            cJSON_free(line);
+        }
+        off += sizeof(hdr) + hdr.len;
+    }
+    fclose(f);
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+esp_err_t session_log_remove(const char *chat_id)
+{
+    static const char *exts[] = { "log", "idx", "tmp", "cmp", "jsonl" };
+    bool removed = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_remove_gen++;
+    for (int i = 0; i < (int)(sizeof(exts) / sizeof(exts[0])); i++) {
+        char path[64];
+        log_path(chat_id, exts[i], path, sizeof(path));
+        if (remove(path) == 0) removed = true;
+    }
+    xSemaphoreGive(s_lock);
+    return removed ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Per-chat binary session log:
+ *   tg_<chat_id>.log  "MSL1" magic, then records of
+ *                     [len u32][ts u32][role u8][3 reserved][content bytes]
+ *   tg_<chat_id>.idx  little-endian uint32 file offset of every record
+ *   tg_<chat_id>.cmp  compacted copy being written, renamed over .log
+ *
+ * The index is derived data: if it disagrees with the log (crash between
+ * the two appends) it is rebuilt by scanning the log.
+ */
+
+typedef struct {
+    const char *role;       /* "user", "assistant" or "system" */
+    const char *content;
+    uint32_t ts;
+} session_rec_t;
+
+/* Called oldest first; role and content are only valid during the call */
+typedef void (*session_rec_cb_t)(const char *role, const char *content, uint32_t ts, void *ctx);
+
+esp_err_t session_log_init(void);
+
+/**
+ * Append records. All records go out in a single write to the log,
+ * followed by a single write of their offsets to the index.
+ */
+esp_err_t session_log_append(const char *chat_id, const session_rec_t *recs, int count);
+
+/**
+ * Deliver the last max_recs records to cb. Seeks through the index, so
+ * the cost depends on max_recs, not on the session length.
+ * @return ESP_ERR_NOT_FOUND if the chat has no log
+ */
+esp_err_t session_log_read_tail(const char *chat_id, int max_recs, session_rec_cb_t cb, void *ctx);
+
+/**
+ * Record count and log size in bytes.
+ * @return ESP_ERR_NOT_FOUND if the chat has no log
+ */
+esp_err_t session_log_stat(const char *chat_id, int *count, size_t *bytes);
+
+/**
+ * Rewrite the log keeping at most the last keep records, fewer if they
+ * exceed max_bytes (the newest record always stays). With summary, the
+ * dropped records are folded into one leading "system" record
+ * ("compacted=N from=TS to=TS"). The copy runs without the log lock, so
+ * appends are not held up; only records appended meanwhile are copied
+ * under it before the new file is renamed into place.
+ */
+esp_err_t session_log_compact(const char *chat_id, int keep, size_t max_bytes, bool summary,
+                              size_t *reclaimed);
+
+/**
+ * Convert a legacy tg_<chat_id>.jsonl file into a log, then delete it.
+ * @return ESP_ERR_NOT_FOUND if there is nothing to migrate
+ */
+esp_err_t session_log_migrate(const char *chat_id);
+
+/**
+ * Write the whole log as JSONL ({"role","content","ts"} per line).
+ */
+esp_err_t session_log_export_jsonl(const char *chat_id, FILE *out);
+
+/**
+ * Delete the log, its index and any legacy JSONL file.
+ */
+esp_err_t session_log_remove(const char *chat_id);
@@ -1,123 +1,475 @@
 #include "session_mgr.h"
+#include "session_log.h"
 #include "mimi_config.h"
+#include "agent/turn_arena.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <dirent.h>
 #include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 
 static const char *TAG = "session";
 
-static void session_path(const char *chat_id, char *buf, size_t size)
+/* ── History cache (LRU of parsed per-chat histories) ─────────── */
+
+typedef struct {
+    char chat_id[32];               /* empty = free slot */
+    cJSON *msgs;                    /* [{"role","content"}...], last MIMI_SESSION_MAX_MSGS */
+    char *summary;                  /* rolling summary of the turns before msgs, or NULL */
+    int64_t last_used_us;
+    session_mark_t mark;            /* load generation + messages appended since */
+} session_cache_t;
+
+/*
+ * A summary is stored as a "system" record "summary keep=<k>\n<text>": it
+ * replaces everything before it except the last k records. Being relative,
+ * it survives compaction renumbering the log.
+ */
+#define SUMMARY_PREFIX      "summary keep="
+#define SUMMARY_LEAD        "[Summary of the earlier conversation]\n"
+#define SUMMARY_ACK         "Noted, I will keep that in mind."
+
+typedef struct {
+    cJSON *msgs;
+    char *summary;
+} history_load_t;
+
+static session_cache_t s_cache[MIMI_SESSION_CACHE_SLOTS];
+static uint32_t s_load_seq;             /* bumped per history load, see session_mark_t */
+static SemaphoreHandle_t s_lock;
+static session_cache_stats_t s_stats;
+
+/* ── Write-behind queue (group commit) ────────────────────────── */
+
+typedef struct {
+    char chat_id[32];
+    char role[12];
+    char *content;                  /* PSRAM copy */
+    uint32_t ts;
+} pending_rec_t;
+
+/* Guarded by s_lock, like the cache it stays in step with */
+static pending_rec_t *s_pending;
+static int s_pending_count;
+static int s_pending_cap;
+static size_t s_pending_bytes;
+
+static SemaphoreHandle_t s_flush_lock;  /* one batch in flight; held until it is on flash */
+static TaskHandle_t s_writer;
+static session_writer_stats_t s_wstats;
+
+/* Caller holds s_lock */
+static session_cache_t *cache_find(const char *chat_id)
 {
-    snprintf(buf, size, "%s/tg_%s.jsonl", MIMI_SPIFFS_SESSION_DIR, chat_id);
+    for (int i = 0; i < MIMI_SESSION_CACHE_SLOTS; i++) {
+        if (s_cache[i].chat_id[0] && strcmp(s_cache[i].chat_id, chat_id) == 0) return &s_cache[i];
+    }
+    return NULL;
 }
 
-esp_err_t session_mgr_init(void)
+static void cache_drop(session_cache_t *slot)
 {
-    ESP_LOGI(TAG, "Session manager initialized at %s", MIMI_SPIFFS_SESSION_DIR);
-    return ESP_OK;
+    cJSON_Delete(slot->msgs);
+    free(slot->summary);
+    memset(slot, 0, sizeof(*slot));
 }
 
-esp_err_t session_append(const char *chat_id, const char *role, const char *content)
+/* Free slot, or the least recently used one (evicted); caller holds s_lock */
+static session_cache_t *cache_victim(void)
 {
-    char path[64];
-    session_path(chat_id, path, sizeof(path));
+    session_cache_t *victim = &s_cache[0];
+    for (int i = 0; i < MIMI_SESSION_CACHE_SLOTS; i++) {
+        if (!s_cache[i].chat_id[0]) return &s_cache[i];
+        if (s_cache[i].last_used_us < victim->last_used_us) victim = &s_cache[i];
+    }
+    ESP_LOGD(TAG, "Evicting cached history of %s", victim->chat_id);
+    s_stats.evictions++;
+    cache_drop(victim);
+    return victim;
+}
 
-    FILE *f = fopen(path, "a");
-    if (!f) {
-        ESP_LOGE(TAG, "Cannot open session file %s", path);
-        return ESP_FAIL;
+static void history_push(cJSON *msgs, const char *role, const char *content)
+{
+    cJSON *entry = cJSON_CreateObject();
+    cJSON_AddStringToObject(entry, "role", role);
+    cJSON_AddStringToObject(entry, "content", content);
+    cJSON_AddItemToArray(msgs, entry);
+    while (cJSON_GetArraySize(msgs) > MIMI_SESSION_MAX_MSGS) {
+        cJSON_DeleteItemFromArray(msgs, 0);
     }
+}
 
-    cJSON *obj = cJSON_CreateObject();
-    cJSON_AddStringToObject(obj, "role", role);
-    cJSON_AddStringToObject(obj, "content", content);
-    cJSON_AddNumberToObject(obj, "ts", (double)time(NULL));
+/* Keep only the last keep messages: the rest is covered by a new summary */
+static void history_fold(cJSON *msgs, int keep)
+{
+    while (cJSON_GetArraySize(msgs) > keep) {
+        cJSON_DeleteItemFromArray(msgs, 0);
+    }
+}
 
-    char *line = cJSON_PrintUnformatted(obj);
-    cJSON_Delete(obj);
+static void history_load_rec(const char *role, const char *content, uint32_t ts, void *ctx)
+{
+    history_load_t *h = (history_load_t *)ctx;
 
-    if (line) {
-        fprintf(f, "%s\n", line);
-        free(line);
+    /* Other "system" records are compaction markers, not LLM messages */
+    if (strcmp(role, "system") == 0) {
+        if (strncmp(content, SUMMARY_PREFIX, strlen(SUMMARY_PREFIX)) != 0) return;
+        const char *text = strchr(content, '\n');
+        history_fold(h->msgs, atoi(content + strlen(SUMMARY_PREFIX)));
+        free(h->summary);
+        h->summary = text ? strdup(text + 1) : NULL;
+        return;
     }
+    history_push(h->msgs, role, content);
+}
 
-    fclose(f);
-    return ESP_OK;
+/* Cache miss: seek straight to the last MIMI_SESSION_MAX_MSGS records */
+static history_load_t history_load(const char *chat_id)
+{
+    history_load_t h = { .msgs = cJSON_CreateArray() };
+    esp_err_t err = session_log_read_tail(chat_id, MIMI_SESSION_MAX_MSGS, history_load_rec, &h);
+    if (err != ESP_OK && err != ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "Reading history of %s failed: %s", chat_id, esp_err_to_name(err));
+    }
+    return h;
 }
 
-esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size, int max_msgs)
+/* ── Writer ───────────────────────────────────────────────────── */
+
+esp_err_t session_flush(void)
 {
-    char path[64];
-    session_path(chat_id, path, sizeof(path));
+    xSemaphoreTake(s_flush_lock, portMAX_DELAY);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    pending_rec_t *batch = s_pending;
+    int count = s_pending_count;
+    s_pending = NULL;
+    s_pending_count = 0;
+    s_pending_cap = 0;
+    s_pending_bytes = 0;
+    xSemaphoreGive(s_lock);
 
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        /* No history yet */
-        snprintf(buf, size, "[]");
+    if (count == 0) {
+        xSemaphoreGive(s_flush_lock);
         return ESP_OK;
     }
 
-    /* Read all lines into a ring buffer of cJSON objects */
-    cJSON *messages[MIMI_SESSION_MAX_MSGS];
-    int count = 0;
-    int write_idx = 0;
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t result = ESP_OK;
+    int files = 0;
+    session_rec_t *recs = malloc(count * sizeof(session_rec_t));
+    bool *done = calloc(count, sizeof(bool));
 
-    char line[2048];
-    while (fgets(line, sizeof(line), f)) {
-        /* Strip newline */
-        size_t len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
-        if (line[0] == '\0') continue;
+    /* One append, i.e. one open of the log and of its index, per chat */
+    for (int i = 0; recs && done && i < count; i++) {
+        if (done[i]) continue;
+        int n = 0;
+        for (int j = i; j < count; j++) {
+            if (done[j] || strcmp(batch[j].chat_id, batch[i].chat_id) != 0) continue;
+            recs[n++] = (session_rec_t){ .role = batch[j].role, .content = batch[j].content, .ts = batch[j].ts };
+            done[j] = true;
+        }
+        esp_err_t err = session_log_append(batch[i].chat_id, recs, n);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Cannot append to session %s: %s", batch[i].chat_id, esp_err_to_name(err));
+            result = err;
+        }
+        files++;
+    }
+    if (!recs || !done) result = ESP_ERR_NO_MEM;
+    free(recs);
+    free(done);
+    for (int i = 0; i < count; i++) free(batch[i].content);
+    free(batch);
+
+    int64_t flush_ms = (esp_timer_get_time() - start_us) / 1000;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_wstats.batches++;
+    s_wstats.records += count;
+    s_wstats.files += files;
+    if (result != ESP_OK) s_wstats.failed++;
+    s_wstats.flush_ms_total += flush_ms;
+    if (flush_ms > s_wstats.flush_ms_max) s_wstats.flush_ms_max = flush_ms;
+    xSemaphoreGive(s_lock);
+    xSemaphoreGive(s_flush_lock);
 
-        cJSON *obj = cJSON_Parse(line);
-        if (!obj) continue;
+    ESP_LOGD(TAG, "Flushed %d records to %d sessions in %lld ms", count, files, (long long)flush_ms);
+    return result;
+}
 
-        /* Ring buffer: overwrite oldest if full */
-        if (count >= max_msgs) {
-            cJSON_Delete(messages[write_idx]);
+static void session_writer_task(void *arg)
+{
+    (void)arg;
+    while (1) {
+        /* Byte threshold wakes us early; otherwise a batch waits at most MIMI_SESSION_FLUSH_MS */
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MIMI_SESSION_FLUSH_MS));
+        session_flush();
+    }
+}
+
+static void session_flush_on_shutdown(void)
+{
+    session_flush();
+}
+
+/*
+ * Caller holds s_lock. Queue records (taking ownership of the PSRAM copies)
+ * and mirror them into a cached history.
+ */
+static esp_err_t pending_push_locked(const char *chat_id, const char **roles, char **copies, int n)
+{
+    if (s_pending_count + n > s_pending_cap) {
+        int cap = s_pending_cap ? s_pending_cap * 2 : 16;
+        pending_rec_t *tmp = heap_caps_realloc(s_pending, cap * sizeof(pending_rec_t), MALLOC_CAP_SPIRAM);
+        if (!tmp) {
+            for (int i = 0; i < n; i++) free(copies[i]);
+            return ESP_ERR_NO_MEM;
         }
-        messages[write_idx] = obj;
-        write_idx = (write_idx + 1) % max_msgs;
-        if (count < max_msgs) count++;
+        s_pending = tmp;
+        s_pending_cap = cap;
+    }
+    uint32_t ts = (uint32_t)time(NULL);
+    for (int i = 0; i < n; i++) {
+        pending_rec_t *rec = &s_pending[s_pending_count++];
+        memset(rec, 0, sizeof(*rec));
+        strncpy(rec->chat_id, chat_id, sizeof(rec->chat_id) - 1);
+        strncpy(rec->role, roles[i], sizeof(rec->role) - 1);
+        rec->content = copies[i];
+        rec->ts = ts;
+        s_pending_bytes += strlen(copies[i]);
+    }
+
+    /* Keep a cached history current; uncached chats are loaded on their next turn.
+     * Summary records are applied to the cache by session_set_summary() */
+    session_cache_t *slot = cache_find(chat_id);
+    turn_arena_escape_begin();
+    for (int i = 0; slot && i < n; i++) {
+        if (strcmp(roles[i], "system") == 0) continue;
+        history_push(slot->msgs, roles[i], copies[i]);
+        slot->mark.appended++;
+    }
+    turn_arena_escape_end();
+    if (s_pending_count > s_wstats.pending_max) s_wstats.pending_max = s_pending_count;
+    return ESP_OK;
+}
+
+/* Wake the writer once enough is queued; without one, write through */
+static esp_err_t pending_kick(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t pending_bytes = s_pending_bytes;
+    xSemaphoreGive(s_lock);
+    if (!s_writer) return session_flush();
+    if (pending_bytes >= MIMI_SESSION_FLUSH_BYTES) xTaskNotifyGive(s_writer);
+    return ESP_OK;
+}
+
+/* Queue records and mirror them into a cached history */
+static esp_err_t pending_push(const char *chat_id, const char **roles, const char **contents, int n)
+{
+    char *copies[2] = {0};
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(contents[i]);
+        copies[i] = heap_caps_malloc(len + 1, MALLOC_CAP_SPIRAM);
+        if (!copies[i]) {
+            for (int j = 0; j < i; j++) free(copies[j]);
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(copies[i], contents[i], len + 1);
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = pending_push_locked(chat_id, roles, copies, n);
+    xSemaphoreGive(s_lock);
+    return err == ESP_OK ? pending_kick() : err;
+}
+
+esp_err_t session_mgr_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    s_flush_lock = xSemaphoreCreateMutex();
+    if (!s_lock || !s_flush_lock) return ESP_ERR_NO_MEM;
+    esp_err_t err = session_log_init();
+    if (err != ESP_OK) return err;
+
+    if (xTaskCreatePinnedToCore(session_writer_task, "sess_write", MIMI_SESSION_WRITER_STACK, NULL,
+                                MIMI_SESSION_WRITER_PRIO, &s_writer, MIMI_SESSION_WRITER_CORE) != pdPASS) {
+        ESP_LOGW(TAG, "Writer task create failed, session appends write through");
+        s_writer = NULL;
+    }
+    esp_register_shutdown_handler(session_flush_on_shutdown);
+
+    ESP_LOGI(TAG, "Session manager initialized at %s (%d cached histories)",
+             MIMI_SPIFFS_SESSION_DIR, MIMI_SESSION_CACHE_SLOTS);
+    return ESP_OK;
+}
+
+esp_err_t session_append(const char *chat_id, const char *role, const char *content)
+{
+    return pending_push(chat_id, &role, &content, 1);
+}
+
+esp_err_t session_append_turn(const char *chat_id, const char *user_text, const char *assistant_text)
+{
+    const char *roles[2] = { "user", "assistant" };
+    const char *contents[2] = { user_text, assistant_text };
+    return pending_push(chat_id, roles, contents, 2);
+}
+
+/* Cached history of chat_id, loaded on a miss; returns with s_lock held */
+static session_cache_t *cache_get_locked(const char *chat_id)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    session_cache_t *slot = cache_find(chat_id);
+    if (slot) {
+        s_stats.hits++;
+        slot->last_used_us = esp_timer_get_time();
+        return slot;
+    }
+    xSemaphoreGive(s_lock);
+
+    /* Queued records must reach flash first; it is read outside the lock so hot chats are not held up */
+    session_flush();
+    int64_t start_us = esp_timer_get_time();
+    /* The parsed history stays cached after the caller's turn ends */
+    turn_arena_escape_begin();
+    history_load_t loaded = history_load(chat_id);
+    turn_arena_escape_end();
+    int64_t load_ms = (esp_timer_get_time() - start_us) / 1000;
+    ESP_LOGI(TAG, "History of %s loaded from flash in %lld ms", chat_id, (long long)load_ms);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.misses++;
+    s_stats.load_ms_total += load_ms;
+    slot = cache_find(chat_id);
+    if (!slot) {
+        slot = cache_victim();
+        strncpy(slot->chat_id, chat_id, sizeof(slot->chat_id) - 1);
+        slot->msgs = loaded.msgs;
+        slot->summary = loaded.summary;
+        slot->mark.load = ++s_load_seq;
+        loaded.msgs = NULL;
+        loaded.summary = NULL;
     }
-    fclose(f);
+    cJSON_Delete(loaded.msgs);
+    free(loaded.summary);
+    slot->last_used_us = esp_timer_get_time();
+    return slot;
+}
 
-    /* Build JSON array with only role + content */
+/* Copy of the last max_msgs entries; the caller owns and extends the result */
+static cJSON *history_copy(const char *chat_id, int max_msgs, bool with_summary, session_mark_t *mark)
+{
+    session_cache_t *slot = cache_get_locked(chat_id);
+    if (mark) *mark = slot->mark;
     cJSON *arr = cJSON_CreateArray();
-    int start = (count < max_msgs) ? 0 : write_idx;
-    for (int i = 0; i < count; i++) {
-        int idx = (start + i) % max_msgs;
-        cJSON *src = messages[idx];
-
-        cJSON *entry = cJSON_CreateObject();
-        cJSON *role = cJSON_GetObjectItem(src, "role");
-        cJSON *content = cJSON_GetObjectItem(src, "content");
-        if (role && content) {
-            cJSON_AddStringToObject(entry, "role", role->valuestring);
-            cJSON_AddStringToObject(entry, "content", content->valuestring);
+    if (with_summary && slot->summary) {
+        /* Sent as the oldest exchange in place of the turns it covers; the
+         * acknowledgement keeps user and assistant roles alternating */
+        size_t len = strlen(SUMMARY_LEAD) + strlen(slot->summary) + 1;
+        char *text = malloc(len);
+        if (text) {
+            snprintf(text, len, "%s%s", SUMMARY_LEAD, slot->summary);
+            history_push(arr, "user", text);
+            history_push(arr, "assistant", SUMMARY_ACK);
+            free(text);
         }
-        cJSON_AddItemToArray(arr, entry);
     }
+    int total = cJSON_GetArraySize(slot->msgs);
+    int skip = total > max_msgs ? total - max_msgs : 0;
+    const cJSON *item;
+    int i = 0;
+    cJSON_ArrayForEach(item, slot->msgs) {
+        if (i++ < skip) continue;
+        cJSON_AddItemToArray(arr, cJSON_Duplicate(item, true));
+    }
+    xSemaphoreGive(s_lock);
+    return arr;
+}
+
+cJSON *session_get_history(const char *chat_id, int max_msgs)
+{
+    return history_copy(chat_id, max_msgs, true, NULL);
+}
+
+int session_history_summary_msgs(const cJSON *history)
+{
+    const cJSON *first = cJSON_GetArrayItem(history, 0);
+    const char *text = cJSON_GetStringValue(cJSON_GetObjectItem(first, "content"));
+    if (!text || strncmp(text, SUMMARY_LEAD, strlen(SUMMARY_LEAD)) != 0) return 0;
+    return cJSON_GetArraySize(history) >= 2 ? 2 : 1;
+}
 
-    /* Cleanup ring buffer */
-    int cleanup_start = (count < max_msgs) ? 0 : write_idx;
-    for (int i = 0; i < count; i++) {
-        int idx = (cleanup_start + i) % max_msgs;
-        cJSON_Delete(messages[idx]);
+cJSON *session_get_turns(const char *chat_id, int max_msgs, session_mark_t *mark)
+{
+    return history_copy(chat_id, max_msgs, false, mark);
+}
+
+char *session_get_summary(const char *chat_id)
+{
+    session_cache_t *slot = cache_get_locked(chat_id);
+    char *summary = slot->summary ? strdup(slot->summary) : NULL;
+    xSemaphoreGive(s_lock);
+    return summary;
+}
+
+esp_err_t session_set_summary(const char *chat_id, const char *summary, int keep,
+                              const session_mark_t *mark)
+{
+    size_t len = strlen(SUMMARY_PREFIX) + 12 + strlen(summary) + 1;
+    char *record = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    char *copy = strdup(summary);
+    if (!record || !copy) {
+        free(record);
+        free(copy);
+        return ESP_ERR_NO_MEM;
     }
 
+    /* The chat may have had turns since the snapshot was taken: they stay
+     * verbatim, so keep grows by them. The record is queued under the same
+     * lock as appends, so its position in the log matches that count */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    session_cache_t *slot = cache_find(chat_id);
+    if (!slot || slot->mark.load != mark->load) {
+        xSemaphoreGive(s_lock);
+        free(record);
+        free(copy);
+        return ESP_ERR_INVALID_STATE;   /* reloaded meanwhile: the snapshot no longer lines up */
+    }
+    keep += (int)(slot->mark.appended - mark->appended);
+    snprintf(record, len, SUMMARY_PREFIX "%d\n%s", keep, summary);
+    const char *role = "system";
+    esp_err_t err = pending_push_locked(chat_id, &role, &record, 1);
+    if (err == ESP_OK) {
+        history_fold(slot->msgs, keep);
+        free(slot->summary);
+        slot->summary = copy;
+        copy = NULL;
+    }
+    xSemaphoreGive(s_lock);
+    free(copy);
+    return err == ESP_OK ? pending_kick() : err;
+}
+
+esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size, int max_msgs)
+{
+    cJSON *arr = session_get_history(chat_id, max_msgs);
     char *json_str = cJSON_PrintUnformatted(arr);
     cJSON_Delete(arr);
 
     if (json_str) {
         strncpy(buf, json_str, size - 1);
         buf[size - 1] = '\0';
-        free(json_str);
+        cJSON_free(json_str);
     } else {
         snprintf(buf, size, "[]");
     }
@@ -125,18 +477,64 @@ esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size,
     return ESP_OK;
 }
 
+void session_get_cache_stats(session_cache_stats_t *out)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    int cached = 0;
+    for (int i = 0; i < MIMI_SESSION_CACHE_SLOTS; i++) {
+        if (s_cache[i].chat_id[0]) cached++;
+    }
+    out->cached = cached;
+    xSemaphoreGive(s_lock);
+}
+
+void session_get_writer_stats(session_writer_stats_t *out)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_wstats;
+    out->pending = s_pending_count;
+    xSemaphoreGive(s_lock);
+}
+
 esp_err_t session_clear(const char *chat_id)
 {
-    char path[64];
-    session_path(chat_id, path, sizeof(path));
+    /* A batch in flight could recreate the log after removal: wait it out */
+    xSemaphoreTake(s_flush_lock, portMAX_DELAY);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    session_cache_t *slot = cache_find(chat_id);
+    if (slot) cache_drop(slot);
+    bool dropped = false;
+    int kept = 0;
+    for (int i = 0; i < s_pending_count; i++) {
+        pending_rec_t *rec = &s_pending[i];
+        if (strcmp(rec->chat_id, chat_id) == 0) {
+            s_pending_bytes -= strlen(rec->content);
+            free(rec->content);
+            dropped = true;
+            continue;
+        }
+        s_pending[kept++] = *rec;
+    }
+    s_pending_count = kept;
+    xSemaphoreGive(s_lock);
 
-    if (remove(path) == 0) {
+    esp_err_t err = session_log_remove(chat_id);
+    xSemaphoreGive(s_flush_lock);
+
+    if (err == ESP_OK || dropped) {
         ESP_LOGI(TAG, "Session %s cleared", chat_id);
         return ESP_OK;
     }
     return ESP_ERR_NOT_FOUND;
 }
 
+esp_err_t session_export(const char *chat_id)
+{
+    session_flush();
+    return session_log_export_jsonl(chat_id, stdout);
+}
+
 void session_list(void)
 {
     DIR *dir = opendir(MIMI_SPIFFS_SESSION_DIR);
@@ -152,9 +550,13 @@ void session_list(void)
     struct dirent *entry;
     int count = 0;
     while ((entry = readdir(dir)) != NULL) {
-        if (strstr(entry->d_name, "tg_") && strstr(entry->d_name, ".jsonl")) {
+        if (!strstr(entry->d_name, "tg_")) continue;
+        if (strstr(entry->d_name, ".log")) {
             ESP_LOGI(TAG, "  Session: %s", entry->d_name);
             count++;
+        } else if (strstr(entry->d_name, ".jsonl")) {
+            ESP_LOGI(TAG, "  Session: %s (legacy JSONL, converted on first use)", entry->d_name);
+            count++;
         }
     }
     closedir(dir);
@@ -162,4 +564,18 @@ void session_list(void)
     if (count == 0) {
         ESP_LOGI(TAG, "  No sessions found");
     }
+
+    session_cache_stats_t st;
+    session_get_cache_stats(&st);
+    ESP_LOGI(TAG, "  History cache: %d/%d chats, %u hits, %u misses (%lld ms on flash), %u evictions",
+             st.cached, MIMI_SESSION_CACHE_SLOTS, (unsigned)st.hits, (unsigned)st.misses,
+             (long long)st.load_ms_total, (unsigned)st.evictions);
+
+    session_writer_stats_t ws;
+    session_get_writer_stats(&ws);
+    ESP_LOGI(TAG, "  Writer: %u batches, %u records into %u file appends, %u failed, flush avg %lld ms max %lld ms, "
+             "%d queued (max %d)",
+             (unsigned)ws.batches, (unsigned)ws.records, (unsigned)ws.files, (unsigned)ws.failed,
+             ws.batches ? (long long)(ws.flush_ms_total / ws.batches) : 0LL, (long long)ws.flush_ms_max,
+             ws.pending, ws.pending_max);
 }
@@ -2,6 +2,17 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+
+/*
+ * Where a cached history stood when it was read: a summary computed from
+ * that snapshot can still be applied after the chat has moved on.
+ */
+typedef struct {
+    uint32_t load;                  /* history load generation */
+    uint32_t appended;              /* messages appended since that load */
+} session_mark_t;
 
 /**
  * Initialize session manager.
@@ -9,13 +20,66 @@
 esp_err_t session_mgr_init(void);
 
 /**
- * Append a message to a session file (JSONL format).
+ * Queue a message for the chat's session log (see session_log.h). The
+ * cached history is updated at once; the sess_write task groups queued
+ * records into one append per chat, at most MIMI_SESSION_FLUSH_MS later
+ * or as soon as MIMI_SESSION_FLUSH_BYTES are queued.
  * @param chat_id   Session identifier (e.g., "12345")
  * @param role      "user" or "assistant"
  * @param content   Message text
  */
 esp_err_t session_append(const char *chat_id, const char *role, const char *content);
 
+/**
+ * Queue the user message and final reply of one turn together.
+ */
+esp_err_t session_append_turn(const char *chat_id, const char *user_text, const char *assistant_text);
+
+/**
+ * Write every queued record now and wait for it. Runs automatically on
+ * esp_restart() (shutdown handler); call it before OTA.
+ */
+esp_err_t session_flush(void);
+
+/**
+ * Session history as a cJSON array ready for LLM messages (caller owns it):
+ * [{"role":"user","content":"..."},{"role":"assistant","content":"..."},...]
+ * Served from an in-memory LRU of recent chats kept current by
+ * session_append(); only a cache miss reads the session file. If older
+ * turns were summarized, the summary leads as an extra "user" message.
+ *
+ * @param chat_id   Session identifier
+ * @param max_msgs  Maximum number of messages to return (at most MIMI_SESSION_MAX_MSGS)
+ */
+cJSON *session_get_history(const char *chat_id, int max_msgs);
+
+/**
+ * Number of leading messages of a session_get_history() array that carry
+ * the summary (the summary and its acknowledgement), 0 if it has none.
+ * Trimming should drop verbatim turns after them first.
+ */
+int session_history_summary_msgs(const cJSON *history);
+
+/**
+ * Like session_get_history(), without the summary message. If mark is not
+ * NULL it receives the history's position, for session_set_summary().
+ */
+cJSON *session_get_turns(const char *chat_id, int max_msgs, session_mark_t *mark);
+
+/**
+ * Current summary of the chat's older turns (caller frees), or NULL.
+ */
+char *session_get_summary(const char *chat_id);
+
+/**
+ * Replace the chat's summary and drop all but its last keep messages of the
+ * snapshot taken at mark, plus any appended since. Stored as a "system"
+ * record, so it applies again when the history is next loaded from flash.
+ * @return ESP_ERR_INVALID_STATE if the history was reloaded since mark
+ */
+esp_err_t session_set_summary(const char *chat_id, const char *summary, int keep,
+                              const session_mark_t *mark);
+
 /**
  * Load session history as a JSON array string suitable for LLM messages.
  * Returns the last max_msgs messages as:
@@ -29,11 +93,39 @@ esp_err_t session_append(const char *chat_id, const char *role, const char *cont
 esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size, int max_msgs);
 
 /**
- * Clear a session (delete the file).
+ * Clear a session (delete the log and its index).
  */
 esp_err_t session_clear(const char *chat_id);
 
+/**
+ * Print a session as JSONL to stdout, for debugging.
+ */
+esp_err_t session_export(const char *chat_id);
+
 /**
  * List all session files (prints to log).
  */
 void session_list(void);
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    int64_t load_ms_total;          /* time spent reading session files on misses */
+    int cached;                     /* chats currently cached */
+} session_cache_stats_t;
+
+void session_get_cache_stats(session_cache_stats_t *out);
+
+typedef struct {
+    uint32_t batches;
+    uint32_t records;
+    uint32_t files;                 /* per-chat appends, one log + index open each */
+    uint32_t failed;                /* batches with a failed append */
+    int64_t flush_ms_total;
+    int64_t flush_ms_max;
+    int pending;                    /* records queued right now */
+    int pending_max;
+} session_writer_stats_t;
+
+void session_get_writer_stats(session_writer_stats_t *out);
@@ -11,16 +11,22 @@
 
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "bus/channel_registry.h"
 #include "wifi/wifi_manager.h"
 #include "telegram/telegram_bot.h"
 #include "llm/llm_proxy.h"
 #include "agent/agent_loop.h"
+#include "agent/context_builder.h"
+#include "agent/turn_arena.h"
 #include "memory/memory_store.h"
 #include "memory/session_mgr.h"
+#include "memory/session_compact.h"
 #include "gateway/ws_server.h"
 #include "cli/serial_cli.h"
 #include "proxy/http_proxy.h"
+#include "proxy/http_pool.h"
 #include "tools/tool_registry.h"
+#include "tools/tool_executor.h"
 #include "cron/cron_service.h"
 #include "heartbeat/heartbeat.h"
 #include "buttons/button_driver.h"
@@ -62,37 +68,30 @@ static esp_err_t init_spiffs(void)
     return ESP_OK;
 }
 
-/* Outbound dispatch task: reads from outbound queue and routes to channels */
-static void outbound_dispatch_task(void *arg)
+/* ── Outbound channels ────────────────────────────────────────── */
+
+static esp_err_t system_send(const char *chat_id, const char *text)
 {
-    ESP_LOGI(TAG, "Outbound dispatch started");
-
-    while (1) {
-        mimi_msg_t msg;
-        if (message_bus_pop_outbound(&msg, UINT32_MAX) != ESP_OK) continue;
-
-        ESP_LOGI(TAG, "Dispatching response to %s:%s", msg.channel, msg.chat_id);
-
-        if (strcmp(msg.channel, MIMI_CHAN_TELEGRAM) == 0) {
-            esp_err_t send_err = telegram_send_message(msg.chat_id, msg.content);
-            if (send_err != ESP_OK) {
-                ESP_LOGE(TAG, "Telegram send failed for %s: %s", msg.chat_id, esp_err_to_name(send_err));
-            } else {
-                ESP_LOGI(TAG, "Telegram send success for %s (%d bytes)", msg.chat_id, (int)strlen(msg.content));
-            }
-        } else if (strcmp(msg.channel, MIMI_CHAN_WEBSOCKET) == 0) {
-            esp_err_t ws_err = ws_server_send(msg.chat_id, msg.content);
-            if (ws_err != ESP_OK) {
-                ESP_LOGW(TAG, "WS send failed for %s: %s", msg.chat_id, esp_err_to_name(ws_err));
-            }
-        } else if (strcmp(msg.channel, MIMI_CHAN_SYSTEM) == 0) {
-            ESP_LOGI(TAG, "System message [%s]: %.128s", msg.chat_id, msg.content);
-        } else {
-            ESP_LOGW(TAG, "Unknown channel: %s", msg.channel);
-        }
+    ESP_LOGI(TAG, "System message [%s]: %.128s", chat_id, text);
+    return ESP_OK;
+}
 
-        free(msg.content);
+/* Each channel gets its own outbound queue(s) and dispatcher task(s) */
+static esp_err_t register_channels(void)
+{
+    const channel_desc_t channels[] = {
+        { MIMI_CHAN_TELEGRAM,  telegram_send_message, MIMI_CHAN_TELEGRAM_LANES,
+          MIMI_CHAN_QUEUE_LEN, MIMI_CHAN_TELEGRAM_STACK },
+        { MIMI_CHAN_WEBSOCKET, ws_server_send,        MIMI_CHAN_WS_LANES,
+          MIMI_CHAN_QUEUE_LEN, MIMI_CHAN_WS_STACK },
+        { MIMI_CHAN_SYSTEM,    system_send,           1,
+          MIMI_CHAN_QUEUE_LEN, MIMI_CHAN_SYSTEM_STACK },
+    };
+    for (size_t i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+        esp_err_t err = channel_register(&channels[i]);
+        if (err != ESP_OK) return err;
     }
+    return ESP_OK;
 }
 
 void app_main(void)
@@ -120,22 +119,27 @@ void app_main(void)
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(init_spiffs());
 
-    /* Initialize subsystems */
+    /* Initialize subsystems (cJSON hooks first: nothing may parse JSON before) */
+    ESP_ERROR_CHECK(turn_arena_init());
     ESP_ERROR_CHECK(message_bus_init());
     ESP_ERROR_CHECK(memory_store_init());
     ESP_ERROR_CHECK(skill_loader_init());
     ESP_ERROR_CHECK(session_mgr_init());
     ESP_ERROR_CHECK(wifi_manager_init());
     ESP_ERROR_CHECK(http_proxy_init());
+    ESP_ERROR_CHECK(http_pool_init());
     ESP_ERROR_CHECK(telegram_bot_init());
     ESP_ERROR_CHECK(llm_proxy_init());
     ESP_ERROR_CHECK(tool_registry_init());
+    ESP_ERROR_CHECK(tool_executor_init());
     ESP_ERROR_CHECK(cron_service_init());
     ESP_ERROR_CHECK(heartbeat_init());
+    ESP_ERROR_CHECK(context_builder_init());
     ESP_ERROR_CHECK(agent_loop_init());
 
     /* Start Serial CLI first (works without WiFi) */
     ESP_ERROR_CHECK(serial_cli_init());
+    ESP_ERROR_CHECK(session_compact_start());
 
     /* Start WiFi */
     esp_err_t wifi_err = wifi_manager_start();
@@ -146,12 +150,8 @@ void app_main(void)
         if (wifi_manager_wait_connected(30000) == ESP_OK) {
             ESP_LOGI(TAG, "WiFi connected: %s", wifi_manager_get_ip());
 
-            /* Outbound dispatch task should start first to avoid dropping early replies. */
-            ESP_ERROR_CHECK((xTaskCreatePinnedToCore(
-                outbound_dispatch_task, "outbound",
-                MIMI_OUTBOUND_STACK, NULL,
-                MIMI_OUTBOUND_PRIO, NULL, MIMI_OUTBOUND_CORE) == pdPASS)
-                ? ESP_OK : ESP_FAIL);
+            /* Channel dispatchers should start first to avoid dropping early replies. */
+            ESP_ERROR_CHECK(register_channels());
 
             /* Start network-dependent services */
             ESP_ERROR_CHECK(agent_loop_start());
@@ -25,6 +25,15 @@
 #ifndef MIMI_SECRET_MODEL_PROVIDER
 #define MIMI_SECRET_MODEL_PROVIDER  "anthropic"
 #endif
+#ifndef MIMI_SECRET_LLM_API_URL
+#define MIMI_SECRET_LLM_API_URL     ""
+#endif
+#ifndef MIMI_SECRET_LLM_AUTH
+#define MIMI_SECRET_LLM_AUTH        ""
+#endif
+#ifndef MIMI_SECRET_LLM_MAX_TOKENS
+#define MIMI_SECRET_LLM_MAX_TOKENS  ""
+#endif
 #ifndef MIMI_SECRET_PROXY_HOST
 #define MIMI_SECRET_PROXY_HOST      ""
 #endif
@@ -51,11 +60,28 @@
 
 /* Agent Loop */
 #define MIMI_AGENT_STACK             (24 * 1024)
+#define MIMI_AGENT_WORKERS           2      /* turns of different chats run in parallel */
+#define MIMI_AGENT_DISPATCH_STACK    (3 * 1024)
+#define MIMI_AGENT_COALESCE_MS       500    /* once a burst is queued, merge messages sent within this gap (0 = off) */
+#define MIMI_AGENT_COALESCE_MAX_MS   3000   /* never hold a burst back longer than this */
+#define MIMI_AGENT_SUPERSEDE         1      /* a new message cancels its chat's running turn and joins it */
 #define MIMI_AGENT_PRIO              6
 #define MIMI_AGENT_CORE              1
 #define MIMI_AGENT_MAX_HISTORY       20
 #define MIMI_AGENT_MAX_TOOL_ITER     10
 #define MIMI_MAX_TOOL_CALLS          4
+#define MIMI_ARENA_ENABLE            1      /* per-turn PSRAM arena for cJSON */
+#define MIMI_ARENA_CHUNK_SIZE        (32 * 1024)
+
+/* Tool executor (independent tool calls of one response run concurrently) */
+#define MIMI_TOOL_WORKERS            2
+#define MIMI_TOOL_WORKER_STACK       (12 * 1024)
+#define MIMI_TOOL_WORKER_PRIO        5
+#define MIMI_TOOL_WORKER_CORE        1
+#define MIMI_TOOL_QUEUE_LEN          8
+#define MIMI_TOOL_OUTPUT_SIZE        (8 * 1024)
+#define MIMI_TOOL_TIMEOUT_MS         (30 * 1000)
+#define MIMI_TOOL_CANCEL_POLL_MS     200    /* how often a cancellable run checks its flag */
 #define MIMI_AGENT_SEND_WORKING_STATUS 1
 
 /* Timezone (POSIX TZ format) */
@@ -67,16 +93,51 @@
 #define MIMI_LLM_MAX_TOKENS          4096
 #define MIMI_LLM_API_URL             "https://api.anthropic.com/v1/messages"
 #define MIMI_OPENAI_API_URL          "https://api.openai.com/v1/chat/completions"
+#define MIMI_LLM_API_URL_MAX_LEN     128    /* custom endpoint, e.g. http://192.168.1.50:8080/v1/chat/completions */
 #define MIMI_LLM_API_VERSION         "2023-06-01"
 #define MIMI_LLM_STREAM_BUF_SIZE     (32 * 1024)
+#define MIMI_LLM_STREAM              1
+#define MIMI_LLM_SSE_BUF_SIZE        (8 * 1024)
+#define MIMI_LLM_SSE_MAX_BLOCKS      16
+#define MIMI_LLM_PROMPT_CACHE        1      /* Anthropic cache_control on tools + stable system prompt */
 #define MIMI_LLM_LOG_VERBOSE_PAYLOAD 0
 #define MIMI_LLM_LOG_PREVIEW_BYTES   160
 
+/* HTTP connection pool (direct HTTPS keep-alive) */
+#define MIMI_HTTP_POOL_MAX_CONNS     6
+#define MIMI_HTTP_POOL_PER_HOST      2
+#define MIMI_HTTP_POOL_IDLE_MS       (30 * 1000)
+#define MIMI_HTTP_POOL_BUF_SIZE      4096    /* chunk size for streamed request bodies */
+#define MIMI_HTTP_CANCEL_TASKS       MIMI_AGENT_WORKERS    /* tasks with a cancel token (agent workers) */
+
+/* TLS session cache (proxy tunnel path) */
+#define MIMI_TLS_SESSION_CACHE_SIZE  4
+#define MIMI_TLS_SESSION_TTL_S       (60 * 60)
+
 /* Message Bus */
-#define MIMI_BUS_QUEUE_LEN           16
-#define MIMI_OUTBOUND_STACK          (12 * 1024)
-#define MIMI_OUTBOUND_PRIO           5
+#define MIMI_BUS_QUEUE_LEN           16     /* inbound queue depth per priority class */
+#define MIMI_BUS_SPILL_LEN           32     /* PSRAM overflow per class before dropping */
+#define MIMI_BUS_STRICT_PRIO         0      /* 1 = strict priority, 0 = weighted */
+#define MIMI_BUS_WEIGHT_INTERACTIVE  4      /* turns per round when classes compete */
+#define MIMI_BUS_WEIGHT_SCHEDULED    2
+#define MIMI_BUS_WEIGHT_BACKGROUND   1
+#define MIMI_BUS_PRODUCERS_MAX       8      /* class/channel pairs with their own drop counters */
+#define MIMI_BUS_POOL_SMALL_SIZE     64     /* payload slab classes: capacity x blocks (PSRAM) */
+#define MIMI_BUS_POOL_SMALL_COUNT    32
+#define MIMI_BUS_POOL_MEDIUM_SIZE    512
+#define MIMI_BUS_POOL_MEDIUM_COUNT   16
+#define MIMI_BUS_POOL_LARGE_SIZE     4096
+#define MIMI_BUS_POOL_LARGE_COUNT    8
+#define MIMI_OUTBOUND_PRIO           5      /* channel dispatcher lanes */
 #define MIMI_OUTBOUND_CORE           0
+#define MIMI_CHANNEL_MAX             6
+#define MIMI_CHANNEL_MAX_LANES       4
+#define MIMI_CHAN_QUEUE_LEN          8      /* outbound queue depth per lane */
+#define MIMI_CHAN_TELEGRAM_LANES     1      /* concurrent sends; a chat always uses the same lane */
+#define MIMI_CHAN_TELEGRAM_STACK     (12 * 1024)
+#define MIMI_CHAN_WS_LANES           1
+#define MIMI_CHAN_WS_STACK           (4 * 1024)
+#define MIMI_CHAN_SYSTEM_STACK       (3 * 1024)
 
 /* Memory / SPIFFS */
 #define MIMI_SPIFFS_BASE             "/spiffs"
@@ -87,7 +148,37 @@
 #define MIMI_SOUL_FILE               "/spiffs/config/SOUL.md"
 #define MIMI_USER_FILE               "/spiffs/config/USER.md"
 #define MIMI_CONTEXT_BUF_SIZE        (16 * 1024)
+#define MIMI_CONTEXT_REVALIDATE_MS   (30 * 1000)  /* size/mtime check of cached prompt sections */
+#define MIMI_CONTEXT_TOKEN_BUDGET    8000   /* system prompt + history + current turn (estimated) */
+#define MIMI_BUDGET_SOUL             1000   /* per-part token budgets */
+#define MIMI_BUDGET_USER             1000
+#define MIMI_BUDGET_SKILLS           600
+#define MIMI_BUDGET_MEMORY           1200
+#define MIMI_BUDGET_NOTES            800
+#define MIMI_BUDGET_HISTORY          4000
+#define MIMI_SUMMARY_ENABLE          1      /* fold old turns into a rolling summary */
+#define MIMI_SUMMARY_TRIGGER_TOKENS  2500   /* summarize once the history estimate passes this */
+#define MIMI_SUMMARY_KEEP_MSGS       6      /* newest messages always sent verbatim */
+#define MIMI_SUMMARY_MAX_TOKENS      400    /* output cap of the summarization call */
+#define MIMI_SUMMARY_INPUT_CHARS     12000  /* transcript sent to the summarizer */
+#define MIMI_SUMMARY_MAX_CHARS       2000   /* stored summary, LLM or extractive */
 #define MIMI_SESSION_MAX_MSGS        20
+#define MIMI_SESSION_CACHE_SLOTS     8      /* chats whose parsed history stays in memory */
+#define MIMI_SESSION_FLUSH_MS        2000   /* write-behind: max time a record stays queued */
+#define MIMI_SESSION_FLUSH_BYTES     (16 * 1024)  /* ...or flush as soon as this much is queued */
+#define MIMI_SESSION_WRITER_STACK    (4 * 1024)
+#define MIMI_SESSION_WRITER_PRIO     2
+#define MIMI_SESSION_WRITER_CORE     0
+#define MIMI_SESSION_KEEP_RECS       200    /* records a compacted session log keeps */
+#define MIMI_SESSION_COMPACT_SLACK   50     /* growth past KEEP_RECS before a rewrite */
+#define MIMI_SESSION_CHAT_QUOTA      (128 * 1024)
+#define MIMI_SESSION_TOTAL_QUOTA     (4 * 1024 * 1024)
+#define MIMI_SESSION_COMPACT_SUMMARY 1      /* fold dropped records into a summary record */
+#define MIMI_SESSION_COMPACT_FIRST_MS    (60 * 1000)
+#define MIMI_SESSION_COMPACT_INTERVAL_MS (10 * 60 * 1000)
+#define MIMI_SESSION_COMPACT_STACK   (4 * 1024)
+#define MIMI_SESSION_COMPACT_PRIO    1
+#define MIMI_SESSION_COMPACT_CORE    0
 
 /* Cron / Heartbeat */
 #define MIMI_CRON_FILE               "/spiffs/cron.json"
@@ -122,5 +213,8 @@
 #define MIMI_NVS_KEY_API_KEY         "api_key"
 #define MIMI_NVS_KEY_MODEL           "model"
 #define MIMI_NVS_KEY_PROVIDER        "provider"
+#define MIMI_NVS_KEY_LLM_URL         "api_url"
+#define MIMI_NVS_KEY_LLM_AUTH        "auth_style"
+#define MIMI_NVS_KEY_LLM_MAX_TOKENS  "max_tokens"
 #define MIMI_NVS_KEY_PROXY_HOST      "host"
 #define MIMI_NVS_KEY_PROXY_PORT      "port"
@@ -1,4 +1,5 @@
 #include "ota_manager.h"
+#include "memory/session_mgr.h"
 
 #include "esp_log.h"
 #include "esp_ota_ops.h"
@@ -12,6 +13,9 @@ esp_err_t ota_update_from_url(const char *url)
 {
     ESP_LOGI(TAG, "Starting OTA from: %s", url);
 
+    /* Queued session records must not depend on the download finishing */
+    session_flush();
+
     esp_http_client_config_t config = {
         .url = url,
         .timeout_ms = 120000,
@@ -0,0 +1,542 @@
+#include "http_pool.h"
+#include "mimi_config.h"
+#include "proxy/http_proxy.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "http_pool";
+
+typedef struct {
+    char host[64];                    /* empty = free slot */
+    int port;
+    bool tls;                         /* false: plain http:// (LAN endpoints, never proxied) */
+    bool proxied;                     /* conn runs through the CONNECT/SOCKS5 tunnel */
+    proxy_conn_t *conn;
+    bool busy;
+    int64_t last_used_us;
+    uint32_t uses;
+
+    /* Per-request state, only touched by the owning task */
+    bool saw_connect;
+    bool saw_data;
+    bool sent;                        /* request head and body fully written */
+    http_cancel_t *cancel;
+} pool_slot_t;
+
+/* Cancel tokens by task (guarded by s_lock) */
+typedef struct {
+    TaskHandle_t task;
+    http_cancel_t *cancel;
+} cancel_binding_t;
+
+static pool_slot_t s_slots[MIMI_HTTP_POOL_MAX_CONNS];
+static cancel_binding_t s_bindings[MIMI_HTTP_CANCEL_TASKS];
+static http_pool_stats_t s_stats;
+static SemaphoreHandle_t s_lock;
+
+/* ── Helpers ──────────────────────────────────────────────────── */
+
+/* Split scheme://host[:port]/path; path points into url ("/" if absent) */
+static const char *url_split(const char *url, char *host, size_t size, int *port, bool *is_tls)
+{
+    const char *p = strstr(url, "://");
+    bool tls = (strncmp(url, "http://", 7) != 0);
+    if (is_tls) *is_tls = tls;
+    p = p ? p + 3 : url;
+
+    size_t n = strcspn(p, ":/?");
+    size_t copy = n < size ? n : size - 1;
+    memcpy(host, p, copy);
+    host[copy] = '\0';
+    p += n;
+
+    *port = tls ? 443 : 80;
+    if (*p == ':') {
+        *port = atoi(p + 1);
+        p += strcspn(p, "/?");
+    }
+    return *p ? p : "/";
+}
+
+/*
+ * Chunked request body: writer output is gathered into chunks of up to
+ * MIMI_HTTP_POOL_BUF_SIZE bytes, each sent as one write (size line, data
+ * and CRLF together) so small writer flushes don't become TLS records.
+ */
+#define CHUNK_HEAD_ROOM 8                 /* "%x\r\n" for a size below 16^6 */
+
+typedef struct {
+    proxy_conn_t *conn;
+    char *buf;                            /* CHUNK_HEAD_ROOM + data + CRLF */
+    size_t len;
+} chunk_out_t;
+
+static esp_err_t chunk_flush(chunk_out_t *co)
+{
+    if (co->len == 0) return ESP_OK;
+    char size_line[CHUNK_HEAD_ROOM + 1];
+    int hl = snprintf(size_line, sizeof(size_line), "%x\r\n", (unsigned)co->len);
+    char *start = co->buf + CHUNK_HEAD_ROOM - hl;
+    memcpy(start, size_line, hl);
+    memcpy(co->buf + CHUNK_HEAD_ROOM + co->len, "\r\n", 2);
+    int total = hl + (int)co->len + 2;
+    co->len = 0;
+    return proxy_conn_write(co->conn, start, total) < 0 ? ESP_ERR_HTTP_WRITE_DATA : ESP_OK;
+}
+
+static esp_err_t chunk_sink(const char *data, size_t len, void *ctx)
+{
+    chunk_out_t *co = (chunk_out_t *)ctx;
+    while (len > 0) {
+        size_t room = MIMI_HTTP_POOL_BUF_SIZE - co->len;
+        size_t take = len < room ? len : room;
+        memcpy(co->buf + CHUNK_HEAD_ROOM + co->len, data, take);
+        co->len += take;
+        data += take;
+        len -= take;
+        if (co->len == MIMI_HTTP_POOL_BUF_SIZE) {
+            esp_err_t err = chunk_flush(co);
+            if (err != ESP_OK) return err;
+        }
+    }
+    return ESP_OK;
+}
+
+/* Drop the underlying connection, keep the slot */
+static void slot_disconnect(pool_slot_t *slot)
+{
+    if (slot->conn) {
+        proxy_conn_close(slot->conn);
+        slot->conn = NULL;
+    }
+}
+
+static void slot_free(pool_slot_t *slot)
+{
+    if (slot->conn) proxy_conn_close(slot->conn);
+    memset(slot, 0, sizeof(*slot));
+}
+
+/* Call with s_lock held */
+static void evict_idle_locked(bool force, bool proxied)
+{
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < MIMI_HTTP_POOL_MAX_CONNS; i++) {
+        pool_slot_t *slot = &s_slots[i];
+        if (!slot->host[0] || slot->busy) continue;
+        /* TLS slots from the other transport mode are stale after a proxy change */
+        if (force || (slot->tls && slot->proxied != proxied) ||
+            now - slot->last_used_us > (int64_t)MIMI_HTTP_POOL_IDLE_MS * 1000) {
+            ESP_LOGD(TAG, "Evicting idle connection to %s", slot->host);
+            slot_free(slot);
+            s_stats.evictions++;
+        }
+    }
+}
+
+/* Returns a busy slot for host, or NULL when the per-host / total limit is reached */
+static pool_slot_t *slot_acquire(const char *host, int port, bool tls, bool proxied)
+{
+    pool_slot_t *slot = NULL;
+    pool_slot_t *free_slot = NULL;
+    int host_count = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    evict_idle_locked(false, proxied);
+
+    for (int i = 0; i < MIMI_HTTP_POOL_MAX_CONNS; i++) {
+        pool_slot_t *s = &s_slots[i];
+        if (!s->host[0]) {
+            if (!free_slot) free_slot = s;
+            continue;
+        }
+        if (strcmp(s->host, host) != 0 || s->port != port || s->tls != tls ||
+            s->proxied != proxied) continue;
+        host_count++;
+        if (!s->busy && !slot) slot = s;
+    }
+
+    if (!slot && free_slot && host_count < MIMI_HTTP_POOL_PER_HOST) {
+        slot = free_slot;
+        strncpy(slot->host, host, sizeof(slot->host) - 1);
+        slot->port = port;
+        slot->tls = tls;
+        slot->proxied = proxied;
+    }
+    if (slot) slot->busy = true;
+
+    xSemaphoreGive(s_lock);
+    return slot;
+}
+
+static void slot_release(pool_slot_t *slot, bool keep)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (keep) {
+        slot->busy = false;
+        slot->last_used_us = esp_timer_get_time();
+        slot->uses++;
+    } else {
+        slot_free(slot);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static void stats_record(const pool_slot_t *slot, bool retried, bool overflow)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.requests++;
+    if (slot->saw_connect) {
+        s_stats.handshakes++;
+    } else {
+        s_stats.reused++;
+    }
+    if (retried) s_stats.retries++;
+    if (overflow) s_stats.overflow++;
+    xSemaphoreGive(s_lock);
+}
+
+/* ── Cancellation ─────────────────────────────────────────────── */
+
+static http_cancel_t *cancel_current(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    http_cancel_t *cancel = NULL;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_HTTP_CANCEL_TASKS; i++) {
+        if (s_bindings[i].task == self) {
+            cancel = s_bindings[i].cancel;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return cancel;
+}
+
+/* Publish the connection to the canceller; false if the token already fired */
+static bool cancel_arm(http_cancel_t *cancel, proxy_conn_t *conn)
+{
+    if (!cancel) return true;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = !cancel->fired;
+    if (ok) cancel->conn = conn;
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+/* The connection is about to be reused or closed; returns whether the token fired meanwhile */
+static bool cancel_disarm(http_cancel_t *cancel)
+{
+    if (!cancel) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cancel->conn = NULL;
+    bool fired = cancel->fired;
+    xSemaphoreGive(s_lock);
+    return fired;
+}
+
+/* ── Transport: TLS connection + http_reader ──────────────────── */
+
+static esp_err_t write_head(pool_slot_t *slot, const http_pool_req_t *req,
+                            const char *host, int port, const char *path)
+{
+    char head[1024];
+    int hlen = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s",
+                        req->method == HTTP_METHOD_POST ? "POST" : "GET", path, host);
+    /* RFC 7230 5.4: the port is part of Host unless it is the scheme's default */
+    if (port != (slot->tls ? 443 : 80) && hlen < (int)sizeof(head)) {
+        hlen += snprintf(head + hlen, sizeof(head) - hlen, ":%d", port);
+    }
+    if (hlen < (int)sizeof(head)) {
+        hlen += snprintf(head + hlen, sizeof(head) - hlen, "\r\n");
+    }
+    for (int i = 0; i < req->header_count && hlen < (int)sizeof(head); i++) {
+        hlen += snprintf(head + hlen, sizeof(head) - hlen, "%s: %s\r\n",
+                         req->headers[i].name, req->headers[i].value);
+    }
+    if (req->body_writer && hlen < (int)sizeof(head)) {
+        hlen += snprintf(head + hlen, sizeof(head) - hlen, "Transfer-Encoding: chunked\r\n");
+    } else if (req->body && hlen < (int)sizeof(head)) {
+        hlen += snprintf(head + hlen, sizeof(head) - hlen, "Content-Length: %d\r\n", req->body_len);
+    }
+    if (hlen < (int)sizeof(head)) {
+        hlen += snprintf(head + hlen, sizeof(head) - hlen, "\r\n");
+    }
+    if (hlen >= (int)sizeof(head)) {
+        ESP_LOGE(TAG, "Request head for %s too large", host);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (proxy_conn_write(slot->conn, head, hlen) < 0) return ESP_ERR_HTTP_WRITE_DATA;
+    return ESP_OK;
+}
+
+static esp_err_t write_body(pool_slot_t *slot, const http_pool_req_t *req)
+{
+    if (req->body_writer) {
+        chunk_out_t co = { .conn = slot->conn };
+        co.buf = heap_caps_malloc(CHUNK_HEAD_ROOM + MIMI_HTTP_POOL_BUF_SIZE + 2, MALLOC_CAP_SPIRAM);
+        if (!co.buf) return ESP_ERR_NO_MEM;
+        esp_err_t err = req->body_writer(chunk_sink, &co, req->body_ctx);
+        if (err == ESP_OK) err = chunk_flush(&co);
+        free(co.buf);
+        if (err == ESP_OK && proxy_conn_write(slot->conn, "0\r\n\r\n", 5) < 0) {
+            err = ESP_ERR_HTTP_WRITE_DATA;
+        }
+        return err;
+    }
+    if (req->body && proxy_conn_write(slot->conn, req->body, req->body_len) < 0) {
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t slot_exchange(pool_slot_t *slot, const http_pool_req_t *req,
+                               int *out_status, bool *keep)
+{
+    char host[64];
+    int port;
+    const char *path = url_split(req->url, host, sizeof(host), &port, NULL);
+    *keep = false;
+
+    if (!slot->conn) {
+        if (!slot->tls) {
+            slot->conn = proxy_conn_open_plain(host, port, req->timeout_ms);
+        } else if (slot->proxied) {
+            slot->conn = proxy_conn_open(host, port, req->timeout_ms);
+        } else {
+            slot->conn = proxy_conn_open_direct(host, port, req->timeout_ms);
+        }
+        if (!slot->conn) return ESP_ERR_HTTP_CONNECT;
+        slot->saw_connect = true;
+    }
+    if (!cancel_arm(slot->cancel, slot->conn)) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = write_head(slot, req, host, port, path);
+    if (err == ESP_OK) err = write_body(slot, req);
+    if (err == ESP_OK) {
+        slot->sent = true;
+        http_reader_t reader;
+        http_reader_init(&reader, req->on_body, req->user_data);
+        err = http_reader_run(&reader, slot->conn, req->timeout_ms);
+
+        *out_status = reader.status;
+        slot->saw_data = reader.bytes_in > 0;
+        *keep = (err == ESP_OK && http_reader_keep_alive(&reader));
+    }
+
+    /* A fired token may have shut the socket down: never reuse it */
+    if (cancel_disarm(slot->cancel)) {
+        *keep = false;
+        if (err != ESP_OK) err = ESP_ERR_INVALID_STATE;
+    }
+    return err;
+}
+
+/* ── Request execution ────────────────────────────────────────── */
+
+static esp_err_t slot_perform(pool_slot_t *slot, const http_pool_req_t *req,
+                              int *out_status, bool *keep)
+{
+    slot->saw_connect = false;
+    slot->saw_data = false;
+    slot->sent = false;
+
+    esp_err_t err = slot_exchange(slot, req, out_status, keep);
+    if (!*keep) slot_disconnect(slot);
+    return err;
+}
+
+static void stats_cancelled(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.cancelled++;
+    xSemaphoreGive(s_lock);
+}
+
+static esp_err_t perform_oneshot(const http_pool_req_t *req, bool tls, bool proxied,
+                                 http_cancel_t *cancel, int *out_status)
+{
+    pool_slot_t slot = { .tls = tls, .proxied = proxied, .cancel = cancel };
+    bool keep;
+    esp_err_t err = slot_perform(&slot, req, out_status, &keep);
+    stats_record(&slot, false, true);
+    if (err == ESP_ERR_INVALID_STATE) stats_cancelled();
+    if (slot.conn) proxy_conn_close(slot.conn);
+    return err;
+}
+
+esp_err_t http_pool_perform(const http_pool_req_t *req, int *out_status)
+{
+    *out_status = 0;
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    char host[64];
+    int port;
+    bool tls;
+    url_split(req->url, host, sizeof(host), &port, &tls);
+    /* Plain http:// targets are LAN endpoints: always connected directly */
+    bool proxied = tls && http_proxy_is_enabled();
+
+    http_cancel_t *cancel = cancel_current();
+    if (cancel && cancel->fired) {
+        stats_cancelled();
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    pool_slot_t *slot = slot_acquire(host, port, tls, proxied);
+    if (!slot) {
+        ESP_LOGD(TAG, "No free connection for %s, using one-shot connection", host);
+        return perform_oneshot(req, tls, proxied, cancel, out_status);
+    }
+    slot->cancel = cancel;
+
+    /* The server may have closed the idle connection meanwhile: find out before sending */
+    if (slot->conn && !proxy_conn_alive(slot->conn)) {
+        ESP_LOGD(TAG, "Idle connection to %s was closed by the peer, reconnecting", host);
+        slot_disconnect(slot);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_stats.stale++;
+        xSemaphoreGive(s_lock);
+    }
+
+    bool reused = slot->uses > 0 && slot->conn;
+    bool retried = false;
+    bool keep = false;
+    esp_err_t err = slot_perform(slot, req, out_status, &keep);
+
+    /* A reused connection can still die under the request: reconnect once, but
+     * only if the request never fully went out (or repeating it is harmless)
+     * and nothing reached the caller's callback yet. A POST that was sent may
+     * have been executed, so it is not sent twice. */
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE && reused &&
+        !slot->saw_connect && !slot->saw_data &&
+        (!slot->sent || req->method == HTTP_METHOD_GET)) {
+        ESP_LOGW(TAG, "Reused connection to %s failed (%s), reconnecting",
+                 host, esp_err_to_name(err));
+        slot_disconnect(slot);
+        retried = true;
+        err = slot_perform(slot, req, out_status, &keep);
+    }
+
+    stats_record(slot, retried, false);
+    if (err == ESP_ERR_INVALID_STATE) {
+        ESP_LOGI(TAG, "Request to %s cancelled", host);
+        stats_cancelled();
+    }
+    slot->cancel = NULL;
+
+    /* Connection state is unknown after a failure: do not reuse the slot */
+    slot_release(slot, err == ESP_OK);
+    return err;
+}
+
+/* ── Public ───────────────────────────────────────────────────── */
+
+esp_err_t http_pool_init(void)
+{
+    memset(s_slots, 0, sizeof(s_slots));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    ESP_LOGI(TAG, "HTTP pool ready (%d connections, %d per host, idle %d ms)",
+             MIMI_HTTP_POOL_MAX_CONNS, MIMI_HTTP_POOL_PER_HOST, MIMI_HTTP_POOL_IDLE_MS);
+    return ESP_OK;
+}
+
+esp_err_t http_pool_cancel_attach(http_cancel_t *cancel)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    cancel_binding_t *slot = NULL;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_HTTP_CANCEL_TASKS; i++) {
+        if (s_bindings[i].task == self) {
+            slot = &s_bindings[i];
+            break;
+        }
+        if (!slot && !s_bindings[i].task) slot = &s_bindings[i];
+    }
+    if (slot) {
+        slot->task = cancel ? self : NULL;
+        slot->cancel = cancel;
+    }
+    xSemaphoreGive(s_lock);
+    return slot || !cancel ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void http_pool_cancel_fire(http_cancel_t *cancel)
+{
+    if (!s_lock || !cancel) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cancel->fired = true;
+    /* The owner clears conn under the lock before closing it, so it is still open here */
+    if (cancel->conn) proxy_conn_shutdown(cancel->conn);
+    xSemaphoreGive(s_lock);
+}
+
+void http_pool_cancel_reset(http_cancel_t *cancel)
+{
+    if (!s_lock || !cancel) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cancel->fired = false;
+    cancel->conn = NULL;
+    xSemaphoreGive(s_lock);
+}
+
+void http_pool_evict_idle(bool force)
+{
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    evict_idle_locked(force, http_proxy_is_enabled());
+    xSemaphoreGive(s_lock);
+}
+
+void http_pool_get_stats(http_pool_stats_t *out)
+{
+    if (!s_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
+
+void http_pool_dump(void)
+{
+    if (!s_lock) {
+        printf("HTTP pool not initialized\n");
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    int open = 0;
+    for (int i = 0; i < MIMI_HTTP_POOL_MAX_CONNS; i++) {
+        const pool_slot_t *slot = &s_slots[i];
+        if (!slot->host[0]) continue;
+        open++;
+        printf("  [%d] %-28s %-6s %-4s uses=%u idle=%llds\n", i, slot->host,
+               !slot->tls ? "plain" : slot->proxied ? "proxy" : "direct", slot->busy ? "busy" : "idle",
+               (unsigned)slot->uses,
+               slot->busy ? 0LL : (long long)((now - slot->last_used_us) / 1000000));
+    }
+    http_pool_stats_t st = s_stats;
+    xSemaphoreGive(s_lock);
+
+    if (open == 0) printf("  (no open connections)\n");
+    printf("Requests: %u  reused: %u  handshakes: %u  retries: %u  stale: %u  evictions: %u  one-shot: %u  cancelled: %u\n",
+           (unsigned)st.requests, (unsigned)st.reused, (unsigned)st.handshakes,
+           (unsigned)st.retries, (unsigned)st.stale, (unsigned)st.evictions, (unsigned)st.overflow,
+           (unsigned)st.cancelled);
+}
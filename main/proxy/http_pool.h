@@ -0,0 +1,99 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+#include "proxy/http_reader.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ── Keep-alive HTTPS connection pool (direct + proxy) ────────── */
+
+typedef struct {
+    const char *name;
+    const char *value;
+} http_pool_header_t;
+
+/* Byte sink handed to a body writer; writes straight into the connection */
+typedef esp_err_t (*http_pool_sink_t)(const char *data, size_t len, void *sink_ctx);
+
+typedef struct {
+    const char *url;                     /* full https:// URL; host selects the pool slot */
+    esp_http_client_method_t method;
+    const http_pool_header_t *headers;
+    int header_count;
+    const char *body;                    /* NULL for no request body */
+    int body_len;                        /* length of body (Content-Length) */
+    /* Alternative to body: produce the body through sink, of any length; it
+     * is sent with Transfer-Encoding: chunked.
+     * May be called again if a stale reused connection is retried. */
+    esp_err_t (*body_writer)(http_pool_sink_t sink, void *sink_ctx, void *body_ctx);
+    void *body_ctx;
+    http_body_cb_t on_body;              /* response body as it arrives, with the status */
+    void *user_data;
+    int timeout_ms;
+} http_pool_req_t;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t reused;                     /* served on an already-open connection */
+    uint32_t handshakes;                 /* new TCP + TLS connections */
+    uint32_t retries;                    /* reused connection failed before the request went out, retried once */
+    uint32_t stale;                      /* idle connection found closed by the pre-reuse probe */
+    uint32_t evictions;                  /* idle connections closed */
+    uint32_t overflow;                   /* all slots busy, one-shot connection used */
+    uint32_t cancelled;                  /* requests cut short by http_pool_cancel_fire() */
+} http_pool_stats_t;
+
+/*
+ * Cancel token for the requests of one task. Once it fires, a request in
+ * flight on that task is cut off (its socket is shut down) and later ones
+ * fail before connecting, with ESP_ERR_INVALID_STATE, until it is reset.
+ */
+typedef struct {
+    volatile bool fired;
+    proxy_conn_t *conn;                  /* connection of the request in flight; pool lock */
+} http_cancel_t;
+
+/**
+ * Initialize the pool (mutex + slot table). No connections are opened.
+ */
+esp_err_t http_pool_init(void);
+
+/**
+ * Perform one request on a pooled connection to the URL's host.
+ * The request head is written by hand over a TLS connection (direct, or
+ * through the CONNECT/SOCKS5 tunnel when a proxy is set) and the response
+ * is framed by http_reader.
+ * An idle connection is reused when available; otherwise a new one is opened
+ * (up to MIMI_HTTP_POOL_PER_HOST per host, then a one-shot connection).
+ * An idle connection is probed before reuse and replaced if the peer closed it.
+ * A reused connection that fails anyway is reconnected once, only if no
+ * response data arrived and the request was not fully sent (GETs excepted):
+ * a POST is never delivered twice.
+ */
+esp_err_t http_pool_perform(const http_pool_req_t *req, int *out_status);
+
+/**
+ * Attach a token to the calling task for all its later requests, through
+ * whichever module issues them. NULL detaches.
+ * @return ESP_ERR_NO_MEM if MIMI_HTTP_CANCEL_TASKS tasks already have one
+ */
+esp_err_t http_pool_cancel_attach(http_cancel_t *cancel);
+
+/** Fire the token; any task. */
+void http_pool_cancel_fire(http_cancel_t *cancel);
+
+/** Re-arm the token for the next request; owning task, between requests. */
+void http_pool_cancel_reset(http_cancel_t *cancel);
+
+/**
+ * Close connections idle longer than MIMI_HTTP_POOL_IDLE_MS (all idle ones if force).
+ */
+void http_pool_evict_idle(bool force);
+
+/** Snapshot cumulative counters. */
+void http_pool_get_stats(http_pool_stats_t *out);
+
+/** Print per-host slot state and counters to stdout (CLI). */
+void http_pool_dump(void);
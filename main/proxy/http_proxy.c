@@ -4,14 +4,21 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/select.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs.h"
 #include "esp_tls.h"
 #include "esp_crt_bundle.h"
+#include "mbedtls/ssl.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 static const char *TAG = "proxy";
 
@@ -24,9 +31,19 @@ __attribute__((constructor)) static void proxy_log_level(void)
 static char     s_proxy_host[64] = {0};
 static uint16_t s_proxy_port     = 0;
 static char     s_proxy_type[8] = "http"; // "http" or "socks5"
+static struct sockaddr_in s_proxy_addr;    /* resolved proxy address, reused per tunnel */
+static bool     s_proxy_addr_valid = false;
+static proxy_stats_t s_stats;
+
+static void proxy_resolve_invalidate(void);
+static proxy_conn_t *conn_tls_start(int sock, const char *host, int port, int timeout_ms);
+static SemaphoreHandle_t s_lock;           /* guards TLS session cache, resolved address, stats */
 
 esp_err_t http_proxy_init(void)
 {
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
     /* Start with build-time defaults */
     if (MIMI_SECRET_PROXY_HOST[0] != '\0' && MIMI_SECRET_PROXY_PORT[0] != '\0') {
         strncpy(s_proxy_host, MIMI_SECRET_PROXY_HOST, sizeof(s_proxy_host) - 1);
@@ -78,6 +95,8 @@ esp_err_t http_proxy_set(const char *host, uint16_t port, const char *type)
     strncpy(s_proxy_host, host, sizeof(s_proxy_host) - 1);
     s_proxy_port = port;
     strncpy(s_proxy_type, type, sizeof(s_proxy_type) - 1);
+    http_proxy_flush_tls_sessions();
+    proxy_resolve_invalidate();
     ESP_LOGI(TAG, "Proxy set to %s:%d (%s)", s_proxy_host, s_proxy_port, s_proxy_type);
     return ESP_OK;
 }
@@ -95,6 +114,8 @@ esp_err_t http_proxy_clear(void)
     s_proxy_host[0] = '\0';
     s_proxy_port = 0;
     strcpy(s_proxy_type, "http"); // Reset to default
+    http_proxy_flush_tls_sessions();
+    proxy_resolve_invalidate();
     ESP_LOGI(TAG, "Proxy cleared");
     return ESP_OK;
 }
@@ -104,84 +125,272 @@ bool http_proxy_is_enabled(void)
     return s_proxy_host[0] != '\0' && s_proxy_port != 0;
 }
 
-/* ── Proxied TLS connection ───────────────────────────────────── */
+/* ── TLS session cache ────────────────────────────────────────── */
 
-struct proxy_conn {
-    int         sock;   /* raw TCP socket (for timeout control) */
-    esp_tls_t  *tls;    /* esp_tls handle owns TLS + socket lifecycle */
-};
+/*
+ * One resumable session per host. A session is taken out of the cache for the
+ * duration of a handshake and replaced by the fresh one the server issues, so
+ * concurrent opens never share (or free) a session that mbedtls is reading.
+ */
+typedef struct {
+    char host[64];
+    esp_tls_client_session_t *session;
+    int64_t stored_us;
+} tls_session_entry_t;
+
+static tls_session_entry_t s_sessions[MIMI_TLS_SESSION_CACHE_SIZE];
 
-/* Read a line from socket (up to CR-LF). Returns length or -1. */
-static int sock_read_line(int fd, char *buf, int max, int timeout_ms)
+static void proxy_lock(void)
 {
-    int pos = 0;
-    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
-    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+}
+
+static void proxy_unlock(void)
+{
+    xSemaphoreGive(s_lock);
+}
+
+static void session_entry_clear(tls_session_entry_t *e)
+{
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (e->session) esp_tls_free_client_session(e->session);
+#endif
+    memset(e, 0, sizeof(*e));
+}
 
-    while (pos < max - 1) {
-        char c;
-        int r = recv(fd, &c, 1, 0);
-        if (r <= 0) return -1;
-        if (c == '\n') { buf[pos] = '\0'; return pos; }
-        if (c != '\r') buf[pos++] = c;
+/* Remove and return the cached session for host (caller owns it), or NULL */
+static esp_tls_client_session_t *session_take(const char *host)
+{
+    esp_tls_client_session_t *session = NULL;
+    int64_t now = esp_timer_get_time();
+
+    proxy_lock();
+    for (int i = 0; i < MIMI_TLS_SESSION_CACHE_SIZE; i++) {
+        tls_session_entry_t *e = &s_sessions[i];
+        if (!e->session || strcmp(e->host, host) != 0) continue;
+        if (now - e->stored_us > (int64_t)MIMI_TLS_SESSION_TTL_S * 1000000) {
+            session_entry_clear(e);
+        } else {
+            session = e->session;
+            memset(e, 0, sizeof(*e));
+        }
+        break;
     }
-    buf[pos] = '\0';
-    return pos;
+    proxy_unlock();
+    return session;
 }
 
-/* Open TCP + CONNECT tunnel for HTTP proxy, returns socket fd or -1 */
-static int open_connect_tunnel(const char *host, int port, int timeout_ms)
+/* Store a session for host, replacing an existing or the oldest entry */
+static void session_put(const char *host, esp_tls_client_session_t *session)
 {
-    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
-    struct addrinfo *res = NULL;
-    char port_str[8];
-    snprintf(port_str, sizeof(port_str), "%d", s_proxy_port);
+    proxy_lock();
+    tls_session_entry_t *slot = NULL;
+    for (int i = 0; i < MIMI_TLS_SESSION_CACHE_SIZE; i++) {
+        tls_session_entry_t *e = &s_sessions[i];
+        if (e->session && strcmp(e->host, host) == 0) { slot = e; break; }
+        if (!slot || (slot->session && (!e->session || e->stored_us < slot->stored_us))) {
+            slot = e;
+        }
+    }
+    session_entry_clear(slot);
+    strncpy(slot->host, host, sizeof(slot->host) - 1);
+    slot->session = session;
+    slot->stored_us = esp_timer_get_time();
+    proxy_unlock();
+}
 
-    if (getaddrinfo(s_proxy_host, port_str, &hints, &res) != 0 || !res) {
-        ESP_LOGE(TAG, "DNS resolve failed for proxy %s", s_proxy_host);
-        return -1;
+/*
+ * Resumption is seen in the handshake itself: a resumed session (ticket or
+ * session ID, TLS 1.2 or 1.3 PSK) skips the server Certificate message, so
+ * the verify callback never runs. The bundle's callback is wrapped for the
+ * handshake running on this task to note whether it was called.
+ */
+typedef struct {
+    int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *);
+    void *p_vrfy;
+    bool saw_cert;
+} tls_cert_probe_t;
+
+static __thread tls_cert_probe_t *t_cert_probe;
+
+static int probe_verify(void *ctx, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
+{
+    tls_cert_probe_t *probe = (tls_cert_probe_t *)ctx;
+    probe->saw_cert = true;
+    return probe->f_vrfy ? probe->f_vrfy(probe->p_vrfy, crt, depth, flags) : 0;
+}
+
+static esp_err_t probe_bundle_attach(void *conf)
+{
+    esp_err_t err = esp_crt_bundle_attach(conf);
+    tls_cert_probe_t *probe = t_cert_probe;
+    if (err == ESP_OK && probe) {
+        mbedtls_ssl_config *ssl_conf = (mbedtls_ssl_config *)conf;
+        probe->f_vrfy = ssl_conf->MBEDTLS_PRIVATE(f_vrfy);
+        probe->p_vrfy = ssl_conf->MBEDTLS_PRIVATE(p_vrfy);
+        mbedtls_ssl_conf_verify(ssl_conf, probe_verify, probe);
     }
+    return err;
+}
 
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { freeaddrinfo(res); return -1; }
+static void session_record(bool resumed, bool ok, int64_t elapsed_us)
+{
+    uint32_t ms = (uint32_t)(elapsed_us / 1000);
+    proxy_lock();
+    if (!ok) {
+        s_stats.tls_failed++;
+    } else if (resumed) {
+        s_stats.tls_resumed++;
+        s_stats.tls_resumed_ms_total += ms;
+    } else {
+        s_stats.tls_full++;
+        s_stats.tls_full_ms_total += ms;
+    }
+    proxy_unlock();
+}
 
-    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
-    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+void http_proxy_get_stats(proxy_stats_t *out)
+{
+    proxy_lock();
+    *out = s_stats;
+    proxy_unlock();
+}
 
-    if (connect(sock, res->ai_addr, res->ai_addrlen) != 0) {
-        ESP_LOGE(TAG, "TCP connect to proxy %s:%d failed", s_proxy_host, s_proxy_port);
-        freeaddrinfo(res); close(sock); return -1;
+void http_proxy_flush_tls_sessions(void)
+{
+    proxy_lock();
+    for (int i = 0; i < MIMI_TLS_SESSION_CACHE_SIZE; i++) {
+        session_entry_clear(&s_sessions[i]);
     }
-    freeaddrinfo(res);
-    ESP_LOGI(TAG, "Connected to proxy %s:%d", s_proxy_host, s_proxy_port);
+    proxy_unlock();
+}
 
-    char req[256];
-    int len = snprintf(req, sizeof(req),
-        "CONNECT %s:%d HTTP/1.1\r\nHost: %s:%d\r\n\r\n", host, port, host, port);
+/* ── TLS connection (proxied or direct) ───────────────────────── */
+
+struct proxy_conn {
+    int         sock;   /* raw TCP socket (for timeout control) */
+    esp_tls_t  *tls;    /* esp_tls handle owns TLS + socket lifecycle; NULL for plain TCP */
+};
+
+/* ── Tunnel setup: deadline-bounded socket I/O ────────────────── */
 
-    if (send(sock, req, len, 0) != len) {
-        ESP_LOGE(TAG, "Failed to send CONNECT"); close(sock); return -1;
+static int remaining_ms(int64_t deadline_us)
+{
+    int64_t left = deadline_us - esp_timer_get_time();
+    return left > 0 ? (int)(left / 1000) : 0;
+}
+
+/* Wait for fd readable (or writable). Returns 1 ready, 0 deadline passed, -1 error */
+static int sock_wait(int fd, bool for_write, int64_t deadline_us)
+{
+    while (1) {
+        int ms = remaining_ms(deadline_us);
+        if (ms <= 0) return 0;
+
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(fd, &set);
+        struct timeval tv = { .tv_sec = ms / 1000, .tv_usec = (ms % 1000) * 1000 };
+        int r = select(fd + 1, for_write ? NULL : &set, for_write ? &set : NULL, NULL, &tv);
+        if (r < 0 && errno == EINTR) continue;
+        return r > 0 ? 1 : r;
     }
+}
 
-    char line[256];
-    if (sock_read_line(sock, line, sizeof(line), timeout_ms) < 0) {
-        ESP_LOGE(TAG, "No response from proxy"); close(sock); return -1;
+static bool sock_send_all(int fd, const void *data, size_t len, int64_t deadline_us)
+{
+    const char *p = (const char *)data;
+    size_t sent = 0;
+    while (sent < len) {
+        if (sock_wait(fd, true, deadline_us) <= 0) return false;
+        ssize_t r = send(fd, p + sent, len - sent, 0);
+        if (r < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
+            return false;
+        }
+        sent += (size_t)r;
     }
-    if (strstr(line, "200") == NULL) {
-        ESP_LOGE(TAG, "CONNECT rejected: %s", line); close(sock); return -1;
+    return true;
+}
+
+static bool sock_recv_exact(int fd, void *buf, size_t len, int64_t deadline_us)
+{
+    char *p = (char *)buf;
+    size_t got = 0;
+    while (got < len) {
+        if (sock_wait(fd, false, deadline_us) <= 0) return false;
+        ssize_t r = recv(fd, p + got, len - got, 0);
+        if (r < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
+            return false;
+        }
+        if (r == 0) return false;
+        got += (size_t)r;
     }
+    return true;
+}
 
-    /* Consume remaining response headers */
-    while (sock_read_line(sock, line, sizeof(line), timeout_ms) > 0) { }
+/*
+ * Read a response head up to and including the blank line, NUL-terminated.
+ * Bytes are peeked first and only the head is consumed, so anything the proxy
+ * sends after it stays in the socket for the TLS layer. Returns length or -1.
+ */
+static int sock_read_head(int fd, char *buf, size_t size, int64_t deadline_us)
+{
+    size_t len = 0;
+    while (len < size - 1) {
+        if (sock_wait(fd, false, deadline_us) <= 0) return -1;
+        ssize_t n = recv(fd, buf + len, size - 1 - len, MSG_PEEK);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+        if (n <= 0) return -1;
+
+        /* The terminator may straddle the previously consumed bytes */
+        buf[len + n] = '\0';
+        char *term = strstr(buf + (len >= 3 ? len - 3 : 0), "\r\n\r\n");
+        size_t take = term ? (size_t)(term + 4 - buf) - len : (size_t)n;
+
+        if (!sock_recv_exact(fd, buf + len, take, deadline_us)) return -1;
+        len += take;
+        if (term) {
+            buf[len] = '\0';
+            return (int)len;
+        }
+    }
+    return -1;
+}
 
-    ESP_LOGI(TAG, "CONNECT tunnel established to %s:%d", host, port);
+/* Non-blocking TCP connect bounded by the deadline. Returns socket (still O_NONBLOCK) or -1 */
+static int sock_connect(const struct sockaddr_in *addr, int64_t deadline_us)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+    if (connect(sock, (const struct sockaddr *)addr, sizeof(*addr)) != 0) {
+        if (errno != EINPROGRESS || sock_wait(sock, true, deadline_us) <= 0) {
+            close(sock);
+            return -1;
+        }
+        int so_err = 0;
+        socklen_t so_len = sizeof(so_err);
+        if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &so_err, &so_len) != 0 || so_err != 0) {
+            close(sock);
+            return -1;
+        }
+    }
     return sock;
 }
 
-/* Open TCP + SOCKS5 tunnel, returns socket fd or -1 */
-static int open_socks5_tunnel(const char *host, int port, int timeout_ms)
+/* Resolve the proxy once and reuse the address until the config changes or connect fails */
+static bool proxy_resolve(struct sockaddr_in *out)
 {
+    proxy_lock();
+    bool valid = s_proxy_addr_valid;
+    if (valid) *out = s_proxy_addr;
+    proxy_unlock();
+    if (valid) return true;
+
     struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
     struct addrinfo *res = NULL;
     char port_str[8];
@@ -189,46 +398,80 @@ static int open_socks5_tunnel(const char *host, int port, int timeout_ms)
 
     if (getaddrinfo(s_proxy_host, port_str, &hints, &res) != 0 || !res) {
         ESP_LOGE(TAG, "DNS resolve failed for proxy %s", s_proxy_host);
-        return -1;
+        return false;
     }
+    memcpy(out, res->ai_addr, sizeof(*out));
+    freeaddrinfo(res);
 
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { freeaddrinfo(res); return -1; }
+    proxy_lock();
+    s_proxy_addr = *out;
+    s_proxy_addr_valid = true;
+    proxy_unlock();
+    return true;
+}
 
-    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
-    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+static void proxy_resolve_invalidate(void)
+{
+    proxy_lock();
+    s_proxy_addr_valid = false;
+    proxy_unlock();
+}
 
-    if (connect(sock, res->ai_addr, res->ai_addrlen) != 0) {
-        ESP_LOGE(TAG, "TCP connect to proxy %s:%d failed", s_proxy_host, s_proxy_port);
-        freeaddrinfo(res); close(sock); return -1;
+/* Send CONNECT on an open proxy socket and wait for a 2xx reply */
+static bool open_connect_tunnel(int sock, const char *host, int port, int64_t deadline_us)
+{
+    char req[256];
+    int len = snprintf(req, sizeof(req),
+        "CONNECT %s:%d HTTP/1.1\r\nHost: %s:%d\r\n\r\n", host, port, host, port);
+
+    if (!sock_send_all(sock, req, len, deadline_us)) {
+        ESP_LOGE(TAG, "Failed to send CONNECT");
+        return false;
     }
-    freeaddrinfo(res);
-    ESP_LOGI(TAG, "Connected to SOCKS5 proxy %s:%d", s_proxy_host, s_proxy_port);
 
+    char head[512];
+    if (sock_read_head(sock, head, sizeof(head), deadline_us) < 0) {
+        ESP_LOGE(TAG, "No response from proxy");
+        return false;
+    }
+
+    const char *sp = strchr(head, ' ');
+    int status = (strncmp(head, "HTTP/", 5) == 0 && sp) ? atoi(sp + 1) : 0;
+    if (status < 200 || status > 299) {
+        head[strcspn(head, "\r\n")] = '\0';
+        ESP_LOGE(TAG, "CONNECT rejected: %s", head);
+        return false;
+    }
+
+    ESP_LOGI(TAG, "CONNECT tunnel established to %s:%d", host, port);
+    return true;
+}
+
+/* SOCKS5 (no auth) CONNECT by domain name on an open proxy socket */
+static bool open_socks5_tunnel(int sock, const char *host, int port, int64_t deadline_us)
+{
     /* SOCKS5 handshake: version 5, no authentication */
     unsigned char handshake[3] = { 0x05, 0x01, 0x00 };
-    if (send(sock, handshake, sizeof(handshake), 0) != sizeof(handshake)) {
-        ESP_LOGE(TAG, "Failed to send SOCKS5 handshake"); close(sock); return -1;
+    if (!sock_send_all(sock, handshake, sizeof(handshake), deadline_us)) {
+        ESP_LOGE(TAG, "Failed to send SOCKS5 handshake");
+        return false;
     }
 
-    /* Receive handshake response */
     unsigned char handshake_resp[2];
-    if (recv(sock, handshake_resp, sizeof(handshake_resp), 0) != sizeof(handshake_resp)) {
-        ESP_LOGE(TAG, "No response from SOCKS5 proxy"); close(sock); return -1;
+    if (!sock_recv_exact(sock, handshake_resp, sizeof(handshake_resp), deadline_us)) {
+        ESP_LOGE(TAG, "No response from SOCKS5 proxy");
+        return false;
     }
-
     if (handshake_resp[0] != 0x05 || handshake_resp[1] != 0x00) {
         ESP_LOGE(TAG, "SOCKS5 handshake failed: version=%d, auth=%d", handshake_resp[0], handshake_resp[1]);
-        close(sock); return -1;
+        return false;
     }
 
     /* SOCKS5 connect request: version 5, connect command, reserved, domain name address type */
     size_t host_len = strlen(host);
-    size_t req_len = 4 + 1 + host_len + 2;
-    unsigned char *req = malloc(req_len);
-    if (!req) { close(sock); return -1; }
+    if (host_len > 255) return false;
 
+    unsigned char req[4 + 1 + 255 + 2];
     req[0] = 0x05; /* version */
     req[1] = 0x01; /* connect command */
     req[2] = 0x00; /* reserved */
@@ -238,26 +481,54 @@ static int open_socks5_tunnel(const char *host, int port, int timeout_ms)
     req[5 + host_len] = (unsigned char)(port >> 8); /* port high byte */
     req[6 + host_len] = (unsigned char)(port & 0xFF); /* port low byte */
 
-    if (send(sock, req, req_len, 0) != (ssize_t)req_len) {
+    if (!sock_send_all(sock, req, 7 + host_len, deadline_us)) {
         ESP_LOGE(TAG, "Failed to send SOCKS5 connect request");
-        free(req); close(sock); return -1;
+        return false;
     }
-    free(req);
 
-    /* Receive connect response */
-    unsigned char resp[256];
-    int resp_len = recv(sock, resp, sizeof(resp), 0);
-    if (resp_len < 10) {
-        ESP_LOGE(TAG, "No response from SOCKS5 proxy"); close(sock); return -1;
+    /* Reply: VER REP RSV ATYP, then a bound address whose size depends on ATYP.
+     * Read exactly that much so the TLS layer starts on the first tunnel byte. */
+    unsigned char resp[4 + 1 + 255 + 2];
+    if (!sock_recv_exact(sock, resp, 4, deadline_us)) {
+        ESP_LOGE(TAG, "No response from SOCKS5 proxy");
+        return false;
     }
-
     if (resp[0] != 0x05 || resp[1] != 0x00) {
         ESP_LOGE(TAG, "SOCKS5 connect failed: version=%d, status=%d", resp[0], resp[1]);
-        close(sock); return -1;
+        return false;
+    }
+
+    size_t addr_len;
+    switch (resp[3]) {
+    case 0x01: addr_len = 4; break;    /* IPv4 */
+    case 0x04: addr_len = 16; break;   /* IPv6 */
+    case 0x03:                         /* domain: length-prefixed */
+        if (!sock_recv_exact(sock, resp + 4, 1, deadline_us)) return false;
+        addr_len = resp[4];
+        break;
+    default:
+        ESP_LOGE(TAG, "SOCKS5 reply has unknown address type %d", resp[3]);
+        return false;
+    }
+    if (!sock_recv_exact(sock, resp + 5, addr_len + 2, deadline_us)) {
+        ESP_LOGE(TAG, "Truncated SOCKS5 reply");
+        return false;
     }
 
     ESP_LOGI(TAG, "SOCKS5 tunnel established to %s:%d", host, port);
-    return sock;
+    return true;
+}
+
+static void tunnel_record(bool ok, int64_t elapsed_us)
+{
+    proxy_lock();
+    if (ok) {
+        s_stats.tunnels++;
+        s_stats.tunnel_ms_total += (uint32_t)(elapsed_us / 1000);
+    } else {
+        s_stats.tunnel_failed++;
+    }
+    proxy_unlock();
 }
 
 proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms)
@@ -267,14 +538,103 @@ proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms)
         return NULL;
     }
 
-    int sock;
-    if (strcmp(s_proxy_type, "socks5") == 0) {
-        sock = open_socks5_tunnel(host, port, timeout_ms);
-    } else {
-        sock = open_connect_tunnel(host, port, timeout_ms);
+    int64_t t0 = esp_timer_get_time();
+    int64_t deadline = t0 + (int64_t)timeout_ms * 1000;
+
+    struct sockaddr_in addr;
+    if (!proxy_resolve(&addr)) {
+        tunnel_record(false, 0);
+        return NULL;
+    }
+
+    int sock = sock_connect(&addr, deadline);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "TCP connect to proxy %s:%d failed", s_proxy_host, s_proxy_port);
+        proxy_resolve_invalidate();
+        tunnel_record(false, 0);
+        return NULL;
+    }
+
+    bool ok = (strcmp(s_proxy_type, "socks5") == 0)
+              ? open_socks5_tunnel(sock, host, port, deadline)
+              : open_connect_tunnel(sock, host, port, deadline);
+    int64_t tunnel_us = esp_timer_get_time() - t0;
+    tunnel_record(ok, tunnel_us);
+    if (!ok) {
+        close(sock);
+        return NULL;
+    }
+    ESP_LOGI(TAG, "Tunnel to %s:%d ready in %lld ms", host, port, (long long)(tunnel_us / 1000));
+
+    return conn_tls_start(sock, host, port, timeout_ms);
+}
+
+/* Resolve and connect host:port with a deadline. Returns a connected socket or -1. */
+static int direct_connect(const char *host, int port, int64_t deadline)
+{
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    if (getaddrinfo(host, port_str, &hints, &res) != 0 || !res) {
+        ESP_LOGE(TAG, "DNS resolve failed for %s", host);
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memcpy(&addr, res->ai_addr, sizeof(addr));
+    freeaddrinfo(res);
+
+    int sock = sock_connect(&addr, deadline);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "TCP connect to %s:%d failed", host, port);
     }
+    return sock;
+}
+
+/* Switch a freshly connected socket to blocking I/O bounded by timeout_ms */
+static void sock_set_blocking(int sock, int timeout_ms)
+{
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) & ~O_NONBLOCK);
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+proxy_conn_t *proxy_conn_open_direct(const char *host, int port, int timeout_ms)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    int sock = direct_connect(host, port, deadline);
+    if (sock < 0) return NULL;
+    return conn_tls_start(sock, host, port, timeout_ms);
+}
+
+proxy_conn_t *proxy_conn_open_plain(const char *host, int port, int timeout_ms)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    int sock = direct_connect(host, port, deadline);
     if (sock < 0) return NULL;
 
+    sock_set_blocking(sock, timeout_ms);
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    proxy_conn_t *conn = calloc(1, sizeof(*conn));
+    if (!conn) {
+        close(sock);
+        return NULL;
+    }
+    conn->sock = sock;
+    ESP_LOGI(TAG, "Plain TCP connection to %s:%d", host, port);
+    return conn;
+}
+
+/* TLS handshake over an already-connected socket (tunnel or direct). Takes ownership of sock. */
+static proxy_conn_t *conn_tls_start(int sock, const char *host, int port, int timeout_ms)
+{
+    /* esp_tls drives the handshake on a blocking socket with its own timeout */
+    sock_set_blocking(sock, timeout_ms);
+
     proxy_conn_t *conn = calloc(1, sizeof(*conn));
     if (!conn) { close(sock); return NULL; }
     conn->sock = sock;
@@ -286,30 +646,72 @@ proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms)
         close(sock); free(conn); return NULL;
     }
 
-    /* Inject our CONNECT-tunnel socket and skip TCP connect phase */
+    /* Inject our connected socket and skip the TCP connect phase */
     esp_tls_set_conn_sockfd(conn->tls, sock);
     esp_tls_set_conn_state(conn->tls, ESP_TLS_CONNECTING);
 
     esp_tls_cfg_t cfg = {
-        .crt_bundle_attach = esp_crt_bundle_attach,
+        .crt_bundle_attach = probe_bundle_attach,
         .timeout_ms = timeout_ms,
     };
 
+    esp_tls_client_session_t *cached = session_take(host);
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    cfg.client_session = cached;
+#endif
+
+    tls_cert_probe_t probe = {0};
+    t_cert_probe = &probe;
+    int64_t tls_t0 = esp_timer_get_time();
     int ret = esp_tls_conn_new_sync(host, strlen(host), port, &cfg, conn->tls);
+    int64_t elapsed = esp_timer_get_time() - tls_t0;
+    t_cert_probe = NULL;
+
+    /* Offered is not resumed: a rejected session means a full handshake */
+    bool resumed = cached && !probe.saw_cert;
+    session_record(resumed, ret > 0, elapsed);
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (cached) esp_tls_free_client_session(cached);
+#endif
+
     if (ret <= 0) {
-        ESP_LOGE(TAG, "TLS handshake failed over proxy tunnel");
+        ESP_LOGE(TAG, "TLS handshake with %s:%d failed", host, port);
         esp_tls_conn_destroy(conn->tls);
         /* esp_tls_conn_destroy closes the socket */
         free(conn);
         return NULL;
     }
 
-    ESP_LOGI(TAG, "TLS handshake OK with %s:%d via proxy", host, port);
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    /* Keep the server's latest ticket for the next tunnel to this host */
+    esp_tls_client_session_t *fresh = esp_tls_get_client_session(conn->tls);
+    if (fresh) session_put(host, fresh);
+#endif
+
+    ESP_LOGI(TAG, "TLS handshake OK with %s:%d (%s, %lld ms)", host, port,
+             resumed ? "resumed" : cached ? "full, session rejected" : "full",
+             (long long)(elapsed / 1000));
     return conn;
 }
 
 int proxy_conn_write(proxy_conn_t *conn, const char *data, int len)
 {
+    if (!conn->tls) {
+        /* Plain TCP: blocking socket, SO_SNDTIMEO bounds each send */
+        int sent = 0;
+        while (sent < len) {
+            ssize_t n = send(conn->sock, data + sent, len - sent, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ESP_LOGE(TAG, "send error: %d", errno);
+                return -1;
+            }
+            sent += (int)n;
+        }
+        return sent;
+    }
+
     int written = 0;
     while (written < len) {
         ssize_t ret = esp_tls_conn_write(conn->tls, data + written, len - written);
@@ -325,19 +727,65 @@ int proxy_conn_write(proxy_conn_t *conn, const char *data, int len)
     return written;
 }
 
+/* SO_RCVTIMEO in ms; 0 would mean no timeout, so at least 1 */
+static void sock_set_rcv_timeout(int sock, int64_t ms)
+{
+    if (ms < 1) ms = 1;
+    struct timeval tv = { .tv_sec = (time_t)(ms / 1000), .tv_usec = (suseconds_t)(ms % 1000) * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
 int proxy_conn_read(proxy_conn_t *conn, char *buf, int len, int timeout_ms)
 {
-    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
-    setsockopt(conn->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (!conn->tls) {
+        sock_set_rcv_timeout(conn->sock, timeout_ms);
+        ssize_t n = recv(conn->sock, buf, len, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return PROXY_CONN_TIMEOUT;
+            ESP_LOGE(TAG, "recv error: %d", errno);
+            return -1;
+        }
+        return (int)n;
+    }
 
-    ssize_t ret = esp_tls_conn_read(conn->tls, buf, len);
-    if (ret == ESP_TLS_ERR_SSL_WANT_READ) return 0;
-    if (ret == 0) return 0;
-    if (ret < 0) {
+    /* WANT_READ also follows non-application records (session tickets): only a
+     * WANT_READ once the time is up is a timeout. Each retry may only block for
+     * what is left, so the whole read stays within timeout_ms */
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (1) {
+        int64_t left_us = deadline_us - esp_timer_get_time();
+        if (left_us <= 0) return PROXY_CONN_TIMEOUT;
+        sock_set_rcv_timeout(conn->sock, (left_us + 999) / 1000);
+
+        ssize_t ret = esp_tls_conn_read(conn->tls, buf, len);
+        if (ret > 0) return (int)ret;
+        if (ret == 0) return 0;
+        if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_TIMEOUT) continue;
         ESP_LOGE(TAG, "esp_tls_conn_read error: %d", (int)ret);
         return -1;
     }
-    return (int)ret;
+}
+
+bool proxy_conn_alive(proxy_conn_t *conn)
+{
+    if (!conn || conn->sock < 0) return false;
+
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(conn->sock, &rfds);
+    struct timeval tv = { 0 };
+    if (select(conn->sock + 1, &rfds, NULL, NULL, &tv) != 0) return false;
+
+    int so_err = 0;
+    socklen_t so_len = sizeof(so_err);
+    return getsockopt(conn->sock, SOL_SOCKET, SO_ERROR, &so_err, &so_len) == 0 && so_err == 0;
+}
+
+void proxy_conn_shutdown(proxy_conn_t *conn)
+{
+    if (conn && conn->sock >= 0) {
+        shutdown(conn->sock, SHUT_RDWR);
+    }
 }
 
 void proxy_conn_close(proxy_conn_t *conn)
@@ -345,6 +793,8 @@ void proxy_conn_close(proxy_conn_t *conn)
     if (!conn) return;
     if (conn->tls) {
         esp_tls_conn_destroy(conn->tls);
+    } else if (conn->sock >= 0) {
+        close(conn->sock);
     }
     free(conn);
 }
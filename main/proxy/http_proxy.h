@@ -2,6 +2,7 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 /**
@@ -38,11 +39,62 @@ typedef struct proxy_conn proxy_conn_t;
  */
 proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms);
 
+/**
+ * Open an HTTPS connection straight to host:port (no proxy), with the same
+ * deadline-bounded connect and TLS session cache as tunnelled connections.
+ */
+proxy_conn_t *proxy_conn_open_direct(const char *host, int port, int timeout_ms);
+
+/**
+ * Open a plain TCP connection to host:port (no proxy, no TLS), for http://
+ * endpoints on the local network. Read/write/close work the same way.
+ */
+proxy_conn_t *proxy_conn_open_plain(const char *host, int port, int timeout_ms);
+
 /** Write raw bytes through the TLS tunnel. Returns bytes written or -1. */
 int proxy_conn_write(proxy_conn_t *conn, const char *data, int len);
 
-/** Read raw bytes from the TLS tunnel. Returns bytes read or -1. */
+/* proxy_conn_read(): nothing arrived within timeout_ms (the connection is still open) */
+#define PROXY_CONN_TIMEOUT  (-2)
+
+/**
+ * Read raw bytes from the TLS tunnel. Returns bytes read, 0 when the peer
+ * closed the connection, PROXY_CONN_TIMEOUT, or -1 on error.
+ */
 int proxy_conn_read(proxy_conn_t *conn, char *buf, int len, int timeout_ms);
 
+/**
+ * Zero-timeout health check of an idle connection: false if the peer has
+ * closed or reset it (an idle HTTP connection never has data waiting, so
+ * anything readable is EOF, RST or a TLS close_notify).
+ */
+bool proxy_conn_alive(proxy_conn_t *conn);
+
+/**
+ * Shut the socket down in both directions without freeing anything: a read
+ * or write blocked on it in another task returns an error at once. Safe to
+ * call from any task while the owner is using the connection.
+ */
+void proxy_conn_shutdown(proxy_conn_t *conn);
+
 /** Close and free the connection. */
 void proxy_conn_close(proxy_conn_t *conn);
+
+/* ── Tunnel + TLS setup stats (TLS counters include direct connections) ── */
+
+typedef struct {
+    uint32_t tunnels;                /* CONNECT / SOCKS5 tunnels established */
+    uint32_t tunnel_failed;
+    uint32_t tunnel_ms_total;        /* TCP connect + proxy handshake, summed */
+    uint32_t tls_resumed;            /* handshakes the server resumed (no certificate sent) */
+    uint32_t tls_full;               /* full handshakes, including rejected sessions */
+    uint32_t tls_failed;
+    uint32_t tls_resumed_ms_total;   /* summed handshake time, for averages */
+    uint32_t tls_full_ms_total;
+} proxy_stats_t;
+
+/** Snapshot tunnel and TLS handshake counters for proxied connections. */
+void http_proxy_get_stats(proxy_stats_t *out);
+
+/** Drop all cached TLS sessions (e.g. after proxy config changes). */
+void http_proxy_flush_tls_sessions(void);
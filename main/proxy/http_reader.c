@@ -0,0 +1,243 @@
+#include "http_reader.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include "esp_log.h"
+#include "esp_http_client.h"
+
+static const char *TAG = "http_reader";
+
+#define READ_CHUNK 2048
+
+/* ── Header helpers ───────────────────────────────────────────── */
+
+static bool header_is(const char *line, size_t name_len, const char *name)
+{
+    return strlen(name) == name_len && strncasecmp(line, name, name_len) == 0;
+}
+
+/* Case-insensitive token search in a comma-separated header value */
+static bool value_has_token(const char *value, const char *token)
+{
+    size_t tlen = strlen(token);
+    for (const char *p = value; *p; p++) {
+        if (strncasecmp(p, token, tlen) == 0) {
+            char before = (p == value) ? ',' : p[-1];
+            char after = p[tlen];
+            if ((before == ',' || before == ' ' || before == '\t') &&
+                (after == '\0' || after == ',' || after == ' ' || after == ';')) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void parse_header(http_reader_t *r, const char *line)
+{
+    const char *colon = strchr(line, ':');
+    if (!colon) return;
+
+    size_t name_len = colon - line;
+    const char *value = colon + 1;
+    while (*value == ' ' || *value == '\t') value++;
+
+    if (header_is(line, name_len, "Content-Length")) {
+        r->content_length = strtoll(value, NULL, 10);
+    } else if (header_is(line, name_len, "Transfer-Encoding")) {
+        r->chunked = value_has_token(value, "chunked");
+    } else if (header_is(line, name_len, "Connection")) {
+        if (value_has_token(value, "close")) r->conn_close = true;
+        if (value_has_token(value, "keep-alive")) r->conn_keep_alive = true;
+    }
+}
+
+/* ── Line-level state machine ─────────────────────────────────── */
+
+static esp_err_t end_of_headers(http_reader_t *r)
+{
+    /* Interim 1xx responses carry no body: wait for the final status */
+    if (r->status >= 100 && r->status < 200) {
+        r->state = HTTP_READER_STATUS;
+        r->chunked = false;
+        r->content_length = -1;
+        return ESP_OK;
+    }
+
+    if (r->status == 204 || r->status == 304) {
+        r->state = HTTP_READER_DONE;
+    } else if (r->chunked) {
+        r->state = HTTP_READER_CHUNK_SIZE;
+    } else if (r->content_length >= 0) {
+        r->remaining = r->content_length;
+        r->state = r->remaining ? HTTP_READER_BODY_LENGTH : HTTP_READER_DONE;
+    } else {
+        r->state = HTTP_READER_BODY_CLOSE;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t process_line(http_reader_t *r)
+{
+    char *line = r->line;
+    size_t n = r->line_len;
+    r->line_len = 0;
+
+    if (n > 0 && line[n - 1] == '\r') n--;
+    line[n] = '\0';
+
+    switch (r->state) {
+    case HTTP_READER_STATUS: {
+        if (n == 0) return ESP_OK;  /* tolerate stray CRLF before the status line */
+        const char *sp = strchr(line, ' ');
+        if (strncmp(line, "HTTP/1.", 7) != 0 || !sp) {
+            ESP_LOGW(TAG, "Bad status line: %.64s", line);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        r->http10 = (line[7] == '0');
+        r->status = atoi(sp + 1);
+        r->state = HTTP_READER_HEADERS;
+        return ESP_OK;
+    }
+
+    case HTTP_READER_HEADERS:
+        if (n == 0) return end_of_headers(r);
+        parse_header(r, line);
+        return ESP_OK;
+
+    case HTTP_READER_CHUNK_SIZE: {
+        char *end = NULL;
+        unsigned long size = strtoul(line, &end, 16);
+        if (end == line) {
+            ESP_LOGW(TAG, "Bad chunk size line: %.32s", line);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        r->remaining = (int64_t)size;
+        r->state = size ? HTTP_READER_CHUNK_DATA : HTTP_READER_TRAILERS;
+        return ESP_OK;
+    }
+
+    case HTTP_READER_CHUNK_CRLF:
+        if (n != 0) return ESP_ERR_INVALID_RESPONSE;
+        r->state = HTTP_READER_CHUNK_SIZE;
+        return ESP_OK;
+
+    case HTTP_READER_TRAILERS:
+        if (n == 0) r->state = HTTP_READER_DONE;
+        return ESP_OK;
+
+    default:
+        return ESP_OK;
+    }
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+void http_reader_init(http_reader_t *r, http_body_cb_t on_body, void *ctx)
+{
+    memset(r, 0, sizeof(*r));
+    r->state = HTTP_READER_STATUS;
+    r->content_length = -1;
+    r->on_body = on_body;
+    r->ctx = ctx;
+}
+
+static esp_err_t deliver(http_reader_t *r, const char *data, size_t len)
+{
+    r->body_len += len;
+    if (!r->on_body || len == 0) return ESP_OK;
+    return r->on_body(r->status, data, len, r->ctx);
+}
+
+esp_err_t http_reader_feed(http_reader_t *r, const char *data, size_t len)
+{
+    r->bytes_in += len;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t avail = len - i;
+
+        switch (r->state) {
+        case HTTP_READER_DONE:
+            r->trailing_garbage = true;
+            return ESP_OK;
+
+        case HTTP_READER_BODY_CLOSE: {
+            esp_err_t err = deliver(r, data + i, avail);
+            if (err != ESP_OK) return err;
+            i = len;
+            break;
+        }
+
+        case HTTP_READER_BODY_LENGTH:
+        case HTTP_READER_CHUNK_DATA: {
+            size_t take = (int64_t)avail < r->remaining ? avail : (size_t)r->remaining;
+            esp_err_t err = deliver(r, data + i, take);
+            if (err != ESP_OK) return err;
+            i += take;
+            r->remaining -= take;
+            if (r->remaining == 0) {
+                r->state = (r->state == HTTP_READER_BODY_LENGTH) ? HTTP_READER_DONE
+                                                                  : HTTP_READER_CHUNK_CRLF;
+            }
+            break;
+        }
+
+        default: {
+            /* Line-oriented states: accumulate up to '\n' */
+            const char *nl = memchr(data + i, '\n', avail);
+            size_t seg = nl ? (size_t)(nl - (data + i)) : avail;
+            size_t room = sizeof(r->line) - 1 - r->line_len;
+            size_t copy = seg < room ? seg : room;   /* over-long lines are truncated */
+            memcpy(r->line + r->line_len, data + i, copy);
+            r->line_len += copy;
+            i += seg;
+            if (nl) {
+                i++;
+                esp_err_t err = process_line(r);
+                if (err != ESP_OK) return err;
+            }
+            break;
+        }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t http_reader_eof(http_reader_t *r)
+{
+    if (r->state == HTTP_READER_BODY_CLOSE) {
+        r->state = HTTP_READER_DONE;
+        r->conn_close = true;
+        return ESP_OK;
+    }
+    if (r->state == HTTP_READER_DONE) return ESP_OK;
+    return r->bytes_in ? ESP_ERR_INVALID_RESPONSE : ESP_ERR_HTTP_CONNECTION_CLOSED;
+}
+
+bool http_reader_done(const http_reader_t *r)
+{
+    return r->state == HTTP_READER_DONE;
+}
+
+bool http_reader_keep_alive(const http_reader_t *r)
+{
+    if (r->state != HTTP_READER_DONE || r->trailing_garbage || r->conn_close) return false;
+    return r->http10 ? r->conn_keep_alive : true;
+}
+
+esp_err_t http_reader_run(http_reader_t *r, proxy_conn_t *conn, int timeout_ms)
+{
+    char buf[READ_CHUNK];
+    while (!http_reader_done(r)) {
+        int n = proxy_conn_read(conn, buf, sizeof(buf), timeout_ms);
+        if (n == PROXY_CONN_TIMEOUT) return ESP_ERR_TIMEOUT;
+        if (n < 0) return ESP_FAIL;
+        if (n == 0) return http_reader_eof(r);
+
+        esp_err_t err = http_reader_feed(r, buf, n);
+        if (err != ESP_OK) return err;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "proxy/http_proxy.h"
+
+/* ── Incremental HTTP/1.1 response reader ─────────────────────── */
+
+#define HTTP_READER_LINE_MAX 512
+
+/**
+ * Body callback: data points into the caller's read buffer (valid only for the
+ * call). status is the final response status. Returning an error aborts.
+ */
+typedef esp_err_t (*http_body_cb_t)(int status, const char *data, size_t len, void *ctx);
+
+typedef enum {
+    HTTP_READER_STATUS = 0,
+    HTTP_READER_HEADERS,
+    HTTP_READER_BODY_LENGTH,      /* Content-Length framed */
+    HTTP_READER_BODY_CLOSE,       /* delimited by connection close */
+    HTTP_READER_CHUNK_SIZE,
+    HTTP_READER_CHUNK_DATA,
+    HTTP_READER_CHUNK_CRLF,
+    HTTP_READER_TRAILERS,
+    HTTP_READER_DONE,
+} http_reader_state_t;
+
+typedef struct {
+    http_reader_state_t state;
+    int status;
+    bool http10;
+    bool chunked;
+    bool conn_close;              /* "Connection: close" seen */
+    bool conn_keep_alive;         /* "Connection: keep-alive" seen (HTTP/1.0) */
+    bool trailing_garbage;        /* bytes after the end of the response */
+    int64_t content_length;       /* -1 when absent */
+    int64_t remaining;            /* bytes left in the body or current chunk */
+    size_t bytes_in;              /* total bytes fed */
+    size_t body_len;              /* total body bytes delivered */
+
+    http_body_cb_t on_body;
+    void *ctx;
+
+    char line[HTTP_READER_LINE_MAX];
+    size_t line_len;
+} http_reader_t;
+
+/** Reset the reader for a new response. */
+void http_reader_init(http_reader_t *r, http_body_cb_t on_body, void *ctx);
+
+/**
+ * Feed raw bytes in any fragmentation. Body bytes are passed straight to
+ * on_body without copying. Returns ESP_ERR_INVALID_RESPONSE on malformed
+ * framing, or the callback's error.
+ */
+esp_err_t http_reader_feed(http_reader_t *r, const char *data, size_t len);
+
+/** Peer closed the connection: completes a close-delimited body, else error. */
+esp_err_t http_reader_eof(http_reader_t *r);
+
+/** True once the full response (including trailers) has been consumed. */
+bool http_reader_done(const http_reader_t *r);
+
+/** True if the connection can carry another request after this response. */
+bool http_reader_keep_alive(const http_reader_t *r);
+
+/**
+ * Read one complete response from a proxied connection.
+ * Each read waits up to timeout_ms.
+ */
+esp_err_t http_reader_run(http_reader_t *r, proxy_conn_t *conn, int timeout_ms);
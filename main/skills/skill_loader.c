@@ -1,5 +1,6 @@
 #include "skills/skill_loader.h"
 #include "mimi_config.h"
+#include "agent/context_builder.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -125,6 +126,7 @@ static void install_builtin(const builtin_skill_t *skill)
 
     fputs(skill->content, f);
     fclose(f);
+    context_invalidate_path(path);
     ESP_LOGI(TAG, "Installed built-in skill: %s", path);
 }
 
@@ -1,7 +1,7 @@
 #include "telegram_bot.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
-#include "proxy/http_proxy.h"
+#include "proxy/http_pool.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -9,7 +9,6 @@
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "esp_http_client.h"
-#include "esp_crt_bundle.h"
 #include "nvs.h"
 #include "cJSON.h"
 
@@ -106,97 +105,28 @@ static void save_update_offset_if_needed(bool force)
     nvs_close(nvs);
 }
 
-static esp_err_t http_event_handler(esp_http_client_event_t *evt)
+static esp_err_t http_body_handler(int status, const char *data, size_t len, void *ctx)
 {
-    http_resp_t *resp = (http_resp_t *)evt->user_data;
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
-        if (resp->len + evt->data_len >= resp->cap) {
-            size_t new_cap = resp->cap * 2;
-            if (new_cap < resp->len + evt->data_len + 1) {
-                new_cap = resp->len + evt->data_len + 1;
-            }
-            char *tmp = realloc(resp->buf, new_cap);
-            if (!tmp) return ESP_ERR_NO_MEM;
-            resp->buf = tmp;
-            resp->cap = new_cap;
+    http_resp_t *resp = (http_resp_t *)ctx;
+    if (resp->len + len >= resp->cap) {
+        size_t new_cap = resp->cap * 2;
+        if (new_cap < resp->len + len + 1) {
+            new_cap = resp->len + len + 1;
         }
-        memcpy(resp->buf + resp->len, evt->data, evt->data_len);
-        resp->len += evt->data_len;
-        resp->buf[resp->len] = '\0';
+        char *tmp = realloc(resp->buf, new_cap);
+        if (!tmp) return ESP_ERR_NO_MEM;
+        resp->buf = tmp;
+        resp->cap = new_cap;
     }
+    memcpy(resp->buf + resp->len, data, len);
+    resp->len += len;
+    resp->buf[resp->len] = '\0';
     return ESP_OK;
 }
 
-/* ── Proxy path: manual HTTP over CONNECT tunnel ────────────── */
-
-static char *tg_api_call_via_proxy(const char *path, const char *post_data)
-{
-    proxy_conn_t *conn = proxy_conn_open("api.telegram.org", 443,
-                                          (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000);
-    if (!conn) return NULL;
-
-    /* Build HTTP request */
-    char header[512];
-    int hlen;
-    if (post_data) {
-        hlen = snprintf(header, sizeof(header),
-            "POST /bot%s/%s HTTP/1.1\r\n"
-            "Host: api.telegram.org\r\n"
-            "Content-Type: application/json\r\n"
-            "Content-Length: %d\r\n"
-            "Connection: close\r\n\r\n",
-            s_bot_token, path, (int)strlen(post_data));
-    } else {
-        hlen = snprintf(header, sizeof(header),
-            "GET /bot%s/%s HTTP/1.1\r\n"
-            "Host: api.telegram.org\r\n"
-            "Connection: close\r\n\r\n",
-            s_bot_token, path);
-    }
-
-    if (proxy_conn_write(conn, header, hlen) < 0) {
-        proxy_conn_close(conn);
-        return NULL;
-    }
-    if (post_data && proxy_conn_write(conn, post_data, strlen(post_data)) < 0) {
-        proxy_conn_close(conn);
-        return NULL;
-    }
-
-    /* Read response — accumulate until connection close */
-    size_t cap = 4096, len = 0;
-    char *buf = calloc(1, cap);
-    if (!buf) { proxy_conn_close(conn); return NULL; }
-
-    int timeout = (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000;
-    while (1) {
-        if (len + 1024 >= cap) {
-            cap *= 2;
-            char *tmp = realloc(buf, cap);
-            if (!tmp) break;
-            buf = tmp;
-        }
-        int n = proxy_conn_read(conn, buf + len, cap - len - 1, timeout);
-        if (n <= 0) break;
-        len += n;
-    }
-    buf[len] = '\0';
-    proxy_conn_close(conn);
-
-    /* Skip HTTP headers — find \r\n\r\n */
-    char *body = strstr(buf, "\r\n\r\n");
-    if (!body) { free(buf); return NULL; }
-    body += 4;
-
-    /* Return just the body */
-    char *result = strdup(body);
-    free(buf);
-    return result;
-}
-
-/* ── Direct path: esp_http_client ───────────────────────────── */
+/* ── API call (pooled, direct or via proxy) ─────────────────────── */
 
-static char *tg_api_call_direct(const char *method, const char *post_data)
+static char *tg_api_call(const char *method, const char *post_data)
 {
     char url[256];
     snprintf(url, sizeof(url), "https://api.telegram.org/bot%s/%s", s_bot_token, method);
@@ -208,30 +138,23 @@ static char *tg_api_call_direct(const char *method, const char *post_data)
     };
     if (!resp.buf) return NULL;
 
-    esp_http_client_config_t config = {
+    http_pool_header_t headers[] = {
+        { "Content-Type", "application/json" },
+    };
+    http_pool_req_t req = {
         .url = url,
-        .event_handler = http_event_handler,
+        .method = post_data ? HTTP_METHOD_POST : HTTP_METHOD_GET,
+        .headers = headers,
+        .header_count = post_data ? 1 : 0,
+        .body = post_data,
+        .body_len = post_data ? strlen(post_data) : 0,
+        .on_body = http_body_handler,
         .user_data = &resp,
         .timeout_ms = (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000,
-        .buffer_size = 2048,
-        .buffer_size_tx = 2048,
-        .crt_bundle_attach = esp_crt_bundle_attach,
     };
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        free(resp.buf);
-        return NULL;
-    }
-
-    if (post_data) {
-        esp_http_client_set_method(client, HTTP_METHOD_POST);
-        esp_http_client_set_header(client, "Content-Type", "application/json");
-        esp_http_client_set_post_field(client, post_data, strlen(post_data));
-    }
-
-    esp_err_t err = esp_http_client_perform(client);
-    esp_http_client_cleanup(client);
+    int status = 0;
+    esp_err_t err = http_pool_perform(&req, &status);
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
@@ -242,14 +165,6 @@ static char *tg_api_call_direct(const char *method, const char *post_data)
     return resp.buf;
 }
 
-static char *tg_api_call(const char *method, const char *post_data)
-{
-    if (http_proxy_is_enabled()) {
-        return tg_api_call_via_proxy(method, post_data);
-    }
-    return tg_api_call_direct(method, post_data);
-}
-
 static bool tg_response_is_ok(const char *resp, const char **out_desc)
 {
     if (out_desc) {
@@ -360,11 +275,11 @@ static void process_updates(const char *json_str)
         mimi_msg_t msg = {0};
         strncpy(msg.channel, MIMI_CHAN_TELEGRAM, sizeof(msg.channel) - 1);
         strncpy(msg.chat_id, chat_id_str, sizeof(msg.chat_id) - 1);
-        msg.content = strdup(text->valuestring);
+        msg.content = payload_dup(text->valuestring);
         if (msg.content) {
             if (message_bus_push_inbound(&msg) != ESP_OK) {
                 ESP_LOGW(TAG, "Inbound queue full, drop telegram message");
-                free(msg.content);
+                payload_release(msg.content);
             }
         }
     }
@@ -487,7 +402,7 @@ esp_err_t telegram_send_message(const char *chat_id, const char *text)
 
         ESP_LOGI(TAG, "Sending telegram chunk to %s (%d bytes)", chat_id, (int)chunk);
         char *resp = tg_api_call("sendMessage", json_str);
-        free(json_str);
+        cJSON_free(json_str);
 
         int sent_ok = 0;
         bool markdown_failed = false;
@@ -516,7 +431,7 @@ esp_err_t telegram_send_message(const char *chat_id, const char *text)
             cJSON_Delete(body2);
             if (json2) {
                 char *resp2 = tg_api_call("sendMessage", json2);
-                free(json2);
+                cJSON_free(json2);
                 if (resp2) {
                     const char *desc2 = NULL;
                     sent_ok = tg_response_is_ok(resp2, &desc2);
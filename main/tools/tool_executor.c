@@ -0,0 +1,319 @@
+#include "tool_executor.h"
+#include "tools/tool_registry.h"
+#include "mimi_config.h"
+#include "agent/turn_arena.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+
+static const char *TAG = "tool_exec";
+
+#define TOOL_PATH_MAX 96
+
+/* Caller-side progress of a call; only touched by the tool_executor_run() task */
+enum {
+    PHASE_PENDING,
+    PHASE_RUNNING,
+    PHASE_FINISHED,
+};
+
+/*
+ * One call handed to a worker. Owned by the caller until it gives up on a
+ * timeout; after that (abandoned) the worker frees it when the tool returns.
+ */
+typedef struct {
+    const mimi_tool_t *tool;
+    char *input;                     /* private copy: the caller may be gone */
+    char *output;
+    size_t output_size;
+    esp_err_t err;
+    SemaphoreHandle_t done_sem;      /* per-run completion signal */
+    bool done;                       /* guarded by s_lock */
+    bool abandoned;                  /* guarded by s_lock */
+} tool_job_t;
+
+static QueueHandle_t s_queue;
+static SemaphoreHandle_t s_lock;
+static SemaphoreHandle_t s_exclusive;    /* exclusive tools touch global state: one at a time, across agent workers */
+static int s_workers = 0;
+
+static void job_free(tool_job_t *job)
+{
+    if (!job) return;
+    free(job->input);
+    free(job->output);
+    free(job);
+}
+
+/* ── Workers ──────────────────────────────────────────────────── */
+
+static void tool_worker_task(void *arg)
+{
+    while (1) {
+        tool_job_t *job;
+        if (xQueueReceive(s_queue, &job, portMAX_DELAY) != pdTRUE) continue;
+
+        int64_t start_us = esp_timer_get_time();
+        ESP_LOGI(TAG, "Executing tool: %s", job->tool->name);
+        bool exclusive = (job->tool->concurrency == TOOL_CONC_EXCLUSIVE);
+        if (exclusive) xSemaphoreTake(s_exclusive, portMAX_DELAY);
+        esp_err_t err = job->tool->execute(job->input, job->output, job->output_size);
+        if (exclusive) xSemaphoreGive(s_exclusive);
+        ESP_LOGD(TAG, "Tool %s finished in %lld ms", job->tool->name,
+                 (long long)((esp_timer_get_time() - start_us) / 1000));
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool abandoned = job->abandoned;
+        job->err = err;
+        job->done = true;
+        if (!abandoned) xSemaphoreGive(job->done_sem);
+        xSemaphoreGive(s_lock);
+
+        if (abandoned) {
+            ESP_LOGW(TAG, "Tool %s returned after its timeout, result dropped", job->tool->name);
+            job_free(job);
+        }
+    }
+}
+
+esp_err_t tool_executor_init(void)
+{
+    s_queue = xQueueCreate(MIMI_TOOL_QUEUE_LEN, sizeof(tool_job_t *));
+    s_lock = xSemaphoreCreateMutex();
+    s_exclusive = xSemaphoreCreateMutex();
+    if (!s_queue || !s_lock || !s_exclusive) {
+        ESP_LOGE(TAG, "Failed to create executor queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < MIMI_TOOL_WORKERS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "tool_w%d", i);
+        if (xTaskCreatePinnedToCore(tool_worker_task, name, MIMI_TOOL_WORKER_STACK, NULL,
+                                    MIMI_TOOL_WORKER_PRIO, NULL, MIMI_TOOL_WORKER_CORE) != pdPASS) {
+            ESP_LOGW(TAG, "Worker %d create failed (free_internal=%u)", i,
+                     (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+            break;
+        }
+        s_workers++;
+    }
+
+    if (s_workers == 0) {
+        ESP_LOGW(TAG, "No tool workers, tool calls run sequentially");
+    } else {
+        ESP_LOGI(TAG, "Tool executor initialized (%d workers)", s_workers);
+    }
+    return ESP_OK;
+}
+
+/* ── Conflict rules ───────────────────────────────────────────── */
+
+/* "path" for file tools, "prefix" for list_dir; empty means the whole tree */
+static void input_path(const char *input, char *path, size_t size)
+{
+    path[0] = '\0';
+    cJSON *root = cJSON_Parse(input);
+    if (!root) return;
+    const char *p = cJSON_GetStringValue(cJSON_GetObjectItem(root, "path"));
+    if (!p) p = cJSON_GetStringValue(cJSON_GetObjectItem(root, "prefix"));
+    if (p) {
+        strncpy(path, p, size - 1);
+        path[size - 1] = '\0';
+    }
+    cJSON_Delete(root);
+}
+
+/* One path is a prefix of the other (same file, or a directory listing over it) */
+static bool paths_overlap(const char *a, const char *b)
+{
+    size_t la = strlen(a);
+    size_t lb = strlen(b);
+    return strncmp(a, b, la < lb ? la : lb) == 0;
+}
+
+static bool calls_conflict(mimi_tool_conc_t ca, const char *pa, mimi_tool_conc_t cb, const char *pb)
+{
+    if (ca == TOOL_CONC_EXCLUSIVE || cb == TOOL_CONC_EXCLUSIVE) return true;
+    if (ca == TOOL_CONC_PARALLEL || cb == TOOL_CONC_PARALLEL) return false;
+    if (ca == TOOL_CONC_PATH_READ && cb == TOOL_CONC_PATH_READ) return false;
+    return paths_overlap(pa, pb);
+}
+
+/* ── Run ──────────────────────────────────────────────────────── */
+
+static char *error_text(const char *fmt, const char *name)
+{
+    char *out = malloc(128);
+    if (out) snprintf(out, 128, fmt, name);
+    return out;
+}
+
+static void run_inline(tool_exec_call_t *call)
+{
+    call->output = heap_caps_calloc(1, MIMI_TOOL_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
+    if (!call->output) {
+        call->err = ESP_ERR_NO_MEM;
+        return;
+    }
+    /* Tools run on the caller's task here; whatever they keep must not come from its arena */
+    turn_arena_escape_begin();
+    call->err = tool_registry_execute(call->name, call->input ? call->input : "{}",
+                                      call->output, MIMI_TOOL_OUTPUT_SIZE);
+    turn_arena_escape_end();
+}
+
+static void mark_cancelled(tool_exec_call_t *call)
+{
+    call->output = error_text("Error: tool '%s' cancelled", call->name);
+    call->err = ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t tool_executor_run(tool_exec_call_t *calls, int count, const volatile bool *cancel)
+{
+    if (count <= 0) return ESP_OK;
+    if (count > MIMI_MAX_TOOL_CALLS) return ESP_ERR_INVALID_ARG;
+
+    for (int i = 0; i < count; i++) {
+        calls[i].output = NULL;
+        calls[i].err = ESP_OK;
+    }
+
+    if (s_workers == 0) {
+        bool cancelled = cancel && *cancel;
+        for (int i = 0; i < count; i++) {
+            cancelled = cancelled || (cancel && *cancel);
+            if (cancelled) mark_cancelled(&calls[i]);
+            else run_inline(&calls[i]);
+        }
+        return cancelled ? ESP_ERR_INVALID_STATE : ESP_OK;
+    }
+
+    SemaphoreHandle_t done_sem = xSemaphoreCreateCounting(count, 0);
+    if (!done_sem) return ESP_ERR_NO_MEM;
+
+    tool_job_t *jobs[MIMI_MAX_TOOL_CALLS] = {0};
+    mimi_tool_conc_t conc[MIMI_MAX_TOOL_CALLS];
+    char paths[MIMI_MAX_TOOL_CALLS][TOOL_PATH_MAX];
+    int phase[MIMI_MAX_TOOL_CALLS];
+    int64_t deadline_us[MIMI_MAX_TOOL_CALLS] = {0};
+    int finished = 0;
+    bool cancelled = false;
+
+    for (int i = 0; i < count; i++) {
+        const char *input = calls[i].input ? calls[i].input : "{}";
+        const mimi_tool_t *tool = tool_registry_find(calls[i].name);
+        phase[i] = PHASE_PENDING;
+        conc[i] = tool ? tool->concurrency : TOOL_CONC_PARALLEL;
+        input_path(input, paths[i], sizeof(paths[i]));
+
+        if (!tool) {
+            ESP_LOGW(TAG, "Unknown tool: %s", calls[i].name);
+            calls[i].output = error_text("Error: unknown tool '%s'", calls[i].name);
+            calls[i].err = ESP_ERR_NOT_FOUND;
+            phase[i] = PHASE_FINISHED;
+            finished++;
+            continue;
+        }
+
+        tool_job_t *job = calloc(1, sizeof(tool_job_t));
+        if (job) {
+            job->tool = tool;
+            job->input = strdup(input);
+            job->output = heap_caps_calloc(1, MIMI_TOOL_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
+            job->output_size = MIMI_TOOL_OUTPUT_SIZE;
+            job->done_sem = done_sem;
+        }
+        if (!job || !job->input || !job->output) {
+            job_free(job);
+            calls[i].output = error_text("Error: out of memory running '%s'", calls[i].name);
+            calls[i].err = ESP_ERR_NO_MEM;
+            phase[i] = PHASE_FINISHED;
+            finished++;
+            continue;
+        }
+        jobs[i] = job;
+    }
+
+    while (finished < count) {
+        /* Dispatch every pending call whose conflicting predecessors are finished */
+        for (int i = 0; i < count; i++) {
+            if (phase[i] != PHASE_PENDING || cancelled) continue;
+            bool ready = true;
+            for (int j = 0; j < i && ready; j++) {
+                if (phase[j] != PHASE_FINISHED &&
+                    calls_conflict(conc[j], paths[j], conc[i], paths[i])) {
+                    ready = false;
+                }
+            }
+            if (!ready) continue;
+            phase[i] = PHASE_RUNNING;
+            deadline_us[i] = esp_timer_get_time() + (int64_t)MIMI_TOOL_TIMEOUT_MS * 1000;
+            xQueueSend(s_queue, &jobs[i], portMAX_DELAY);
+        }
+
+        int64_t now = esp_timer_get_time();
+        int64_t wait_us = INT64_MAX;
+        for (int i = 0; i < count; i++) {
+            if (phase[i] == PHASE_RUNNING && deadline_us[i] - now < wait_us) {
+                wait_us = deadline_us[i] - now;
+            }
+        }
+        if (wait_us < 0 || cancelled) wait_us = 0;
+        if (cancel && wait_us > (int64_t)MIMI_TOOL_CANCEL_POLL_MS * 1000) {
+            wait_us = (int64_t)MIMI_TOOL_CANCEL_POLL_MS * 1000;
+        }
+        xSemaphoreTake(done_sem, pdMS_TO_TICKS(wait_us / 1000) + 1);
+
+        /* Collect results; give up on calls past their deadline, or on all of them when cancelled */
+        now = esp_timer_get_time();
+        cancelled = cancel && *cancel;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int i = 0; i < count; i++) {
+            if (phase[i] == PHASE_PENDING && cancelled) {
+                job_free(jobs[i]);
+                mark_cancelled(&calls[i]);
+                jobs[i] = NULL;
+                phase[i] = PHASE_FINISHED;
+                finished++;
+                continue;
+            }
+            if (phase[i] != PHASE_RUNNING) continue;
+            tool_job_t *job = jobs[i];
+            if (job->done) {
+                calls[i].output = job->output;
+                calls[i].err = job->err;
+                job->output = NULL;
+                job_free(job);
+            } else if (now >= deadline_us[i]) {
+                ESP_LOGW(TAG, "Tool %s timed out after %d ms", calls[i].name, MIMI_TOOL_TIMEOUT_MS);
+                job->abandoned = true;
+                calls[i].output = error_text("Error: tool '%s' timed out", calls[i].name);
+                calls[i].err = ESP_ERR_TIMEOUT;
+            } else if (cancelled) {
+                ESP_LOGI(TAG, "Tool %s abandoned: turn cancelled", calls[i].name);
+                job->abandoned = true;
+                mark_cancelled(&calls[i]);
+            } else {
+                continue;
+            }
+            jobs[i] = NULL;
+            phase[i] = PHASE_FINISHED;
+            finished++;
+        }
+        xSemaphoreGive(s_lock);
+    }
+
+    /* Abandoned jobs never signal, so the semaphore is no longer referenced */
+    vSemaphoreDelete(done_sem);
+    return cancelled ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
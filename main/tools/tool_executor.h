@@ -0,0 +1,35 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+/* ── Concurrent tool execution ────────────────────────────────── */
+
+typedef struct {
+    const char *name;       /* in: tool name */
+    const char *input;      /* in: JSON input, only read during tool_executor_run() */
+    char *output;           /* out: result text (heap), free() after use */
+    esp_err_t err;          /* out: tool status, ESP_ERR_TIMEOUT if abandoned,
+                               ESP_ERR_INVALID_STATE if cancelled */
+} tool_exec_call_t;
+
+/**
+ * Start the worker tasks. If none can be created, tool_executor_run()
+ * falls back to running calls one after another in the caller's task.
+ */
+esp_err_t tool_executor_init(void);
+
+/**
+ * Run the tool calls of one LLM response. Calls that do not conflict
+ * (see mimi_tool_conc_t) run concurrently on the worker pool; a call that
+ * conflicts with an earlier one waits for it. Each call gets its own
+ * output buffer and MIMI_TOOL_TIMEOUT_MS; results stay in call order.
+ * Every calls[i].output is set on return.
+ *
+ * @param cancel  Optional flag polled every MIMI_TOOL_CANCEL_POLL_MS: once
+ *                set, calls not started yet are skipped and running ones
+ *                are abandoned (their results dropped when they return)
+ * @return ESP_ERR_INVALID_STATE if the run was cancelled
+ */
+esp_err_t tool_executor_run(tool_exec_call_t *calls, int count, const volatile bool *cancel);
@@ -43,7 +43,7 @@ static void build_tools_json(void)
         cJSON_AddItemToArray(arr, tool);
     }
 
-    free(s_tools_json);
+    cJSON_free(s_tools_json);
     s_tools_json = cJSON_PrintUnformatted(arr);
     cJSON_Delete(arr);
 
@@ -65,6 +65,8 @@ esp_err_t tool_registry_init(void)
             "\"properties\":{\"query\":{\"type\":\"string\",\"description\":\"The search query\"}},"
             "\"required\":[\"query\"]}",
         .execute = tool_web_search_execute,
+        .concurrency = TOOL_CONC_PARALLEL,
+        .read_only = true,
     };
     register_tool(&ws);
 
@@ -77,6 +79,8 @@ esp_err_t tool_registry_init(void)
             "\"properties\":{},"
             "\"required\":[]}",
         .execute = tool_get_time_execute,
+        .concurrency = TOOL_CONC_PARALLEL,
+        .read_only = true,
     };
     register_tool(&gt);
 
@@ -89,6 +93,8 @@ esp_err_t tool_registry_init(void)
             "\"properties\":{\"path\":{\"type\":\"string\",\"description\":\"Absolute path starting with /spiffs/\"}},"
             "\"required\":[\"path\"]}",
         .execute = tool_read_file_execute,
+        .concurrency = TOOL_CONC_PATH_READ,
+        .read_only = true,
     };
     register_tool(&rf);
 
@@ -102,6 +108,7 @@ esp_err_t tool_registry_init(void)
             "\"content\":{\"type\":\"string\",\"description\":\"File content to write\"}},"
             "\"required\":[\"path\",\"content\"]}",
         .execute = tool_write_file_execute,
+        .concurrency = TOOL_CONC_PATH_WRITE,
     };
     register_tool(&wf);
 
@@ -116,6 +123,7 @@ esp_err_t tool_registry_init(void)
             "\"new_string\":{\"type\":\"string\",\"description\":\"Replacement text\"}},"
             "\"required\":[\"path\",\"old_string\",\"new_string\"]}",
         .execute = tool_edit_file_execute,
+        .concurrency = TOOL_CONC_PATH_WRITE,
     };
     register_tool(&ef);
 
@@ -128,6 +136,8 @@ esp_err_t tool_registry_init(void)
             "\"properties\":{\"prefix\":{\"type\":\"string\",\"description\":\"Optional path prefix filter, e.g. /spiffs/memory/\"}},"
             "\"required\":[]}",
         .execute = tool_list_dir_execute,
+        .concurrency = TOOL_CONC_PATH_READ,
+        .read_only = true,
     };
     register_tool(&ld);
 
@@ -160,6 +170,7 @@ esp_err_t tool_registry_init(void)
             "\"properties\":{},"
             "\"required\":[]}",
         .execute = tool_cron_list_execute,
+        .read_only = true,
     };
     register_tool(&cl);
 
@@ -186,14 +197,21 @@ const char *tool_registry_get_tools_json(void)
     return s_tools_json;
 }
 
+const mimi_tool_t *tool_registry_find(const char *name)
+{
+    for (int i = 0; i < s_tool_count; i++) {
+        if (strcmp(s_tools[i].name, name) == 0) return &s_tools[i];
+    }
+    return NULL;
+}
+
 esp_err_t tool_registry_execute(const char *name, const char *input_json,
                                 char *output, size_t output_size)
 {
-    for (int i = 0; i < s_tool_count; i++) {
-        if (strcmp(s_tools[i].name, name) == 0) {
-            ESP_LOGI(TAG, "Executing tool: %s", name);
-            return s_tools[i].execute(input_json, output, output_size);
-        }
+    const mimi_tool_t *tool = tool_registry_find(name);
+    if (tool) {
+        ESP_LOGI(TAG, "Executing tool: %s", name);
+        return tool->execute(input_json, output, output_size);
     }
 
     ESP_LOGW(TAG, "Unknown tool: %s", name);
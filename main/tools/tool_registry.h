@@ -2,12 +2,23 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include <stdbool.h>
+
+/* How a tool may overlap with other calls of the same LLM response */
+typedef enum {
+    TOOL_CONC_EXCLUSIVE = 0,        /* default: waits for earlier calls, blocks later ones */
+    TOOL_CONC_PARALLEL,             /* no shared state, runs alongside anything */
+    TOOL_CONC_PATH_READ,            /* reads input "path" / "prefix" */
+    TOOL_CONC_PATH_WRITE,           /* writes input "path": serialized with overlapping paths */
+} mimi_tool_conc_t;
 
 typedef struct {
     const char *name;
     const char *description;
     const char *input_schema_json;  /* JSON Schema string for input */
     esp_err_t (*execute)(const char *input_json, char *output, size_t output_size);
+    mimi_tool_conc_t concurrency;
+    bool read_only;                 /* no side effects: a cancelled turn that ran it may be replayed */
 } mimi_tool_t;
 
 /**
@@ -21,6 +32,11 @@ esp_err_t tool_registry_init(void);
  */
 const char *tool_registry_get_tools_json(void);
 
+/**
+ * Look up a registered tool. Returns NULL if unknown.
+ */
+const mimi_tool_t *tool_registry_find(const char *name);
+
 /**
  * Execute a tool by name.
  *